@@ -0,0 +1,255 @@
+#ifndef SURFY_GEOM_BATCH_HPP
+#define SURFY_GEOM_BATCH_HPP
+
+/*
+
+Batch
+Operations over many inputs at once.
+
+*/
+
+#include <cstdint>
+#include <span>
+#include "geom.hpp"
+#include "pool.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace surfy::geom::batch {
+
+	/*
+
+	Edges
+	Ring laid out once for ray casting: vertex i, the y of vertex i - 1 and the slope between them.
+	Horizontal edges get slope 0, they never cross a ray anyway.
+
+	*/
+
+	struct Edges {
+		std::vector<double> x, y, prev, slope;
+
+		Edges(const Coords& ring) {
+			size_t size = ring.size();
+			x.resize(size);
+			y.resize(size);
+			prev.resize(size);
+			slope.resize(size);
+
+			for (size_t i = 0, j = size - 1; i < size; j = i++) {
+				x[i] = ring[i].x;
+				y[i] = ring[i].y;
+				prev[i] = ring[j].y;
+				slope[i] = (ring[j].y != ring[i].y) ? (ring[j].x - ring[i].x) / (ring[j].y - ring[i].y) : 0;
+			}
+		}
+
+		size_t size() const {
+			return x.size();
+		}
+	};
+
+	/*
+
+	Inside
+	Point in ring for every point, out[i] is 1 or 0. Same rule as utils::inside, vertices count as inside.
+	Points are taken 8 at a time and every edge is tested against the whole block,
+	in two AVX2 registers when built with -mavx2, plain loops otherwise.
+	out must hold at least points.size() values.
+
+	*/
+
+	void inside(std::span<const Point> points, const Edges& edges, std::span<uint8_t> out) {
+		constexpr size_t BLOCK = 8;
+		size_t count = std::min(points.size(), out.size());
+		size_t size = edges.size();
+		size_t i = 0;
+
+		if (size == 0) {
+			std::fill(out.begin(), out.begin() + count, 0);
+			return;
+		}
+
+		const double* ex = edges.x.data();
+		const double* ey = edges.y.data();
+		const double* ep = edges.prev.data();
+		const double* es = edges.slope.data();
+
+#if defined(__AVX2__)
+
+		// x0 y0 x1 y1, x2 y2 x3 y3 -> x0 x1 x2 x3, y0 y1 y2 y3
+		auto load = [](const Point* p, __m256d& px, __m256d& py) {
+			__m256d a = _mm256_loadu_pd(&p[0].x);
+			__m256d b = _mm256_loadu_pd(&p[2].x);
+			px = _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), 0b11011000);
+			py = _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), 0b11011000);
+		};
+
+		for (; i + BLOCK <= count; i += BLOCK) {
+			__m256d px0, py0, px1, py1;
+			load(&points[i], px0, py0);
+			load(&points[i + 4], px1, py1);
+
+			__m256d odd0 = _mm256_setzero_pd();
+			__m256d odd1 = _mm256_setzero_pd();
+			__m256d hit0 = _mm256_setzero_pd();
+			__m256d hit1 = _mm256_setzero_pd();
+
+			for (size_t e = 0; e < size; ++e) {
+				__m256d x = _mm256_broadcast_sd(&ex[e]);
+				__m256d y = _mm256_broadcast_sd(&ey[e]);
+				__m256d prev = _mm256_broadcast_sd(&ep[e]);
+				__m256d slope = _mm256_broadcast_sd(&es[e]);
+
+				// (y > py) != (prev > py) && px <= slope * (py - y) + x
+				__m256d cross0 = _mm256_xor_pd(_mm256_cmp_pd(y, py0, _CMP_GT_OQ), _mm256_cmp_pd(prev, py0, _CMP_GT_OQ));
+				__m256d cross1 = _mm256_xor_pd(_mm256_cmp_pd(y, py1, _CMP_GT_OQ), _mm256_cmp_pd(prev, py1, _CMP_GT_OQ));
+				__m256d at0 = _mm256_add_pd(_mm256_mul_pd(slope, _mm256_sub_pd(py0, y)), x);
+				__m256d at1 = _mm256_add_pd(_mm256_mul_pd(slope, _mm256_sub_pd(py1, y)), x);
+				odd0 = _mm256_xor_pd(odd0, _mm256_and_pd(cross0, _mm256_cmp_pd(px0, at0, _CMP_LE_OQ)));
+				odd1 = _mm256_xor_pd(odd1, _mm256_and_pd(cross1, _mm256_cmp_pd(px1, at1, _CMP_LE_OQ)));
+
+				hit0 = _mm256_or_pd(hit0, _mm256_and_pd(_mm256_cmp_pd(px0, x, _CMP_EQ_OQ), _mm256_cmp_pd(py0, y, _CMP_EQ_OQ)));
+				hit1 = _mm256_or_pd(hit1, _mm256_and_pd(_mm256_cmp_pd(px1, x, _CMP_EQ_OQ), _mm256_cmp_pd(py1, y, _CMP_EQ_OQ)));
+			}
+
+			int mask = _mm256_movemask_pd(_mm256_or_pd(odd0, hit0)) | (_mm256_movemask_pd(_mm256_or_pd(odd1, hit1)) << 4);
+			for (size_t k = 0; k < BLOCK; ++k) {
+				out[i + k] = (mask >> k) & 1;
+			}
+		}
+
+#else
+
+		for (; i + BLOCK <= count; i += BLOCK) {
+			double px[BLOCK], py[BLOCK];
+			uint8_t odd[BLOCK] = {}, hit[BLOCK] = {};
+			for (size_t k = 0; k < BLOCK; ++k) {
+				px[k] = points[i + k].x;
+				py[k] = points[i + k].y;
+			}
+
+			for (size_t e = 0; e < size; ++e) {
+				for (size_t k = 0; k < BLOCK; ++k) {
+					bool cross = (ey[e] > py[k]) != (ep[e] > py[k]);
+					odd[k] ^= cross && px[k] <= es[e] * (py[k] - ey[e]) + ex[e];
+					hit[k] |= px[k] == ex[e] && py[k] == ey[e];
+				}
+			}
+
+			for (size_t k = 0; k < BLOCK; ++k) {
+				out[i + k] = odd[k] | hit[k];
+			}
+		}
+
+#endif
+
+		// Tail
+		for (; i < count; ++i) {
+			const Point& p = points[i];
+			uint8_t odd = 0, hit = 0;
+			for (size_t e = 0; e < size; ++e) {
+				bool cross = (ey[e] > p.y) != (ep[e] > p.y);
+				odd ^= cross && p.x <= es[e] * (p.y - ey[e]) + ex[e];
+				hit |= p.x == ex[e] && p.y == ey[e];
+			}
+			out[i] = odd | hit;
+		}
+	}
+
+	void inside(std::span<const Point> points, const Coords& ring, std::span<uint8_t> out) {
+		inside(points, Edges(ring), out);
+	}
+
+	/*
+
+	Chunks
+	Consecutive [first, last) ranges of about equal vertex count, at most parts of them.
+	A huge polygon ends up alone in its range instead of dragging a range of small ones with it.
+
+	*/
+
+	std::vector<std::pair<size_t, size_t>> chunks(std::span<const Shape> shapes, size_t parts) {
+		std::vector<std::pair<size_t, size_t>> result;
+		if (shapes.empty() || parts == 0) {
+			return result;
+		}
+
+		size_t total = 0;
+		for (const Shape& shape : shapes) {
+			total += std::max<size_t>(1, shape.vertices);
+		}
+
+		size_t target = (total + parts - 1) / parts;
+		size_t weight = 0;
+		size_t first = 0;
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			weight += std::max<size_t>(1, shapes[i].vertices);
+			if (weight >= target || i + 1 == shapes.size()) {
+				result.push_back({first, i + 1});
+				first = i + 1;
+				weight = 0;
+			}
+		}
+		return result;
+	}
+
+	/*
+
+	For Each
+	function(index, shape) for every Shape of a vector or span, on the pool (the shared one by default).
+	function runs on worker threads and must be thread-safe.
+	Work is split by vertex count, a few chunks per worker so idle workers can steal.
+	Every Shape is handled by exactly one call, so writing results by index keeps the input order.
+	An exception from function skips the chunks not yet started and is rethrown to the caller.
+	Safe to call from inside a task of the same pool.
+
+	*/
+
+	template <typename Shapes, typename Function>
+	void forEach(Shapes&& shapes, Function&& function, pool::Pool& workers = pool::shared()) {
+		const size_t CHUNKS_PER_WORKER = 4;
+		std::span<const Shape> all(std::data(shapes), std::size(shapes));
+		std::vector<std::pair<size_t, size_t>> ranges = chunks(all, workers.size() * CHUNKS_PER_WORKER);
+
+		if (ranges.size() < 2) {
+			for (size_t i = 0; i < all.size(); ++i) {
+				function(i, shapes[i]);
+			}
+			return;
+		}
+
+		pool::Group group;
+		for (const auto& [first, last] : ranges) {
+			workers.submit(group, [&shapes, &function, first, last]() {
+				for (size_t i = first; i < last; ++i) {
+					function(i, shapes[i]);
+				}
+			});
+		}
+		workers.wait(group);
+	}
+
+	// Shape::clip for every Shape, in place
+	void clip(std::span<Shape> shapes, const Coords& mask, pool::Pool& workers = pool::shared()) {
+		forEach(shapes, [&mask](size_t, Shape& shape) {
+			shape.clip(mask);
+		}, workers);
+	}
+
+	void clip(std::span<Shape> shapes, const BBox& bbox, const double& buffer = 0., pool::Pool& workers = pool::shared()) {
+		forEach(shapes, [&bbox, &buffer](size_t, Shape& shape) {
+			shape.clip(bbox, buffer);
+		}, workers);
+	}
+
+	// Shape::simplify for every Shape, in place
+	void simplify(std::span<Shape> shapes, const double& tolerance, pool::Pool& workers = pool::shared()) {
+		forEach(shapes, [&tolerance](size_t, Shape& shape) {
+			shape.simplify(tolerance);
+		}, workers);
+	}
+}
+
+#endif
@@ -150,6 +150,115 @@ namespace surfy::geom {
 			return outputList;
 		}
 
+		/*
+
+		Rect
+		Sutherland-Hodgman against an axis-aligned box, the same passes as utils::mask(box)
+		(bottom, right, top, left, boundary inclusive) without the general line intersection.
+
+		*/
+
+		Coords rect(const Coords& ring, const BBox& box) {
+			Coords input;
+			Coords output = ring;
+
+			auto pass = [&](auto inside, auto cross) {
+				input.swap(output);
+				output.clear();
+				size_t size = input.size();
+				for (size_t j = 0; j < size; ++j) {
+					const Point& P = input[j];
+					const Point& Q = input[(j + 1) % size];
+					if (inside(Q)) {
+						if (!inside(P)) {
+							output.push_back(cross(P, Q));
+						}
+						output.push_back(Q);
+					} else if (inside(P)) {
+						output.push_back(cross(P, Q));
+					}
+				}
+			};
+
+			auto atY = [](const Point& P, const Point& Q, const double& y) {
+				return Point{P.x + (Q.x - P.x) * (y - P.y) / (Q.y - P.y), y};
+			};
+
+			auto atX = [](const Point& P, const Point& Q, const double& x) {
+				return Point{x, P.y + (Q.y - P.y) * (x - P.x) / (Q.x - P.x)};
+			};
+
+			pass([&](const Point& p) { return p.y >= box[1]; }, [&](const Point& P, const Point& Q) { return atY(P, Q, box[1]); });
+			pass([&](const Point& p) { return p.x <= box[2]; }, [&](const Point& P, const Point& Q) { return atX(P, Q, box[2]); });
+			pass([&](const Point& p) { return p.y <= box[3]; }, [&](const Point& P, const Point& Q) { return atY(P, Q, box[3]); });
+			pass([&](const Point& p) { return p.x >= box[0]; }, [&](const Point& P, const Point& Q) { return atX(P, Q, box[0]); });
+
+			return output;
+		}
+
+		/*
+
+		Rect Lines
+		Liang-Barsky against an axis-aligned box, boundary inclusive.
+		A line that leaves the box and comes back gives one piece per stay inside.
+
+		*/
+
+		std::vector<Coords> lines(const Coords& line, const BBox& box) {
+			std::vector<Coords> pieces;
+			Coords piece;
+
+			for (size_t i = 1; i < line.size(); ++i) {
+				const Point& a = line[i - 1];
+				const Point& b = line[i];
+				double dx = b.x - a.x;
+				double dy = b.y - a.y;
+				double enter = 0;
+				double leave = 1;
+
+				// Keeps the part of the segment where p * t <= q
+				auto edge = [&](double p, double q) {
+					if (p == 0) {
+						return q >= 0;
+					}
+					double t = q / p;
+					if (p < 0) {
+						enter = std::max(enter, t);
+					} else {
+						leave = std::min(leave, t);
+					}
+					return enter <= leave;
+				};
+
+				if (!(edge(-dx, a.x - box[0]) && edge(dx, box[2] - a.x) && edge(-dy, a.y - box[1]) && edge(dy, box[3] - a.y))) {
+					if (piece.size() > 1) {
+						pieces.push_back(std::move(piece));
+					}
+					piece.clear();
+					continue;
+				}
+
+				if (piece.empty() || enter > 0) {
+					if (piece.size() > 1) {
+						pieces.push_back(std::move(piece));
+					}
+					piece.clear();
+					piece.push_back(enter > 0 ? Point{a.x + enter * dx, a.y + enter * dy} : a);
+				}
+				piece.push_back(leave < 1 ? Point{a.x + leave * dx, a.y + leave * dy} : b);
+
+				if (leave < 1) {
+					pieces.push_back(std::move(piece));
+					piece.clear();
+				}
+			}
+
+			if (piece.size() > 1) {
+				pieces.push_back(std::move(piece));
+			}
+			return pieces;
+		}
+
 	}
 
 	/*
@@ -212,4 +321,70 @@ namespace surfy::geom {
 
 		refresh();
 	}
+
+	/*
+
+	Clip by BBox
+	Box is expanded by buffer on every side, e.g. a tile with its render margin.
+	Shapes already inside the expanded box are left untouched.
+	Lines are cut into the pieces inside the box, a Line cut in several becomes a MultiLine.
+
+	*/
+
+	void Shape::clip(const BBox& box, const double& buffer = 0.) {
+		BBox expanded = {box[0] - buffer, box[1] - buffer, box[2] + buffer, box[3] + buffer};
+
+		if (empty || (bbox[0] >= expanded[0] && bbox[1] >= expanded[1] && bbox[2] <= expanded[2] && bbox[3] <= expanded[3])) {
+			return;
+		}
+
+		// Rings take the axis-aligned clipper, the rest the general mask
+		if (type == "Polygon") {
+			if (!geom.polygon.outer.empty) {
+				geom.polygon.outer.coords = clippers::rect(geom.polygon.outer.coords, expanded);
+			}
+			if (!geom.polygon.inner.empty) {
+				geom.polygon.inner.coords = clippers::rect(geom.polygon.inner.coords, expanded);
+			}
+			refresh();
+		} else if (type == "MultiPolygon") {
+			for (types::Polygon& poly : geom.multiPolygon.items) {
+				if (!poly.outer.empty) {
+					poly.outer.coords = clippers::rect(poly.outer.coords, expanded);
+				}
+				if (!poly.inner.empty) {
+					poly.inner.coords = clippers::rect(poly.inner.coords, expanded);
+				}
+			}
+			refresh();
+		} else if (type == "Line" || type == "MultiLine") {
+			types::MultiLine pieces;
+			if (type == "Line") {
+				for (Coords& piece : clippers::lines(geom.line.coords, expanded)) {
+					pieces.items.emplace_back().coords = std::move(piece);
+				}
+			} else {
+				for (const types::Line& line : geom.multiLine.items) {
+					for (Coords& piece : clippers::lines(line.coords, expanded)) {
+						pieces.items.emplace_back().coords = std::move(piece);
+					}
+				}
+			}
+
+			if (type == "Line" && pieces.items.size() <= 1) {
+				geom.line.coords = pieces.items.empty() ? Coords() : std::move(pieces.items.front().coords);
+			} else {
+				if (type == "Line") {
+					geom.line.~Line();
+					new (&geom.multiLine) types::MultiLine();
+					typeID = 3;
+					type = "MultiLine";
+				}
+				geom.multiLine.items = std::move(pieces.items);
+			}
+			refresh();
+		} else {
+			clip(utils::mask(expanded));
+		}
+	}
 }
\ No newline at end of file
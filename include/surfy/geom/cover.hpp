@@ -0,0 +1,361 @@
+#ifndef SURFY_GEOM_COVER_HPP
+#define SURFY_GEOM_COVER_HPP
+
+/*
+
+Cover
+Grid cells (quadkey or geohash) covering a Polygon or MultiPolygon.
+Rings are scanned row by row with an active edge table: cells an edge passes through are boundary,
+cells between crossings of the row centre line are interior (even-odd, holes included).
+Full blocks of interior cells are merged into their parent, and a cell budget is met
+by coarsening the boundary, so a covering mixes levels.
+
+*/
+
+#include <cstdint>
+#include <tuple>
+#include <unordered_set>
+#include "geom.hpp"
+#include "tiles.hpp"
+
+namespace surfy::geom::cover {
+
+	enum Scheme {
+		Quadkey, // Web Mercator tiles, x from the west, y from the top like tiles::TileID
+		Geohash // Lon/Lat, x from the west, y from the south
+	};
+
+	// Ordered by level, x, y. Geohash level 12 has 30 bits per axis, too many to pack all three in 64 bits
+	struct Cell {
+		uint32_t level, x, y;
+
+		bool operator==(const Cell& other) const {
+			return level == other.level && x == other.x && y == other.y;
+		}
+
+		bool operator<(const Cell& other) const {
+			return std::tie(level, x, y) < std::tie(other.level, other.x, other.y);
+		}
+	};
+
+	struct Covering {
+		std::vector<Cell> interior; // Fully inside
+		std::vector<Cell> boundary; // Touched by a ring
+
+		size_t size() const {
+			return interior.size() + boundary.size();
+		}
+	};
+
+	class Grid {
+	public:
+		Scheme scheme;
+
+		Grid(Scheme scheme = Quadkey) : scheme(scheme) {}
+
+		uint32_t maxLevel() const {
+			return scheme == Quadkey ? 29 : 12;
+		}
+
+		// Bits per axis at level, geohash starts with longitude
+		uint32_t xBits(uint32_t level) const {
+			return scheme == Quadkey ? level : (5 * level + 1) / 2;
+		}
+
+		uint32_t yBits(uint32_t level) const {
+			return scheme == Quadkey ? level : 5 * level / 2;
+		}
+
+		Cell parent(const Cell& cell, uint32_t level) const {
+			return {level, cell.x >> (xBits(cell.level) - xBits(level)), cell.y >> (yBits(cell.level) - yBits(level))};
+		}
+
+		Cell parent(const Cell& cell) const {
+			return parent(cell, cell.level - 1);
+		}
+
+		// Cell bounds, EPSG:3857 for quadkeys, Lon/Lat for geohashes
+		BBox bbox(const Cell& cell) const {
+			if (scheme == Quadkey) {
+				return tiles::bbox(tiles::TileID{cell.level, cell.x, cell.y});
+			}
+
+			double width = 360. / static_cast<double>(1ULL << xBits(cell.level));
+			double height = 180. / static_cast<double>(1ULL << yBits(cell.level));
+			return {-180. + cell.x * width, -90. + cell.y * height, -180. + (cell.x + 1) * width, -90. + (cell.y + 1) * height};
+		}
+
+		std::string key(const Cell& cell) const {
+			std::string result;
+
+			if (scheme == Quadkey) {
+				for (uint32_t i = cell.level; i > 0; --i) {
+					result.push_back('0' + (((cell.x >> (i - 1)) & 1) | (((cell.y >> (i - 1)) & 1) << 1)));
+				}
+				return result;
+			}
+
+			static const char* BASE32 = "0123456789bcdefghjkmnpqrstuvwxyz";
+			uint32_t xLeft = xBits(cell.level);
+			uint32_t yLeft = yBits(cell.level);
+			uint32_t value = 0;
+			for (uint32_t bit = 0; bit < 5 * cell.level; ++bit) {
+				uint32_t next = (bit % 2 == 0) ? (cell.x >> --xLeft) & 1 : (cell.y >> --yLeft) & 1;
+				value = (value << 1) | next;
+				if (bit % 5 == 4) {
+					result.push_back(BASE32[value]);
+					value = 0;
+				}
+			}
+			return result;
+		}
+
+		/*
+
+		Cover
+		Shape in Lon/Lat at level, maxCells = 0 means no limit.
+		Cost grows with the cells at level the Shape spans, pick the level to match its size.
+
+		*/
+
+		Covering cover(const Shape& shape, uint32_t level, size_t maxCells = 0) const {
+			level = std::min(level, maxLevel());
+			Covering result;
+
+			std::vector<Edge> edges;
+			if (shape.type == "Polygon") {
+				add(shape.geom.polygon, level, edges);
+			} else if (shape.type == "MultiPolygon") {
+				for (const types::Polygon& poly : shape.geom.multiPolygon.items) {
+					add(poly, level, edges);
+				}
+			}
+
+			if (edges.empty()) {
+				return result;
+			}
+
+			scan(edges, level, result);
+			compact(result.interior, level);
+
+			if (maxCells != 0) {
+				limit(result, level, maxCells);
+			}
+
+			std::sort(result.interior.begin(), result.interior.end());
+			std::sort(result.boundary.begin(), result.boundary.end());
+			return result;
+		}
+
+	private:
+
+		// Edge in cell units of the target level
+		struct Edge {
+			double x1, y1, x2, y2;
+			double bottom, top;
+		};
+
+		Point toGrid(const Point& p, uint32_t level) const {
+			double cols = static_cast<double>(1ULL << xBits(level));
+			double rows = static_cast<double>(1ULL << yBits(level));
+
+			if (scheme == Quadkey) {
+				Point m = tiles::mercator(p);
+				return {(m.x + tiles::R) / (2 * tiles::R) * cols, (tiles::R - m.y) / (2 * tiles::R) * rows};
+			}
+
+			return {(p.x + 180.) / 360. * cols, (p.y + 90.) / 180. * rows};
+		}
+
+		void add(const types::Polygon& poly, uint32_t level, std::vector<Edge>& edges) const {
+			for (const Coords* ring : {&poly.outer.coords, &poly.inner.coords}) {
+				size_t size = ring->size();
+				for (size_t i = 0, j = size - 1; i < size; j = i++) {
+					Point a = toGrid((*ring)[j], level);
+					Point b = toGrid((*ring)[i], level);
+					edges.push_back({a.x, a.y, b.x, b.y, std::min(a.y, b.y), std::max(a.y, b.y)});
+				}
+			}
+		}
+
+		/*
+
+		Scan
+		One pass over the rows with an active edge table sorted by bottom.
+		Boundary: columns an active edge spans within the row band.
+		Interior: columns whose centre lies between crossings of the row centre, minus boundary.
+
+		*/
+
+		void scan(std::vector<Edge>& edges, uint32_t level, Covering& result) const {
+			int64_t cols = 1LL << xBits(level);
+			int64_t rows = 1LL << yBits(level);
+
+			auto column = [cols](double x) {
+				return std::clamp<int64_t>(static_cast<int64_t>(std::floor(x)), 0, cols - 1);
+			};
+
+			std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+				return a.bottom < b.bottom;
+			});
+
+			double minY = edges.front().bottom;
+			double maxY = std::numeric_limits<double>::lowest();
+			for (const Edge& edge : edges) {
+				maxY = std::max(maxY, edge.top);
+			}
+
+			int64_t first = std::clamp<int64_t>(static_cast<int64_t>(std::floor(minY)), 0, rows - 1);
+			int64_t last = std::clamp<int64_t>(static_cast<int64_t>(std::floor(maxY)), 0, rows - 1);
+
+			std::vector<const Edge*> active;
+			std::vector<std::pair<int64_t, int64_t>> touched;
+			std::vector<double> crossings;
+			size_t next = 0;
+
+			for (int64_t row = first; row <= last; ++row) {
+				double low = static_cast<double>(row);
+				double high = low + 1;
+				double centre = low + .5;
+
+				// Rows outside the world take the edges beyond it too
+				if (row == rows - 1) {
+					high = std::numeric_limits<double>::max();
+				}
+				if (row == 0) {
+					low = std::numeric_limits<double>::lowest();
+				}
+
+				while (next < edges.size() && edges[next].bottom <= high) {
+					active.push_back(&edges[next++]);
+				}
+				active.erase(std::remove_if(active.begin(), active.end(), [low](const Edge* edge) {
+					return edge->top < low;
+				}), active.end());
+
+				touched.clear();
+				crossings.clear();
+
+				for (const Edge* edge : active) {
+					// X range of the edge within the band
+					double from = std::max(edge->bottom, low);
+					double to = std::min(edge->top, high);
+					double xa, xb;
+					if (edge->y1 == edge->y2) {
+						xa = edge->x1;
+						xb = edge->x2;
+					} else {
+						double slope = (edge->x2 - edge->x1) / (edge->y2 - edge->y1);
+						xa = edge->x1 + (from - edge->y1) * slope;
+						xb = edge->x1 + (to - edge->y1) * slope;
+
+						if ((edge->y1 > centre) != (edge->y2 > centre)) {
+							crossings.push_back(edge->x1 + (centre - edge->y1) * slope);
+						}
+					}
+					touched.push_back({column(std::min(xa, xb)), column(std::max(xa, xb))});
+				}
+
+				// Merge boundary runs
+				std::sort(touched.begin(), touched.end());
+				size_t merged = 0;
+				for (size_t i = 0; i < touched.size(); ++i) {
+					if (merged != 0 && touched[i].first <= touched[merged - 1].second + 1) {
+						touched[merged - 1].second = std::max(touched[merged - 1].second, touched[i].second);
+					} else {
+						touched[merged++] = touched[i];
+					}
+				}
+				touched.resize(merged);
+
+				for (const auto& [from, to] : touched) {
+					for (int64_t col = from; col <= to; ++col) {
+						result.boundary.push_back({level, static_cast<uint32_t>(col), static_cast<uint32_t>(row)});
+					}
+				}
+
+				// Spans between crossing pairs, skipping boundary runs
+				std::sort(crossings.begin(), crossings.end());
+				size_t run = 0;
+				for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+					int64_t from = std::max<int64_t>(0, static_cast<int64_t>(std::ceil(crossings[i] - .5)));
+					int64_t to = std::min<int64_t>(cols - 1, static_cast<int64_t>(std::floor(crossings[i + 1] - .5)));
+
+					for (int64_t col = from; col <= to; ++col) {
+						while (run < touched.size() && touched[run].second < col) {
+							++run;
+						}
+						if (run < touched.size() && touched[run].first <= col) {
+							col = touched[run].second;
+							continue;
+						}
+						result.interior.push_back({level, static_cast<uint32_t>(col), static_cast<uint32_t>(row)});
+					}
+				}
+			}
+		}
+
+		// Replace every complete set of interior children by their parent, bottom up. Cells are all at level
+		void compact(std::vector<Cell>& cells, uint32_t level) const {
+			std::vector<Cell> current;
+			std::vector<Cell> done;
+			current.swap(cells);
+
+			for (uint32_t l = level; l > 0 && !current.empty(); --l) {
+				size_t children = 1ULL << ((xBits(l) - xBits(l - 1)) + (yBits(l) - yBits(l - 1)));
+
+				std::sort(current.begin(), current.end(), [this](const Cell& a, const Cell& b) {
+					return parent(a) < parent(b);
+				});
+
+				std::vector<Cell> parents;
+				for (size_t i = 0; i < current.size();) {
+					Cell up = parent(current[i]);
+					size_t end = i;
+					while (end < current.size() && parent(current[end]) == up) {
+						++end;
+					}
+
+					if (end - i == children) {
+						parents.push_back(up);
+					} else {
+						done.insert(done.end(), current.begin() + i, current.begin() + end);
+					}
+					i = end;
+				}
+				current.swap(parents);
+			}
+
+			done.insert(done.end(), current.begin(), current.end());
+			cells.swap(done);
+		}
+
+		// Coarse cells all share one level, x and y alone tell them apart
+		static uint64_t position(const Cell& cell) {
+			return (static_cast<uint64_t>(cell.x) << 32) | cell.y;
+		}
+
+		// Coarsen the boundary a level at a time, interior cells under a coarse boundary cell go into it
+		void limit(Covering& result, uint32_t level, size_t maxCells) const {
+			while (result.size() > maxCells && level > 0) {
+				--level;
+
+				std::unordered_set<uint64_t> coarse;
+				std::vector<Cell> boundary;
+				for (const Cell& cell : result.boundary) {
+					Cell up = parent(cell, level);
+					if (coarse.insert(position(up)).second) {
+						boundary.push_back(up);
+					}
+				}
+				result.boundary.swap(boundary);
+
+				result.interior.erase(std::remove_if(result.interior.begin(), result.interior.end(), [&](const Cell& cell) {
+					return cell.level >= level && coarse.count(position(parent(cell, level))) != 0;
+				}), result.interior.end());
+			}
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef SURFY_GEOM_CURVE_HPP
+#define SURFY_GEOM_CURVE_HPP
+
+/*
+
+Curve
+64-bit Hilbert and Morton (Z-order) keys of bbox centres, 32 bits per axis,
+parallel radix sort by key, and partitioning of the sorted range into spatially compact chunks.
+Shapes close in key order are close in space, so processing them in that order keeps
+index nodes, tiles and edges hot in cache.
+
+*/
+
+#include <cstdint>
+#include <numeric>
+#include "geom.hpp"
+#include "pool.hpp"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace surfy::geom::curve {
+
+	enum Curve {
+		Hilbert,
+		Morton
+	};
+
+	/*
+
+	Spread
+	Bits of x to the even positions of a 64-bit word.
+	One pdep with BMI2, else the magic-number steps, which the compiler vectorizes in batch loops.
+
+	*/
+
+	uint64_t spread(uint32_t x) {
+#if defined(__BMI2__)
+		return _pdep_u64(x, 0x5555555555555555ull);
+#else
+		uint64_t v = x;
+		v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+		v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+		v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+		v = (v | (v << 2)) & 0x3333333333333333ull;
+		v = (v | (v << 1)) & 0x5555555555555555ull;
+		return v;
+#endif
+	}
+
+	uint64_t morton(uint32_t x, uint32_t y) {
+		return spread(x) | (spread(y) << 1);
+	}
+
+	/*
+
+	Hilbert
+	Position of x, y (32 bits each) on the Hilbert curve.
+	index::hilbert extended to 32 bits: one more prefix step, branch-free.
+
+	*/
+
+	uint64_t hilbert(uint32_t x, uint32_t y) {
+		const uint32_t F = 0xFFFFFFFF;
+
+		uint32_t a = x ^ y;
+		uint32_t b = F ^ a;
+		uint32_t c = F ^ (x | y);
+		uint32_t d = x & (y ^ F);
+
+		uint32_t A = a | (b >> 1);
+		uint32_t B = (a >> 1) ^ a;
+		uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+		uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+		for (uint32_t shift = 2; shift <= 8; shift <<= 1) {
+			a = A; b = B; c = C; d = D;
+			A = ((a & (a >> shift)) ^ (b & (b >> shift)));
+			B = ((a & (b >> shift)) ^ (b & ((a ^ b) >> shift)));
+			C ^= ((a & (c >> shift)) ^ (b & (d >> shift)));
+			D ^= ((b & (c >> shift)) ^ ((a ^ b) & (d >> shift)));
+		}
+
+		a = A; b = B; c = C; d = D;
+		C ^= ((a & (c >> 16)) ^ (b & (d >> 16)));
+		D ^= ((b & (c >> 16)) ^ ((a ^ b) & (d >> 16)));
+
+		a = C ^ (C >> 1);
+		b = D ^ (D >> 1);
+
+		uint32_t i0 = x ^ y;
+		uint32_t i1 = b | (F ^ (i0 | a));
+
+		return (spread(i1) << 1) | spread(i0);
+	}
+
+	/*
+
+	Keys
+	Key of every bbox centre on a 2^32 grid over bounds.
+	Bounds default to the union of all non-empty bboxes.
+
+	*/
+
+	BBox bounds(const std::vector<Shape>& shapes) {
+		BBox result = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+		for (const Shape& shape : shapes) {
+			if (shape.empty) {
+				continue;
+			}
+			result[0] = std::min(result[0], shape.bbox[0]);
+			result[1] = std::min(result[1], shape.bbox[1]);
+			result[2] = std::max(result[2], shape.bbox[2]);
+			result[3] = std::max(result[3], shape.bbox[3]);
+		}
+		return result;
+	}
+
+	std::vector<uint64_t> keys(const std::vector<Shape>& shapes, Curve curve, const BBox& bounds) {
+		const double cells = 4294967295.;
+		double sx = bounds[2] > bounds[0] ? cells / (bounds[2] - bounds[0]) : 0;
+		double sy = bounds[3] > bounds[1] ? cells / (bounds[3] - bounds[1]) : 0;
+
+		std::vector<uint64_t> result(shapes.size());
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			const BBox& b = shapes[i].bbox;
+			if (shapes[i].empty) {
+				continue;
+			}
+			uint32_t x = static_cast<uint32_t>(std::clamp(((b[0] + b[2]) / 2 - bounds[0]) * sx, .0, cells));
+			uint32_t y = static_cast<uint32_t>(std::clamp(((b[1] + b[3]) / 2 - bounds[1]) * sy, .0, cells));
+			result[i] = (curve == Hilbert) ? hilbert(x, y) : morton(x, y);
+		}
+		return result;
+	}
+
+	std::vector<uint64_t> keys(const std::vector<Shape>& shapes, Curve curve = Hilbert) {
+		return keys(shapes, curve, bounds(shapes));
+	}
+
+	/*
+
+	Radix Sort
+	LSD, 8 bits per pass, stable. Digits every key shares are skipped,
+	so keys packed into the low bits cost only the passes they need.
+	Each pass runs in blocks on workers: block histograms, offsets, then a parallel scatter.
+
+	*/
+
+	template <bool Paired, typename Value>
+	void radix(std::vector<uint64_t>& keys, std::vector<Value>& values, pool::Pool& workers) {
+		constexpr size_t DIGITS = 256;
+		constexpr size_t MIN_BLOCK = 1 << 16;
+		size_t size = keys.size();
+		if (size < 2) {
+			return;
+		}
+
+		// Bits that differ between keys, passes over equal bytes change nothing
+		uint64_t differ = 0;
+		for (size_t i = 1; i < size; ++i) {
+			differ |= keys[i] ^ keys[0];
+		}
+		if (differ == 0) {
+			return;
+		}
+
+		size_t blocks = std::clamp<size_t>(size / MIN_BLOCK, 1, workers.size());
+		size_t step = (size + blocks - 1) / blocks;
+
+		std::vector<uint64_t> keysBuffer(size);
+		std::vector<Value> valuesBuffer(Paired ? size : 0);
+		std::vector<std::array<size_t, DIGITS>> counts(blocks);
+
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			if (((differ >> shift) & 0xFF) == 0) {
+				continue;
+			}
+
+			pool::Group group;
+			for (size_t block = 0; block < blocks; ++block) {
+				workers.submit(group, [&, block]() {
+					const uint64_t* from = keys.data();
+					std::array<size_t, DIGITS> count = {};
+					for (size_t i = block * step, end = std::min(size, i + step); i < end; ++i) {
+						++count[(from[i] >> shift) & 0xFF];
+					}
+					counts[block] = count;
+				});
+			}
+			workers.wait(group);
+
+			// Digit major, block minor: stable across blocks
+			size_t offset = 0;
+			for (size_t digit = 0; digit < DIGITS; ++digit) {
+				for (size_t block = 0; block < blocks; ++block) {
+					size_t count = counts[block][digit];
+					counts[block][digit] = offset;
+					offset += count;
+				}
+			}
+
+			for (size_t block = 0; block < blocks; ++block) {
+				workers.submit(group, [&, block]() {
+					// Local copies, so stores to the buffers can't alias the positions
+					std::array<size_t, DIGITS> position = counts[block];
+					const uint64_t* from = keys.data();
+					uint64_t* to = keysBuffer.data();
+					Value* fromValues = values.data();
+					Value* toValues = valuesBuffer.data();
+
+					for (size_t i = block * step, end = std::min(size, i + step); i < end; ++i) {
+						size_t at = position[(from[i] >> shift) & 0xFF]++;
+						to[at] = from[i];
+						if constexpr (Paired) {
+							toValues[at] = std::move(fromValues[i]);
+						}
+					}
+				});
+			}
+			workers.wait(group);
+
+			keys.swap(keysBuffer);
+			if constexpr (Paired) {
+				values.swap(valuesBuffer);
+			}
+		}
+	}
+
+	// Keys only
+	void sort(std::vector<uint64_t>& keys, pool::Pool& workers = pool::shared()) {
+		std::vector<uint8_t> none;
+		radix<false>(keys, none, workers);
+	}
+
+	// Keys with values moved along, e.g. indices
+	template <typename Value>
+	void sort(std::vector<uint64_t>& keys, std::vector<Value>& values, pool::Pool& workers = pool::shared()) {
+		radix<true>(keys, values, workers);
+	}
+
+	/*
+
+	Order
+	Indices of shapes sorted by curve key, empty Shapes first.
+
+	*/
+
+	std::vector<size_t> order(const std::vector<Shape>& shapes, Curve curve = Hilbert, pool::Pool& workers = pool::shared()) {
+		std::vector<uint64_t> sorted = keys(shapes, curve);
+		std::vector<size_t> indices(shapes.size());
+		std::iota(indices.begin(), indices.end(), 0);
+		curve::sort(sorted, indices, workers);
+		return indices;
+	}
+
+	// Reorder shapes in place along the curve, moved, not copied
+	void sort(std::vector<Shape>& shapes, Curve curve = Hilbert, pool::Pool& workers = pool::shared()) {
+		std::vector<size_t> indices = order(shapes, curve, workers);
+		std::vector<Shape> sorted;
+		sorted.reserve(shapes.size());
+		for (size_t index : indices) {
+			sorted.emplace_back(std::move(shapes[index]));
+		}
+		shapes.swap(sorted);
+	}
+
+	/*
+
+	Partition
+	Splits shapes in order into parts of about equal vertex count, one per worker.
+	Each part is a run of the curve, so it covers a compact area, bbox is its extent.
+
+	*/
+
+	struct Range {
+		size_t first;
+		size_t last;
+		BBox bbox;
+	};
+
+	std::vector<Range> partition(const std::vector<Shape>& shapes, const std::vector<size_t>& order, size_t parts) {
+		std::vector<Range> result;
+		if (order.empty() || parts == 0) {
+			return result;
+		}
+
+		size_t total = 0;
+		for (size_t index : order) {
+			total += std::max<size_t>(1, shapes[index].vertices);
+		}
+
+		size_t target = (total + parts - 1) / parts;
+		size_t weight = 0;
+		Range range = {0, 0, {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()}};
+
+		for (size_t i = 0; i < order.size(); ++i) {
+			const Shape& shape = shapes[order[i]];
+			weight += std::max<size_t>(1, shape.vertices);
+			if (!shape.empty) {
+				range.bbox[0] = std::min(range.bbox[0], shape.bbox[0]);
+				range.bbox[1] = std::min(range.bbox[1], shape.bbox[1]);
+				range.bbox[2] = std::max(range.bbox[2], shape.bbox[2]);
+				range.bbox[3] = std::max(range.bbox[3], shape.bbox[3]);
+			}
+
+			if (weight >= target * (result.size() + 1) || i + 1 == order.size()) {
+				range.last = i + 1;
+				result.push_back(range);
+				range = {i + 1, i + 1, {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()}};
+			}
+		}
+
+		return result;
+	}
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef SURFY_GEOM_FILTER_HPP
+#define SURFY_GEOM_FILTER_HPP
+
+/*
+
+Filter
+Drops or collapses features too small to be seen, before clip and simplify spend time on them.
+Thresholds are given in Shape units, see tiles::pixelArea for a zoom-dependent pixel.
+
+*/
+
+#include "geom.hpp"
+
+namespace surfy::geom::filter {
+
+	enum Mode {
+		Drop,
+		Collapse // Tiny polygons add up their area, every full pixel of it is kept as a pixel square
+	};
+
+	struct Stats {
+		size_t features = 0; // Whole features dropped
+		size_t parts = 0; // MultiPolygon items dropped
+		size_t collapsed = 0; // Features or items replaced by a pixel square
+		size_t vertices = 0; // Vertices removed
+
+		Stats& operator+=(const Stats& other) {
+			features += other.features;
+			parts += other.parts;
+			collapsed += other.collapsed;
+			vertices += other.vertices;
+			return *this;
+		}
+	};
+
+	class Tiny {
+	public:
+		double area; // Min polygon area
+		double side; // Min bbox side for lines
+		Mode mode;
+		BBox bounds; // Collapsed squares are kept inside, e.g. the tile
+		Stats stats;
+
+		Tiny(const double& area, Mode mode = Drop, const BBox& bounds = {std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()}) : area(area), side(std::sqrt(area)), mode(mode), bounds(bounds) {}
+
+		/*
+
+		Below
+		Whole feature is under the threshold, decided by bbox and Shape::area only
+
+		*/
+
+		bool below(const Shape& shape) const {
+			if (shape.empty || shape.type == "Point") {
+				return false;
+			}
+
+			const BBox& b = shape.bbox;
+			double width = b[2] - b[0];
+			double height = b[3] - b[1];
+
+			if (shape.type == "Line" || shape.type == "MultiLine") {
+				return width < side && height < side;
+			}
+
+			// BBox area is an upper bound of the polygon area
+			return width * height < area || shape.area < area;
+		}
+
+		/*
+
+		Apply
+		Returns false if the Shape should be dropped.
+		MultiPolygon items under the threshold are removed one by one, counted in parts,
+		and a MultiPolygon left without items counts as a dropped feature as well.
+
+		*/
+
+		bool apply(Shape& shape) {
+			if (below(shape)) {
+				if (mode == Collapse && (shape.type == "Polygon" || shape.type == "MultiPolygon") && collapse(shape.area)) {
+					size_t before = shape.vertices;
+					squash(shape);
+					stats.vertices += before - std::min<size_t>(before, shape.vertices);
+					++stats.collapsed;
+					return true;
+				}
+
+				++stats.features;
+				stats.vertices += shape.vertices;
+				return false;
+			}
+
+			if (shape.type == "MultiPolygon") {
+				std::vector<types::Polygon>& items = shape.geom.multiPolygon.items;
+				size_t kept = 0;
+
+				for (size_t i = 0; i < items.size(); ++i) {
+					types::Polygon& poly = items[i];
+					if (poly.area >= area) {
+						if (kept != i) {
+							items[kept] = std::move(poly);
+						}
+						++kept;
+						continue;
+					}
+
+					if (mode == Collapse && collapse(poly.area)) {
+						stats.vertices += poly.vertices - std::min<size_t>(poly.vertices, 5);
+						poly.outer.coords = square(utils::bbox(poly.outer.coords));
+						poly.inner.coords.clear();
+						if (kept != i) {
+							items[kept] = std::move(poly);
+						}
+						++kept;
+						++stats.collapsed;
+						continue;
+					}
+
+					stats.vertices += poly.vertices;
+					++stats.parts;
+				}
+
+				if (kept != items.size()) {
+					items.erase(items.begin() + kept, items.end());
+					shape.refresh();
+				}
+
+				if (shape.empty) {
+					++stats.features;
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+	private:
+		double accumulated = 0;
+
+		// Adds area to the pool, true when a whole pixel has been collected
+		bool collapse(const double& dropped) {
+			accumulated += dropped;
+			if (accumulated >= area) {
+				accumulated -= area;
+				return true;
+			}
+			return false;
+		}
+
+		// Square of the threshold area centered on the bbox, moved inside bounds
+		Coords square(const BBox& b) const {
+			double half = side / 2;
+			double x = std::max(std::min((b[0] + b[2]) / 2, bounds[2] - half), bounds[0] + half);
+			double y = std::max(std::min((b[1] + b[3]) / 2, bounds[3] - half), bounds[1] + half);
+			return {{x - half, y - half}, {x + half, y - half}, {x + half, y + half}, {x - half, y + half}, {x - half, y - half}};
+		}
+
+		// Replace the geometry with one square, keeping the Shape type
+		void squash(Shape& shape) {
+			if (shape.type == "Polygon") {
+				shape.geom.polygon.outer.coords = square(shape.bbox);
+				shape.geom.polygon.inner.coords.clear();
+				shape.geom.polygon.inner.empty = true;
+			} else {
+				std::vector<types::Polygon>& items = shape.geom.multiPolygon.items;
+				items.resize(1);
+				items[0].outer.coords = square(shape.bbox);
+				items[0].inner.coords.clear();
+				items[0].inner.empty = true;
+			}
+			shape.refresh();
+		}
+	};
+}
+
+#endif
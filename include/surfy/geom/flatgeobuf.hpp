@@ -0,0 +1,897 @@
+#ifndef SURFY_GEOM_FLATGEOBUF_HPP
+#define SURFY_GEOM_FLATGEOBUF_HPP
+
+/*
+
+FlatGeobuf
+Reader and writer for FlatGeobuf 3 files: magic bytes, size-prefixed Header flatbuffer,
+packed Hilbert R-tree, then size-prefixed Feature flatbuffers in the order of the tree leaves.
+Flatbuffers are read and written by hand, only the tables and fields geometry needs.
+The reader memory-maps the file: a bbox query walks the tree and decodes only the features it hits.
+Assumes a little-endian host, like the format itself.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include "geom.hpp"
+#include "curve.hpp"
+#include "index.hpp"
+#include "../utils/mmap.hpp"
+
+namespace surfy::geom::flatgeobuf {
+
+	enum GeometryType : uint8_t {
+		Unknown = 0,
+		Point = 1,
+		LineString = 2,
+		Polygon = 3,
+		MultiPoint = 4,
+		MultiLineString = 5,
+		MultiPolygon = 6,
+		GeometryCollection = 7
+	};
+
+	const uint8_t MAGIC[8] = {0x66, 0x67, 0x62, 0x03, 0x66, 0x67, 0x62, 0x00};
+
+	// Tree node as stored, 40 bytes: bbox, then the feature offset (leaves) or the first child node
+	struct NodeItem {
+		double minX, minY, maxX, maxY;
+		uint64_t offset;
+	};
+
+	static_assert(sizeof(NodeItem) == 40);
+
+	/*
+
+	Level bounds
+	[first, last) node range of every tree level, leaves first. Levels are stored root first,
+	so the leaves are the last items of the index.
+
+	*/
+
+	std::vector<std::pair<uint64_t, uint64_t>> levels(uint64_t items, uint16_t nodeSize) {
+		std::vector<std::pair<uint64_t, uint64_t>> result;
+		if (items == 0 || nodeSize < 2) {
+			return result;
+		}
+
+		std::vector<uint64_t> counts = {items};
+		uint64_t n = items;
+		uint64_t nodes = n;
+		do {
+			n = (n + nodeSize - 1) / nodeSize;
+			nodes += n;
+			counts.push_back(n);
+		} while (n != 1);
+
+		for (uint64_t count : counts) {
+			nodes -= count;
+			result.push_back({nodes, nodes + count});
+		}
+		return result;
+	}
+
+	uint64_t nodes(uint64_t items, uint16_t nodeSize) {
+		std::vector<std::pair<uint64_t, uint64_t>> bounds = levels(items, nodeSize);
+		return bounds.empty() ? 0 : bounds.front().second;
+	}
+
+	namespace flatbuffers {
+
+		template <typename T>
+		T load(const uint8_t* at) {
+			T value;
+			std::memcpy(&value, at, sizeof(T));
+			return value;
+		}
+
+		template <typename T>
+		struct Vector {
+			const uint8_t* data = nullptr;
+			uint32_t size = 0;
+
+			T operator[](size_t i) const {
+				return load<T>(data + i * sizeof(T));
+			}
+		};
+
+		/*
+
+		Table
+		Read-only view of a flatbuffer table. The vtable lists field offsets by id, 0 for absent fields.
+		Every read is checked against the buffer, corrupt input throws instead of reading past it.
+
+		*/
+
+		struct Table {
+			const uint8_t* begin = nullptr;
+			const uint8_t* end = nullptr;
+			const uint8_t* at = nullptr;
+
+			static Table root(const uint8_t* data, size_t size) {
+				Table table = {data, data + size, nullptr};
+				table.at = table.follow(data);
+				return table;
+			}
+
+			explicit operator bool() const {
+				return at != nullptr;
+			}
+
+			void check(const uint8_t* from, size_t bytes) const {
+				if (from < begin || from > end || bytes > static_cast<size_t>(end - from)) {
+					throw std::runtime_error("FlatGeobuf: corrupt buffer");
+				}
+			}
+
+			// uoffset at slot to the object it points to
+			const uint8_t* follow(const uint8_t* slot) const {
+				check(slot, 4);
+				return slot + load<uint32_t>(slot);
+			}
+
+			const uint8_t* field(uint16_t id) const {
+				if (at == nullptr) {
+					return nullptr;
+				}
+				check(at, 4);
+				const uint8_t* vtable = at - load<int32_t>(at);
+				check(vtable, 4);
+				uint16_t size = load<uint16_t>(vtable);
+				if (4u + 2u * id + 2u > size) {
+					return nullptr;
+				}
+				check(vtable, size);
+				uint16_t offset = load<uint16_t>(vtable + 4 + 2 * id);
+				return offset == 0 ? nullptr : at + offset;
+			}
+
+			template <typename T>
+			T scalar(uint16_t id, T fallback = 0) const {
+				const uint8_t* slot = field(id);
+				if (slot == nullptr) {
+					return fallback;
+				}
+				check(slot, sizeof(T));
+				return load<T>(slot);
+			}
+
+			Table table(uint16_t id) const {
+				const uint8_t* slot = field(id);
+				return {begin, end, slot ? follow(slot) : nullptr};
+			}
+
+			template <typename T>
+			Vector<T> vector(uint16_t id) const {
+				const uint8_t* slot = field(id);
+				if (slot == nullptr) {
+					return {};
+				}
+				const uint8_t* length = follow(slot);
+				check(length, 4);
+				uint32_t size = load<uint32_t>(length);
+				check(length + 4, static_cast<size_t>(size) * sizeof(T));
+				return {length + 4, size};
+			}
+
+			std::string_view string(uint16_t id) const {
+				Vector<char> chars = vector<char>(id);
+				return {reinterpret_cast<const char*>(chars.data), chars.size};
+			}
+
+			// Vector of tables
+			size_t count(uint16_t id) const {
+				return vector<uint32_t>(id).size;
+			}
+
+			Table table(uint16_t id, size_t index) const {
+				Vector<uint32_t> offsets = vector<uint32_t>(id);
+				if (index >= offsets.size) {
+					throw std::runtime_error("FlatGeobuf: corrupt buffer");
+				}
+				return {begin, end, follow(offsets.data + index * 4)};
+			}
+		};
+
+		/*
+
+		Builder
+		Writes front to back: a table comes before what it references, so every uoffset points forward,
+		and its vtable just before it. Alignment is kept relative to the start of the buffer.
+
+		*/
+
+		class Builder {
+		public:
+			std::vector<uint8_t> bytes;
+
+			struct Field {
+				uint16_t id;
+				uint8_t size; // 1, 2, 4 or 8, references are 4
+				uint64_t value = 0;
+			};
+
+			// Slots of the reference fields of the last table, by id
+			std::array<size_t, 16> slots;
+
+			// Buffer starts with the root offset
+			void clear() {
+				bytes.assign(4, 0);
+			}
+
+			void root(size_t table) {
+				link(0, table);
+			}
+
+			void pad(size_t alignment, size_t extra = 0) {
+				while ((bytes.size() + extra) % alignment != 0) {
+					bytes.push_back(0);
+				}
+			}
+
+			template <typename T>
+			void put(const T& value) {
+				const uint8_t* raw = reinterpret_cast<const uint8_t*>(&value);
+				bytes.insert(bytes.end(), raw, raw + sizeof(T));
+			}
+
+			// Point the uoffset at slot to target
+			void link(size_t slot, size_t target) {
+				uint32_t offset = static_cast<uint32_t>(target - slot);
+				std::memcpy(bytes.data() + slot, &offset, 4);
+			}
+
+			// Elements aligned to their size, the length prefix right before them
+			template <typename T>
+			size_t vector(const T* data, size_t count) {
+				pad(std::max<size_t>(4, sizeof(T)), 4);
+				size_t at = bytes.size();
+				put(static_cast<uint32_t>(count));
+				const uint8_t* raw = reinterpret_cast<const uint8_t*>(data);
+				bytes.insert(bytes.end(), raw, raw + count * sizeof(T));
+				return at;
+			}
+
+			size_t string(std::string_view text) {
+				pad(4);
+				size_t at = bytes.size();
+				put(static_cast<uint32_t>(text.size()));
+				bytes.insert(bytes.end(), text.begin(), text.end());
+				bytes.push_back(0);
+				return at;
+			}
+
+			// Vector of count table offsets, slot i is at the result + 4 + 4 * i
+			size_t offsets(size_t count) {
+				pad(4);
+				size_t at = bytes.size();
+				put(static_cast<uint32_t>(count));
+				bytes.resize(bytes.size() + 4 * count, 0);
+				return at;
+			}
+
+			size_t table(std::vector<Field> fields) {
+				std::stable_sort(fields.begin(), fields.end(), [](const Field& a, const Field& b) {
+					return a.size > b.size;
+				});
+
+				uint16_t maxId = 0;
+				size_t align = 4;
+				size_t size = 4;
+				std::vector<uint16_t> offsets(fields.size());
+				for (size_t i = 0; i < fields.size(); ++i) {
+					size = (size + fields[i].size - 1) / fields[i].size * fields[i].size;
+					offsets[i] = static_cast<uint16_t>(size);
+					size += fields[i].size;
+					align = std::max<size_t>(align, fields[i].size);
+					maxId = std::max(maxId, fields[i].id);
+				}
+
+				pad(2);
+				size_t vtable = bytes.size();
+				put(static_cast<uint16_t>(4 + 2 * (maxId + 1)));
+				put(static_cast<uint16_t>(size));
+				for (uint16_t id = 0; id <= maxId; ++id) {
+					uint16_t offset = 0;
+					for (size_t i = 0; i < fields.size(); ++i) {
+						if (fields[i].id == id) {
+							offset = offsets[i];
+						}
+					}
+					put(offset);
+				}
+
+				pad(align);
+				size_t table = bytes.size();
+				put(static_cast<int32_t>(table - vtable));
+				bytes.resize(table + size, 0);
+				for (size_t i = 0; i < fields.size(); ++i) {
+					std::memcpy(bytes.data() + table + offsets[i], &fields[i].value, fields[i].size);
+					if (fields[i].id < slots.size()) {
+						slots[fields[i].id] = table + offsets[i];
+					}
+				}
+				return table;
+			}
+		};
+	}
+
+	struct Header {
+		std::string name;
+		BBox envelope = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+		GeometryType type = Unknown;
+		uint64_t count = 0;
+		uint16_t nodeSize = 0; // 0 = no index
+		int32_t crs = 0; // EPSG code, 0 = unknown
+	};
+
+	struct Options {
+		std::string name;
+		uint16_t nodeSize = 16; // 0 writes no index
+		int32_t crs = 0; // EPSG code written into the header, 0 = none
+	};
+
+	namespace encode {
+
+		// Rings flattened into xy, ends in vertices, open rings closed
+		void rings(const std::vector<const Coords*>& rings, bool closed, std::vector<double>& xy, std::vector<uint32_t>& ends) {
+			xy.clear();
+			ends.clear();
+			for (const Coords* ring : rings) {
+				for (const surfy::geom::Point& p : *ring) {
+					xy.push_back(p.x);
+					xy.push_back(p.y);
+				}
+				if (closed && ring->size() > 1 && (ring->front().x != ring->back().x || ring->front().y != ring->back().y)) {
+					xy.push_back(ring->front().x);
+					xy.push_back(ring->front().y);
+				}
+				ends.push_back(static_cast<uint32_t>(xy.size() / 2));
+			}
+		}
+
+		// Geometry table: ends 0, xy 1, type 6, parts 7
+		size_t geometry(flatbuffers::Builder& builder, GeometryType type, const std::vector<const Coords*>& parts, bool closed) {
+			std::vector<double> xy;
+			std::vector<uint32_t> ends;
+			rings(parts, closed, xy, ends);
+
+			bool multiple = ends.size() > 1;
+			std::vector<flatbuffers::Builder::Field> fields = {{1, 4}, {6, 1, type}};
+			if (multiple) {
+				fields.push_back({0, 4});
+			}
+
+			size_t table = builder.table(fields);
+			size_t xySlot = builder.slots[1];
+			size_t endsSlot = builder.slots[0];
+
+			if (multiple) {
+				builder.link(endsSlot, builder.vector(ends.data(), ends.size()));
+			}
+			builder.link(xySlot, builder.vector(xy.data(), xy.size()));
+			return table;
+		}
+
+		std::vector<const Coords*> polygon(const types::Polygon& poly) {
+			std::vector<const Coords*> rings = {&poly.outer.coords};
+			if (!poly.inner.coords.empty()) {
+				rings.push_back(&poly.inner.coords);
+			}
+			return rings;
+		}
+
+		// Feature flatbuffer of shape, geometry is field 0
+		void feature(flatbuffers::Builder& builder, const Shape& shape) {
+			builder.clear();
+
+			if (shape.empty || shape.type == "Dummy") {
+				builder.root(builder.table({}));
+				return;
+			}
+
+			size_t feature = builder.table({{0, 4}});
+			size_t geometrySlot = builder.slots[0];
+			builder.root(feature);
+
+			size_t geometry = 0;
+			if (shape.type == "Point") {
+				Coords point = {{shape.geom.point.x, shape.geom.point.y}};
+				geometry = encode::geometry(builder, Point, {&point}, false);
+			} else if (shape.type == "Line") {
+				geometry = encode::geometry(builder, LineString, {&shape.geom.line.coords}, false);
+			} else if (shape.type == "MultiLine") {
+				std::vector<const Coords*> lines;
+				for (const types::Line& line : shape.geom.multiLine.items) {
+					lines.push_back(&line.coords);
+				}
+				geometry = encode::geometry(builder, MultiLineString, lines, false);
+			} else if (shape.type == "Polygon") {
+				geometry = encode::geometry(builder, Polygon, polygon(shape.geom.polygon), true);
+			} else if (shape.type == "MultiPolygon") {
+				const std::vector<types::Polygon>& items = shape.geom.multiPolygon.items;
+				geometry = builder.table({{6, 1, MultiPolygon}, {7, 4}});
+				size_t partsSlot = builder.slots[7];
+				size_t offsets = builder.offsets(items.size());
+				builder.link(partsSlot, offsets);
+				for (size_t i = 0; i < items.size(); ++i) {
+					size_t part = encode::geometry(builder, Polygon, polygon(items[i]), true);
+					builder.link(offsets + 4 + 4 * i, part);
+				}
+			}
+			builder.link(geometrySlot, geometry);
+		}
+
+		GeometryType type(const Shape& shape) {
+			if (shape.type == "Point") {
+				return Point;
+			} else if (shape.type == "Line") {
+				return LineString;
+			} else if (shape.type == "MultiLine") {
+				return MultiLineString;
+			} else if (shape.type == "Polygon") {
+				return Polygon;
+			} else if (shape.type == "MultiPolygon") {
+				return MultiPolygon;
+			}
+			return Unknown;
+		}
+	}
+
+	/*
+
+	Write
+	Shapes are sorted along the Hilbert curve of their bbox centres, written in that order,
+	and the tree is built over them. Features are encoded twice, once to size them for the
+	leaf offsets and once to write, so memory stays at one feature however many there are.
+	Empty Shapes are written as features without geometry.
+
+	*/
+
+	bool write(const std::string& path, const std::vector<Shape>& shapes, const Options& options = {}) {
+		std::ofstream out(path, std::ios::binary);
+		if (!out.is_open()) {
+			std::cerr << "Error opening " << path << std::endl;
+			return false;
+		}
+
+		Header header;
+		header.count = shapes.size();
+		header.nodeSize = shapes.empty() ? 0 : options.nodeSize;
+		if (header.nodeSize == 1) {
+			header.nodeSize = 2;
+		}
+
+		bool first = true;
+		for (const Shape& shape : shapes) {
+			GeometryType type = encode::type(shape);
+			if (type != Unknown) {
+				header.type = first ? type : (header.type == type ? type : Unknown);
+				first = false;
+			}
+			if (!shape.empty) {
+				header.envelope[0] = std::min(header.envelope[0], shape.bbox[0]);
+				header.envelope[1] = std::min(header.envelope[1], shape.bbox[1]);
+				header.envelope[2] = std::max(header.envelope[2], shape.bbox[2]);
+				header.envelope[3] = std::max(header.envelope[3], shape.bbox[3]);
+			}
+		}
+		bool bounded = header.envelope[0] <= header.envelope[2];
+
+		// Hilbert order, 16 bits per axis like index::Packed
+		std::vector<size_t> order(shapes.size());
+		std::iota(order.begin(), order.end(), 0);
+		if (header.nodeSize != 0 && bounded) {
+			const BBox& e = header.envelope;
+			double width = e[2] - e[0];
+			double height = e[3] - e[1];
+			std::vector<uint64_t> keys(shapes.size());
+			for (size_t i = 0; i < shapes.size(); ++i) {
+				const BBox& b = shapes[i].bbox;
+				if (shapes[i].empty) {
+					continue;
+				}
+				uint32_t x = width > 0 ? static_cast<uint32_t>(65535. * ((b[0] + b[2]) / 2 - e[0]) / width) : 0;
+				uint32_t y = height > 0 ? static_cast<uint32_t>(65535. * ((b[1] + b[3]) / 2 - e[1]) / height) : 0;
+				keys[i] = index::hilbert(x, y);
+			}
+			curve::sort(keys, order);
+		}
+
+		// Header: name 0, envelope 1, geometry_type 2, features_count 8, index_node_size 9, crs 10
+		flatbuffers::Builder builder;
+		builder.clear();
+		std::vector<flatbuffers::Builder::Field> fields = {{2, 1, header.type}, {8, 8, header.count}, {9, 2, header.nodeSize}};
+		if (!options.name.empty()) {
+			fields.push_back({0, 4});
+		}
+		if (bounded) {
+			fields.push_back({1, 4});
+		}
+		if (options.crs != 0) {
+			fields.push_back({10, 4});
+		}
+		builder.root(builder.table(fields));
+		std::array<size_t, 16> slots = builder.slots;
+
+		if (!options.name.empty()) {
+			builder.link(slots[0], builder.string(options.name));
+		}
+		if (bounded) {
+			builder.link(slots[1], builder.vector(header.envelope.data(), 4));
+		}
+		if (options.crs != 0) {
+			// Crs: org 0, code 1
+			size_t crs = builder.table({{0, 4}, {1, 4, static_cast<uint32_t>(options.crs)}});
+			size_t orgSlot = builder.slots[0];
+			builder.link(slots[10], crs);
+			builder.link(orgSlot, builder.string("EPSG"));
+		}
+
+		out.write(reinterpret_cast<const char*>(MAGIC), 8);
+		uint32_t headerSize = static_cast<uint32_t>(builder.bytes.size());
+		out.write(reinterpret_cast<const char*>(&headerSize), 4);
+		out.write(reinterpret_cast<const char*>(builder.bytes.data()), headerSize);
+
+		// Index: leaves are the features in file order, offsets into the features section
+		if (header.nodeSize != 0) {
+			std::vector<std::pair<uint64_t, uint64_t>> bounds = levels(shapes.size(), header.nodeSize);
+			std::vector<NodeItem> nodes(bounds.front().second);
+			uint64_t offset = 0;
+			uint64_t leaf = bounds.front().first;
+
+			for (size_t index : order) {
+				const Shape& shape = shapes[index];
+				encode::feature(builder, shape);
+				nodes[leaf++] = {shape.bbox[0], shape.bbox[1], shape.bbox[2], shape.bbox[3], offset};
+				offset += 4 + builder.bytes.size();
+			}
+
+			for (size_t level = 0; level + 1 < bounds.size(); ++level) {
+				uint64_t pos = bounds[level].first;
+				uint64_t end = bounds[level].second;
+				uint64_t parent = bounds[level + 1].first;
+				while (pos < end) {
+					NodeItem node = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), pos};
+					for (uint16_t j = 0; j < header.nodeSize && pos < end; ++j, ++pos) {
+						node.minX = std::min(node.minX, nodes[pos].minX);
+						node.minY = std::min(node.minY, nodes[pos].minY);
+						node.maxX = std::max(node.maxX, nodes[pos].maxX);
+						node.maxY = std::max(node.maxY, nodes[pos].maxY);
+					}
+					nodes[parent++] = node;
+				}
+			}
+
+			out.write(reinterpret_cast<const char*>(nodes.data()), static_cast<std::streamsize>(nodes.size() * sizeof(NodeItem)));
+		}
+
+		for (size_t index : order) {
+			encode::feature(builder, shapes[index]);
+			uint32_t size = static_cast<uint32_t>(builder.bytes.size());
+			out.write(reinterpret_cast<const char*>(&size), 4);
+			out.write(reinterpret_cast<const char*>(builder.bytes.data()), size);
+		}
+
+		return out.good();
+	}
+
+	/*
+
+	Reader
+	Header is parsed on open, features are decoded on demand straight from the mapping.
+	Feature indices are positions in the file. A features_count of 0 means unknown, such a file
+	has no index and its features are counted by walking the size prefixes to the end of the file.
+
+	*/
+
+	class Reader {
+	public:
+		Header header;
+
+		Reader(const std::string& path) : file(path, false) {
+			const uint8_t* data = bytes();
+			size_t size = file.size();
+			if (size < 12 || std::memcmp(data, MAGIC, 3) != 0 || data[3] != MAGIC[3]) {
+				if (size != 0) {
+					std::cerr << "Not a FlatGeobuf file: " << path << std::endl;
+				}
+				return;
+			}
+
+			uint32_t headerSize = flatbuffers::load<uint32_t>(data + 8);
+			if (headerSize > size - 12) {
+				throw std::runtime_error("FlatGeobuf: header past the end of the file");
+			}
+
+			flatbuffers::Table table = flatbuffers::Table::root(data + 12, headerSize);
+			header.name = std::string(table.string(0));
+			flatbuffers::Vector<double> envelope = table.vector<double>(1);
+			if (envelope.size >= 4) {
+				header.envelope = {envelope[0], envelope[1], envelope[2], envelope[3]};
+			}
+			header.type = static_cast<GeometryType>(table.scalar<uint8_t>(2));
+			header.count = table.scalar<uint64_t>(8);
+			header.nodeSize = table.scalar<uint16_t>(9, 16);
+			flatbuffers::Table crs = table.table(10);
+			if (crs) {
+				header.crs = crs.scalar<int32_t>(1);
+			}
+
+			indexStart = 12 + headerSize;
+
+			// Every feature takes at least its 4-byte size prefix, so a larger count can't be right
+			if (header.count > (size - indexStart) / 4) {
+				throw std::runtime_error("FlatGeobuf: feature count past the end of the file");
+			}
+
+			bounds = levels(header.count, header.nodeSize);
+			size_t indexSize = bounds.empty() ? 0 : bounds.front().second * sizeof(NodeItem);
+			featuresStart = indexStart + indexSize;
+			if (featuresStart > size) {
+				throw std::runtime_error("FlatGeobuf: index past the end of the file");
+			}
+
+			if (header.count == 0) {
+				for (uint64_t offset = 0; featuresStart + offset < size; ++header.count) {
+					offset += 4 + length(offset);
+				}
+			}
+			valid = true;
+		}
+
+		explicit operator bool() const {
+			return valid;
+		}
+
+		size_t size() const {
+			return valid ? header.count : 0;
+		}
+
+		bool indexed() const {
+			return !bounds.empty();
+		}
+
+		// visit(index, shape) for every feature in file order
+		template <typename Visitor>
+		void forEach(Visitor&& visit) const {
+			uint64_t offset = 0;
+			for (uint64_t i = 0; i < size(); ++i) {
+				Shape shape = feature(offset, &offset);
+				visit(static_cast<size_t>(i), shape);
+			}
+		}
+
+		std::vector<Shape> read() const {
+			std::vector<Shape> result;
+			result.reserve(std::min<size_t>(size(), file.size() / 8));
+			forEach([&](size_t, Shape& shape) {
+				result.push_back(std::move(shape));
+			});
+			return result;
+		}
+
+		/*
+
+		Search
+		visit(index, shape) for every feature whose bbox intersects box, in file order.
+		Walks the tree level by level from the root; without an index every feature is decoded and tested.
+
+		*/
+
+		template <typename Visitor>
+		void search(const BBox& box, Visitor&& visit) const {
+			if (!indexed()) {
+				forEach([&](size_t index, Shape& shape) {
+					if (!shape.empty && intersects(shape.bbox, box)) {
+						visit(index, shape);
+					}
+				});
+				return;
+			}
+
+			for (const auto& [offset, index] : hits(box)) {
+				Shape shape = feature(offset);
+				visit(static_cast<size_t>(index), shape);
+			}
+		}
+
+		std::vector<Shape> read(const BBox& box) const {
+			std::vector<Shape> result;
+			search(box, [&](size_t, Shape& shape) {
+				result.push_back(std::move(shape));
+			});
+			return result;
+		}
+
+		/*
+
+		Feature
+		Feature at offset within the features section, next gets the offset of the one after it.
+
+		*/
+
+		Shape feature(uint64_t offset, uint64_t* next = nullptr) const {
+			const uint8_t* data = bytes();
+			size_t at = featuresStart + offset;
+			uint32_t size = length(offset);
+			if (next != nullptr) {
+				*next = offset + 4 + size;
+			}
+
+			flatbuffers::Table feature = flatbuffers::Table::root(data + at + 4, size);
+			flatbuffers::Table geometry = feature.table(0);
+			if (!geometry) {
+				return Shape();
+			}
+			return decode(geometry, header.type);
+		}
+
+	private:
+		surfy::utils::MappedFile file;
+		std::vector<std::pair<uint64_t, uint64_t>> bounds;
+		size_t indexStart = 0;
+		size_t featuresStart = 0;
+		bool valid = false;
+
+		const uint8_t* bytes() const {
+			return reinterpret_cast<const uint8_t*>(file.data());
+		}
+
+		// Size prefix of the feature at offset, checked against the end of the file
+		uint32_t length(uint64_t offset) const {
+			size_t at = featuresStart + offset;
+			if (offset > file.size() || at + 4 > file.size()) {
+				throw std::runtime_error("FlatGeobuf: feature past the end of the file");
+			}
+			uint32_t size = flatbuffers::load<uint32_t>(bytes() + at);
+			if (size > file.size() - at - 4) {
+				throw std::runtime_error("FlatGeobuf: feature past the end of the file");
+			}
+			return size;
+		}
+
+		static bool intersects(const BBox& a, const BBox& b) {
+			return a[0] <= b[2] && a[2] >= b[0] && a[1] <= b[3] && a[3] >= b[1];
+		}
+
+		// (feature offset, feature index) of the leaves hit by box, sorted by offset.
+		// Child offsets must point into the next level down, else the index is corrupt
+		std::vector<std::pair<uint64_t, uint64_t>> hits(const BBox& box) const {
+			std::vector<std::pair<uint64_t, uint64_t>> result;
+			const uint8_t* index = bytes() + indexStart;
+			uint64_t leaves = bounds.front().first;
+			uint64_t nodeSize = header.nodeSize;
+
+			// (node, level), levels counted from the leaves
+			std::vector<std::pair<uint64_t, size_t>> queue = {{0, bounds.size() - 1}};
+			while (!queue.empty()) {
+				auto [node, level] = queue.back();
+				queue.pop_back();
+
+				uint64_t end = std::min(node + nodeSize, bounds[level].second);
+				for (uint64_t pos = node; pos < end; ++pos) {
+					NodeItem item = flatbuffers::load<NodeItem>(index + pos * sizeof(NodeItem));
+					if (item.maxX < box[0] || item.minX > box[2] || item.maxY < box[1] || item.minY > box[3]) {
+						continue;
+					}
+					if (level == 0) {
+						if (pos < leaves) {
+							throw std::runtime_error("FlatGeobuf: corrupt index");
+						}
+						result.push_back({item.offset, pos - leaves});
+					} else if (bounds[level - 1].first <= item.offset && item.offset < bounds[level - 1].second) {
+						queue.push_back({item.offset, level - 1});
+					} else {
+						throw std::runtime_error("FlatGeobuf: corrupt index");
+					}
+				}
+			}
+
+			std::sort(result.begin(), result.end());
+			return result;
+		}
+
+		static Coords coords(const flatbuffers::Vector<double>& xy, size_t first, size_t last) {
+			Coords result;
+			result.reserve(last - first);
+			for (size_t i = first; i < last; ++i) {
+				result.push_back({xy[2 * i], xy[2 * i + 1]});
+			}
+			return result;
+		}
+
+		// Ring i of a geometry: [ends[i - 1], ends[i]), a single ring when there are no ends
+		static std::vector<Coords> rings(const flatbuffers::Table& geometry) {
+			flatbuffers::Vector<double> xy = geometry.vector<double>(1);
+			flatbuffers::Vector<uint32_t> ends = geometry.vector<uint32_t>(0);
+			size_t vertices = xy.size / 2;
+
+			std::vector<Coords> result;
+			if (ends.size == 0) {
+				if (vertices != 0) {
+					result.push_back(coords(xy, 0, vertices));
+				}
+				return result;
+			}
+
+			size_t first = 0;
+			for (size_t i = 0; i < ends.size; ++i) {
+				size_t last = std::min<size_t>(ends[i], vertices);
+				if (last > first) {
+					result.push_back(coords(xy, first, last));
+				}
+				first = std::max(first, last);
+			}
+			return result;
+		}
+
+		// Outer ring first, like the WKT parsers a later ring is the hole
+		static types::Polygon polygon(const flatbuffers::Table& geometry) {
+			std::vector<Coords> parts = rings(geometry);
+			types::Polygon poly;
+			for (size_t i = 0; i < parts.size(); ++i) {
+				if (i == 0) {
+					poly.outer.coords = std::move(parts[i]);
+				} else {
+					poly.inner.coords = std::move(parts[i]);
+				}
+			}
+			return poly;
+		}
+
+		static Shape decode(const flatbuffers::Table& geometry, GeometryType fallback) {
+			GeometryType type = static_cast<GeometryType>(geometry.scalar<uint8_t>(6, fallback));
+			if (type == Unknown) {
+				type = fallback;
+			}
+
+			switch (type) {
+				case Point: {
+					flatbuffers::Vector<double> xy = geometry.vector<double>(1);
+					if (xy.size < 2) {
+						return Shape();
+					}
+					types::Point point;
+					point.x = xy[0];
+					point.y = xy[1];
+					return Shape(point);
+				}
+				case LineString: {
+					types::Line line;
+					std::vector<Coords> parts = rings(geometry);
+					if (!parts.empty()) {
+						line.coords = std::move(parts.front());
+					}
+					return Shape(std::move(line));
+				}
+				case MultiLineString: {
+					types::MultiLine multiLine;
+					for (Coords& part : rings(geometry)) {
+						types::Line line;
+						line.coords = std::move(part);
+						multiLine.items.push_back(std::move(line));
+					}
+					return Shape(std::move(multiLine));
+				}
+				case Polygon:
+					return Shape(polygon(geometry));
+				case MultiPolygon: {
+					types::MultiPolygon multiPolygon;
+					for (size_t i = 0; i < geometry.count(7); ++i) {
+						multiPolygon.items.push_back(polygon(geometry.table(7, i)));
+					}
+					return Shape(std::move(multiPolygon));
+				}
+				default:
+					return Shape();
+			}
+		}
+	};
+}
+
+#endif
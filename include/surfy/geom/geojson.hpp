@@ -0,0 +1,664 @@
+#ifndef SURFY_GEOM_GEOJSON_HPP
+#define SURFY_GEOM_GEOJSON_HPP
+
+/*
+
+GeoJSON
+Streaming reader on the nlohmann SAX interface: geometry is built straight from the coordinate
+numbers as they go past, without json objects, and every Feature is handed to a callback
+as soon as it closes, so a FeatureCollection of any size is read in constant memory.
+Writer serializes geometry straight into a string buffer, numbers with to_chars.
+
+*/
+
+#include <charconv>
+#include <functional>
+#include <string_view>
+#include "geom.hpp"
+#include "../../json.hpp"
+#include "../utils/mmap.hpp"
+
+namespace surfy::geom::geojson {
+
+	using json = nlohmann::ordered_json;
+
+	struct Feature {
+		Shape shape; // Dummy when the geometry is null or of a type Shape can't hold (MultiPoint, GeometryCollection)
+		json id;
+		json properties;
+	};
+
+	struct Options {
+		bool properties = true; // false skips building properties
+	};
+
+	using Visitor = std::function<void(Feature&)>;
+
+	/*
+
+	Handler
+	SAX events to Features. Frames track what every open object or array is.
+	A FeatureCollection, a single Feature or a bare Geometry are all accepted at the top.
+	Coordinate arrays are collected depth-first into points, ring and part ends,
+	and turned into a Shape once the geometry type is known, which may come after "coordinates".
+
+	*/
+
+	class Handler {
+	public:
+		using number_integer_t = json::number_integer_t;
+		using number_unsigned_t = json::number_unsigned_t;
+		using number_float_t = json::number_float_t;
+		using string_t = json::string_t;
+		using binary_t = json::binary_t;
+
+		size_t count = 0; // Features read
+		std::string error;
+
+		Handler(const Visitor& visit, const Options& options = {}) : visit(visit), options(options) {}
+
+		bool null() {
+			return value(nullptr);
+		}
+
+		bool boolean(bool val) {
+			return value(val);
+		}
+
+		bool number_integer(number_integer_t val) {
+			return number(static_cast<double>(val)) || value(val);
+		}
+
+		bool number_unsigned(number_unsigned_t val) {
+			return number(static_cast<double>(val)) || value(val);
+		}
+
+		bool number_float(number_float_t val, const string_t&) {
+			return number(val) || value(val);
+		}
+
+		bool string(string_t& val) {
+			if (frames.empty()) {
+				return value(val);
+			}
+			Frame& top = frames.back();
+			if (top.role != Properties && top.role != Skip && field == "type") {
+				if (top.role == Geometry || top.role == Root) {
+					geometryType = val;
+				}
+				if (top.role == Root) {
+					rootType = val;
+				}
+				return true;
+			}
+			return value(val);
+		}
+
+		bool binary(binary_t&) {
+			return true;
+		}
+
+		bool key(string_t& val) {
+			if (frames.back().role == Properties) {
+				return property(val);
+			}
+			field = val;
+			return true;
+		}
+
+		bool start_object(size_t) {
+			return open(true);
+		}
+
+		bool end_object() {
+			return close();
+		}
+
+		bool start_array(size_t) {
+			return open(false);
+		}
+
+		bool end_array() {
+			return close();
+		}
+
+		bool parse_error(size_t position, const std::string&, const nlohmann::detail::exception& e) {
+			error = "GeoJSON parse error at " + std::to_string(position) + ": " + e.what();
+			return false;
+		}
+
+	private:
+
+		enum Role {
+			Root, // Top object: FeatureCollection, Feature or Geometry
+			Features, // "features" array
+			FeatureObject,
+			Geometry,
+			Coordinates,
+			Properties, // Built into feature.properties
+			Skip
+		};
+
+		struct Frame {
+			Role role;
+			bool object;
+			size_t depth = 0; // Coordinates: 1 for the "coordinates" array, + 1 per nested array
+		};
+
+		const Visitor& visit;
+		Options options;
+		std::vector<Frame> frames;
+		std::string field; // Last key outside properties
+		std::string rootType;
+		std::string geometryType;
+
+		Feature feature;
+		bool hasGeometry = false;
+
+		// Coordinates of the current geometry, capacity is kept between features
+		Coords points;
+		std::vector<size_t> rings; // Point count at every ring end
+		std::vector<size_t> parts; // Ring count at every part end
+		size_t positionDepth = 0; // Depth of the arrays holding numbers, 0 until the first one
+		size_t axis = 0;
+		Point position;
+
+		// Properties DOM
+		std::vector<json*> stack;
+		std::string propertyKey;
+
+		bool open(bool object) {
+			if (frames.empty()) {
+				frames.push_back({object ? Root : Skip, object});
+				reset();
+				return true;
+			}
+
+			Role parent = frames.back().role;
+			size_t depth = frames.back().depth;
+			Role role = Skip;
+
+			if (parent == Properties) {
+				return nest(object);
+			}
+
+			if (parent == Coordinates) {
+				frames.push_back({Coordinates, false, depth + 1});
+				axis = 0;
+				return true;
+			}
+
+			if (parent == Root && !object && field == "features") {
+				role = Features;
+			} else if (parent == Features && object) {
+				role = FeatureObject;
+				reset();
+			} else if ((parent == FeatureObject || parent == Root) && object && field == "geometry") {
+				role = Geometry;
+				geometryType.clear();
+				hasGeometry = true;
+			} else if ((parent == FeatureObject || parent == Root) && object && field == "properties" && options.properties) {
+				feature.properties = json::object();
+				stack.assign(1, &feature.properties);
+				frames.push_back({Properties, true});
+				return true;
+			} else if ((parent == Geometry || parent == Root) && !object && field == "coordinates") {
+				frames.push_back({Coordinates, false, 1});
+				points.clear();
+				rings.clear();
+				parts.clear();
+				positionDepth = 0;
+				axis = 0;
+				if (parent == Root) {
+					hasGeometry = true;
+				}
+				return true;
+			} else if ((parent == FeatureObject || parent == Root) && field == "id") {
+				feature.id = object ? json::object() : json::array();
+			}
+
+			frames.push_back({role, object});
+			return true;
+		}
+
+		bool close() {
+			Frame frame = frames.back();
+
+			if (frame.role == Properties) {
+				if (stack.size() > 1) {
+					stack.pop_back();
+					return true;
+				}
+				stack.clear();
+				frames.pop_back();
+				return true;
+			}
+
+			frames.pop_back();
+
+			if (frame.role == Coordinates) {
+				if (positionDepth != 0) {
+					if (frame.depth == positionDepth) {
+						points.push_back(position);
+					} else if (frame.depth + 1 == positionDepth) {
+						rings.push_back(points.size());
+					} else if (frame.depth + 2 == positionDepth) {
+						parts.push_back(rings.size());
+					}
+				}
+				return true;
+			}
+
+			if (frame.role == Geometry) {
+				build();
+			} else if (frame.role == FeatureObject) {
+				emit();
+			} else if (frame.role == Root) {
+				if (rootType == "Feature") {
+					emit();
+				} else if (rootType != "FeatureCollection" && hasGeometry) {
+					build();
+					emit();
+				}
+			}
+			return true;
+		}
+
+		bool number(double val) {
+			if (frames.empty()) {
+				return false;
+			}
+			Frame& top = frames.back();
+			if (top.role != Coordinates) {
+				return false;
+			}
+			if (positionDepth == 0) {
+				positionDepth = top.depth;
+			}
+			if (top.depth == positionDepth) {
+				if (axis == 0) {
+					position.x = val;
+				} else if (axis == 1) {
+					position.y = val;
+				}
+				++axis;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool value(T&& val) {
+			// A scalar at the top is valid JSON but not GeoJSON
+			if (frames.empty()) {
+				error = "Not GeoJSON: the top-level value is not an object";
+				return false;
+			}
+			Frame& top = frames.back();
+			if (top.role == Properties) {
+				json* parent = stack.back();
+				if (parent->is_array()) {
+					parent->emplace_back(std::forward<T>(val));
+				} else {
+					(*parent)[propertyKey] = std::forward<T>(val);
+				}
+			} else if ((top.role == FeatureObject || top.role == Root) && field == "id") {
+				feature.id = std::forward<T>(val);
+			}
+			return true;
+		}
+
+		bool property(const std::string& val) {
+			propertyKey = val;
+			return true;
+		}
+
+		// Object or array inside properties
+		bool nest(bool object) {
+			json* parent = stack.back();
+			json* child;
+			if (parent->is_array()) {
+				parent->emplace_back(object ? json::object() : json::array());
+				child = &parent->back();
+			} else {
+				json& slot = (*parent)[propertyKey];
+				slot = object ? json::object() : json::array();
+				child = &slot;
+			}
+			stack.push_back(child);
+			return true;
+		}
+
+		void reset() {
+			feature.id = nullptr;
+			feature.properties = nullptr;
+			geometryType.clear();
+			hasGeometry = false;
+			points.clear();
+			rings.clear();
+			parts.clear();
+			positionDepth = 0;
+		}
+
+		Coords slice(size_t first, size_t last) const {
+			return Coords(points.begin() + first, points.begin() + last);
+		}
+
+		// Rings [first, last) into a Polygon, first outer, like the WKT parsers a later ring is the hole
+		types::Polygon polygon(size_t first, size_t last) const {
+			types::Polygon poly;
+			for (size_t r = first; r < last; ++r) {
+				Coords coords = slice(r == 0 ? 0 : rings[r - 1], rings[r]);
+				if (r == first) {
+					poly.outer.coords = std::move(coords);
+				} else {
+					poly.inner.coords = std::move(coords);
+				}
+			}
+			return poly;
+		}
+
+		void build() {
+			feature.shape.~Shape();
+
+			if (geometryType == "Point" && positionDepth == 1 && !points.empty()) {
+				types::Point point;
+				point.x = points[0].x;
+				point.y = points[0].y;
+				new (&feature.shape) Shape(point);
+			} else if (geometryType == "LineString" && positionDepth == 2) {
+				types::Line line;
+				line.coords = points;
+				new (&feature.shape) Shape(std::move(line));
+			} else if (geometryType == "MultiLineString" && positionDepth == 3) {
+				types::MultiLine multiLine;
+				for (size_t r = 0; r < rings.size(); ++r) {
+					types::Line line;
+					line.coords = slice(r == 0 ? 0 : rings[r - 1], rings[r]);
+					multiLine.items.push_back(std::move(line));
+				}
+				new (&feature.shape) Shape(std::move(multiLine));
+			} else if (geometryType == "Polygon" && positionDepth == 3) {
+				new (&feature.shape) Shape(polygon(0, rings.size()));
+			} else if (geometryType == "MultiPolygon" && positionDepth == 4) {
+				types::MultiPolygon multiPolygon;
+				for (size_t p = 0; p < parts.size(); ++p) {
+					multiPolygon.items.push_back(polygon(p == 0 ? 0 : parts[p - 1], parts[p]));
+				}
+				new (&feature.shape) Shape(std::move(multiPolygon));
+			} else {
+				new (&feature.shape) Shape();
+			}
+
+			points.clear();
+			rings.clear();
+			parts.clear();
+			positionDepth = 0;
+		}
+
+		void emit() {
+			if (!hasGeometry) {
+				feature.shape.~Shape();
+				new (&feature.shape) Shape();
+			}
+			++count;
+			visit(feature);
+			reset();
+		}
+	};
+
+	/*
+
+	Read
+	visit(feature) for every Feature in document order, false on a parse error or a top-level scalar (printed to cerr).
+	load() memory-maps the file, read() takes any stream, parse() text in memory.
+
+	*/
+
+	bool parse(std::string_view text, const Visitor& visit, const Options& options = {}) {
+		Handler handler(visit, options);
+		bool parsed = json::sax_parse(text.begin(), text.end(), &handler);
+		if (!parsed) {
+			std::cerr << handler.error << std::endl;
+		}
+		return parsed;
+	}
+
+	bool read(std::istream& input, const Visitor& visit, const Options& options = {}) {
+		Handler handler(visit, options);
+		bool parsed = json::sax_parse(input, &handler);
+		if (!parsed) {
+			std::cerr << handler.error << std::endl;
+		}
+		return parsed;
+	}
+
+	bool load(const std::string& path, const Visitor& visit, const Options& options = {}) {
+		surfy::utils::MappedFile file(path);
+		if (file.empty()) {
+			return false;
+		}
+		return parse(file.view(), visit, options);
+	}
+
+	/*
+
+	Write
+	Geometry appended to out. precision < 0 writes the shortest text that reads back to the same double,
+	else that many decimals with trailing zeros dropped. Rings are closed if they aren't,
+	NaN and infinity become null, empty Shapes a null geometry.
+
+	*/
+
+	namespace write {
+
+		void number(std::string& out, double value, int precision = -1) {
+			if (!std::isfinite(value)) {
+				out += "null";
+				return;
+			}
+
+			char buffer[64];
+			char* end = buffer + sizeof(buffer);
+			std::to_chars_result result = {end, std::errc::value_too_large};
+			if (precision >= 0) {
+				result = std::to_chars(buffer, end, value, std::chars_format::fixed, precision);
+				if (result.ec == std::errc() && precision > 0) {
+					while (result.ptr[-1] == '0') {
+						--result.ptr;
+					}
+					if (result.ptr[-1] == '.') {
+						--result.ptr;
+					}
+				}
+			}
+			if (result.ec != std::errc()) {
+				result = std::to_chars(buffer, end, value);
+			}
+			out.append(buffer, result.ptr);
+		}
+
+		void point(std::string& out, const Point& p, int precision = -1) {
+			out += '[';
+			number(out, p.x, precision);
+			out += ',';
+			number(out, p.y, precision);
+			out += ']';
+		}
+
+		void coords(std::string& out, const Coords& coords, bool closed, int precision = -1) {
+			out += '[';
+			for (size_t i = 0; i < coords.size(); ++i) {
+				if (i != 0) {
+					out += ',';
+				}
+				point(out, coords[i], precision);
+			}
+			if (closed && coords.size() > 1 && (coords.front().x != coords.back().x || coords.front().y != coords.back().y)) {
+				out += ',';
+				point(out, coords.front(), precision);
+			}
+			out += ']';
+		}
+
+		void rings(std::string& out, const types::Polygon& poly, int precision = -1) {
+			out += '[';
+			coords(out, poly.outer.coords, true, precision);
+			if (!poly.inner.coords.empty()) {
+				out += ',';
+				coords(out, poly.inner.coords, true, precision);
+			}
+			out += ']';
+		}
+	}
+
+	void geometry(std::string& out, const types::Point& point, int precision = -1) {
+		out += "{\"type\":\"Point\",\"coordinates\":";
+		write::point(out, point, precision);
+		out += '}';
+	}
+
+	void geometry(std::string& out, const types::Line& line, int precision = -1) {
+		out += "{\"type\":\"LineString\",\"coordinates\":";
+		write::coords(out, line.coords, false, precision);
+		out += '}';
+	}
+
+	void geometry(std::string& out, const types::MultiLine& multiLine, int precision = -1) {
+		out += "{\"type\":\"MultiLineString\",\"coordinates\":[";
+		for (size_t i = 0; i < multiLine.items.size(); ++i) {
+			if (i != 0) {
+				out += ',';
+			}
+			write::coords(out, multiLine.items[i].coords, false, precision);
+		}
+		out += "]}";
+	}
+
+	void geometry(std::string& out, const types::Polygon& poly, int precision = -1) {
+		out += "{\"type\":\"Polygon\",\"coordinates\":";
+		write::rings(out, poly, precision);
+		out += '}';
+	}
+
+	void geometry(std::string& out, const types::MultiPolygon& multiPolygon, int precision = -1) {
+		out += "{\"type\":\"MultiPolygon\",\"coordinates\":[";
+		for (size_t i = 0; i < multiPolygon.items.size(); ++i) {
+			if (i != 0) {
+				out += ',';
+			}
+			write::rings(out, multiPolygon.items[i], precision);
+		}
+		out += "]}";
+	}
+
+	void geometry(std::string& out, const Shape& shape, int precision = -1) {
+		if (shape.empty) {
+			out += "null";
+		} else if (shape.type == "Point") {
+			geometry(out, shape.geom.point, precision);
+		} else if (shape.type == "Line") {
+			geometry(out, shape.geom.line, precision);
+		} else if (shape.type == "MultiLine") {
+			geometry(out, shape.geom.multiLine, precision);
+		} else if (shape.type == "Polygon") {
+			geometry(out, shape.geom.polygon, precision);
+		} else if (shape.type == "MultiPolygon") {
+			geometry(out, shape.geom.multiPolygon, precision);
+		} else {
+			out += "null";
+		}
+	}
+
+	// Feature, properties and id are dumped as they are, null ones are left out
+	void feature(std::string& out, const Shape& shape, const json& properties = nullptr, const json& id = nullptr, int precision = -1) {
+		out += "{\"type\":\"Feature\"";
+		if (!id.is_null()) {
+			out += ",\"id\":";
+			out += id.dump();
+		}
+		out += ",\"geometry\":";
+		geometry(out, shape, precision);
+		out += ",\"properties\":";
+		out += properties.is_null() ? "{}" : properties.dump();
+		out += '}';
+	}
+
+	std::string stringify(const Shape& shape, int precision = -1) {
+		std::string out;
+		geometry(out, shape, precision);
+		return out;
+	}
+
+	/*
+
+	Writer
+	FeatureCollection streamed to an ostream: features are written as they come,
+	through a buffer flushed every flush bytes. The collection is closed by close() or the destructor.
+
+	*/
+
+	class Writer {
+	public:
+		int precision;
+		size_t flush;
+
+		Writer(std::ostream& output, int precision = -1, size_t flush = 1 << 16) : precision(precision), flush(flush), output(output) {
+			buffer.reserve(flush + 4096);
+			buffer += "{\"type\":\"FeatureCollection\",\"features\":[";
+		}
+
+		~Writer() {
+			close();
+		}
+
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		void write(const Shape& shape, const json& properties = nullptr, const json& id = nullptr) {
+			if (closed) {
+				return;
+			}
+			if (count++ != 0) {
+				buffer += ",\n";
+			} else {
+				buffer += '\n';
+			}
+			feature(buffer, shape, properties, id, precision);
+			if (buffer.size() >= flush) {
+				drain();
+			}
+		}
+
+		void write(const Feature& feature) {
+			write(feature.shape, feature.properties, feature.id);
+		}
+
+		void close() {
+			if (closed) {
+				return;
+			}
+			closed = true;
+			buffer += "\n]}\n";
+			drain();
+			output.flush();
+		}
+
+		// Features written
+		size_t size() const {
+			return count;
+		}
+
+	private:
+		std::ostream& output;
+		std::string buffer;
+		size_t count = 0;
+		bool closed = false;
+
+		void drain() {
+			output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			buffer.clear();
+		}
+	};
+}
+
+#endif
@@ -1,7 +1,12 @@
 #ifndef SURFY_GEOM_HPP
 #define SURFY_GEOM_HPP
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -15,6 +20,29 @@ namespace surfy::geom {
 
 	using Coords = std::vector<Point>;
 
+	/*
+
+	Budget
+	Simplify target: max vertices, or bytes at bytesPerVertex (e.g. ~4 for delta-encoded tiles).
+	Zero means no limit, the tighter of the two wins.
+
+	*/
+
+	struct Budget {
+		size_t vertices = 0;
+		size_t bytes = 0;
+		size_t bytesPerVertex = 4;
+
+		size_t limit() const {
+			size_t limit = vertices;
+			if (bytes != 0 && bytesPerVertex != 0) {
+				size_t byBytes = bytes / bytesPerVertex;
+				limit = (limit == 0) ? byBytes : std::min(limit, byBytes);
+			}
+			return limit;
+		}
+	};
+
 	namespace types {
 		struct Geometry {
 			unsigned int vertices = 0;
@@ -51,6 +79,9 @@ namespace surfy::geom {
 
 			Polygon() : inner(), outer() {}
 			Polygon(const Polygon& other) : inner(other.inner), outer(other.outer) {}
+			Polygon(Polygon&& other) noexcept : inner(std::move(other.inner)), outer(std::move(other.outer)) {}
+			Polygon& operator=(const Polygon& other) = default;
+			Polygon& operator=(Polygon&& other) = default;
 		};
 
 		struct MultiPolygon : public Geometry {
@@ -64,11 +95,15 @@ namespace surfy::geom {
 	namespace utils {
 		bool isClosed(const Coords& coords);
 		double distance(const Point& p1, const Point& p2);
+		double distance(const Point& point, const Coords& coords, const bool& closed);
+		bool inside(const Point& point, const Coords& coords);
 		BBox bbox(const Coords& coords);
+		Coords mask(const BBox& bbox);
 		Coords parseCoordsString(const std::string& str);
 		double length(const std::vector<Point>& coords, size_t size);
 		float area(const std::vector<Point>& coords, size_t size);
 		void prune(Coords& coords, const double& epsilon);
+		void significance(const Coords& points, std::vector<double>& weights);
 	};
 
 	namespace parser {
@@ -150,7 +185,7 @@ namespace surfy::geom {
 		double length = .0;
 		double area = .0;
 		bool empty = true;
-		BBox bbox = {360, 180, -360, -180};
+		BBox bbox = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
 		bool optimized;
 
 
@@ -252,10 +287,12 @@ namespace surfy::geom {
 			length = 0;
 			area = .0;
 			empty = true;
+			bbox = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
 
 			if (type == "Point") {
 				vertices = 1;
 				empty = false;
+				bbox = {geom.point.x, geom.point.y, geom.point.x, geom.point.y};
 			} else if (type == "Line") {
 				size_t lineSize = geom.line.coords.size();
 				geom.line.vertices = lineSize;
@@ -274,6 +311,8 @@ namespace surfy::geom {
 			} else if (type == "MultiLine") {
 				
 				geom.multiLine.size = geom.multiLine.items.size();
+				geom.multiLine.vertices = 0;
+				geom.multiLine.length = .0;
 
 				for (int i = 0; i < geom.multiLine.size; ++i) {
 					types::Line& line = geom.multiLine.items[i];
@@ -450,6 +489,7 @@ namespace surfy::geom {
 					typeID = 4;
 					type = "Polygon";
 					types::Polygon onlyPoly = geom.multiPolygon.items[0];
+					geom.multiPolygon.~MultiPolygon();
 					new (&geom.polygon) types::Polygon();
 					geom.polygon = onlyPoly;
 
@@ -599,18 +639,99 @@ namespace surfy::geom {
 			refresh();
 		}
 
+		/*
+
+		Distance
+		Exact distance from a point, zero inside a Polygon.
+		Infinity for an empty Shape.
+
+		*/
+
+		double distance(const Point& point) const {
+			if (empty) {
+				return std::numeric_limits<double>::infinity();
+			}
+
+			if (type == "Point") {
+				return utils::distance(point, geom.point);
+			} else if (type == "Line") {
+				return utils::distance(point, geom.line.coords, false);
+			} else if (type == "MultiLine") {
+				double dist = std::numeric_limits<double>::infinity();
+				for (const types::Line& line : geom.multiLine.items) {
+					dist = std::min(dist, utils::distance(point, line.coords, false));
+				}
+				return dist;
+			} else if (type == "Polygon") {
+				return distance(point, geom.polygon);
+			} else if (type == "MultiPolygon") {
+				double dist = std::numeric_limits<double>::infinity();
+				for (const types::Polygon& poly : geom.multiPolygon.items) {
+					dist = std::min(dist, distance(point, poly));
+					if (dist == 0) {
+						break;
+					}
+				}
+				return dist;
+			}
+
+			return std::numeric_limits<double>::infinity();
+		}
+
 		void clip(const Coords& mask);
 
+		void clip(const BBox& bbox, const double& buffer);
+
 		void simplify(const double& intolerance);
 
+		double simplify(const Budget& budget);
+
 		void optimize() {
 			std::cout << "OPTI" << std::endl;
 		};
 
 		/*
-		Shape (const Polygon& poly) {
-			new (&geom.polygon) Polygon(poly);
-		}*/
+
+		Shape from geometry
+		For readers that build geometry directly, coordinates are moved in.
+		Stats and bbox come from refresh().
+
+		*/
+
+		Shape(types::Point point) : optimized(false) {
+			typeID = 1;
+			type = "Point";
+			new (&geom.point) types::Point(point);
+			refresh();
+		}
+
+		Shape(types::Line line) : optimized(false) {
+			typeID = 2;
+			type = "Line";
+			new (&geom.line) types::Line(std::move(line));
+			refresh();
+		}
+
+		Shape(types::MultiLine multiLine) : optimized(false) {
+			typeID = 3;
+			type = "MultiLine";
+			new (&geom.multiLine) types::MultiLine(std::move(multiLine));
+			refresh();
+		}
+
+		Shape(types::Polygon polygon) : optimized(false) {
+			typeID = 4;
+			type = "Polygon";
+			new (&geom.polygon) types::Polygon(std::move(polygon));
+			refresh();
+		}
+
+		Shape(types::MultiPolygon multiPolygon) : optimized(false) {
+			typeID = 5;
+			type = "MultiPolygon";
+			new (&geom.multiPolygon) types::MultiPolygon(std::move(multiPolygon));
+			refresh();
+		}
 
 		Shape(const Shape& other) {
 			typeID = other.typeID;
@@ -622,6 +743,7 @@ namespace surfy::geom {
 			length = other.length;
 			area = other.area;
 			empty = other.empty;
+			bbox = other.bbox;
 			// std::memcpy(&geom, &other.geom, sizeof(Geometry));
 			if (type == "Point") {
 				new (&geom.point) types::Point(other.geom.point);
@@ -639,8 +761,60 @@ namespace surfy::geom {
 			
 		}
 
+		// Geometry is moved, other keeps its type with empty coordinates
+		Shape(Shape&& other) noexcept {
+			typeID = other.typeID;
+			optimized = other.optimized;
+			type = other.type;
+			source = std::move(other.source);
+			vertices = other.vertices;
+			size = other.size;
+			length = other.length;
+			area = other.area;
+			empty = other.empty;
+			bbox = other.bbox;
+			if (type == "Point") {
+				new (&geom.point) types::Point(other.geom.point);
+			} else if (type == "Line") {
+				new (&geom.line) types::Line(std::move(other.geom.line));
+			} else if (type == "MultiLine") {
+				new (&geom.multiLine) types::MultiLine(std::move(other.geom.multiLine));
+			} else if (type == "Polygon") {
+				new (&geom.polygon) types::Polygon(std::move(other.geom.polygon));
+			} else if (type == "MultiPolygon") {
+				new (&geom.multiPolygon) types::MultiPolygon(std::move(other.geom.multiPolygon));
+			} else {
+				new (&geom.point) types::Point();
+			}
+		}
+
+		// Zero inside the outer ring but not in the hole, else the closest ring
+		static double distance(const Point& point, const types::Polygon& poly) {
+			if (poly.outer.coords.empty()) {
+				return std::numeric_limits<double>::infinity();
+			}
+
+			bool hole = !poly.inner.coords.empty() && utils::inside(point, poly.inner.coords);
+			if (!hole && utils::inside(point, poly.outer.coords)) {
+				return 0;
+			}
+
+			return std::min(utils::distance(point, poly.outer.coords, true), utils::distance(point, poly.inner.coords, true));
+		}
+
+		// Destroy the active union member, Dummy may have none
 		~Shape() {
-			
+			if (type == "Point") {
+				geom.point.~Point();
+			} else if (type == "Line") {
+				geom.line.~Line();
+			} else if (type == "MultiLine") {
+				geom.multiLine.~MultiLine();
+			} else if (type == "Polygon") {
+				geom.polygon.~Polygon();
+			} else if (type == "MultiPolygon") {
+				geom.multiPolygon.~MultiPolygon();
+			}
 		}
 	};
 }
@@ -0,0 +1,460 @@
+#ifndef SURFY_GEOM_GPKG_HPP
+#define SURFY_GEOM_GPKG_HPP
+
+/*
+
+GeoPackage
+Feature tables of OGC GeoPackage files to Shapes and back, on SQLite.
+Geometry blobs are a small header (magic, flags, SRS id, optional envelope) followed by WKB,
+they are parsed straight from the column memory SQLite hands out.
+Bbox reads go through the gpkg_rtree_index extension when the layer has it.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+#include "geom.hpp"
+#include "sqlite.hpp"
+#include "wkb.hpp"
+
+namespace surfy::geom::gpkg {
+
+	namespace blob {
+
+		// NULL blob gives an empty Shape, the rest is sqlite::geopackage
+		Shape parse(const uint8_t* data, size_t size) {
+			if (data == nullptr || size == 0) {
+				return Shape();
+			}
+			return sqlite::geopackage(data, size);
+		}
+
+		// Little-endian header with the xy envelope (minx, maxx, miny, maxy), points go without one
+		void write(std::string& out, const Shape& shape, int32_t srs) {
+			bool envelope = shape.type != "Point" && !shape.empty;
+			out.append("GP", 2);
+			out.push_back(0);
+			out.push_back(static_cast<char>(0x01 | (envelope ? 0x02 : 0) | (shape.empty ? 0x10 : 0)));
+			wkb::writer::put(out, srs);
+			if (envelope) {
+				wkb::writer::put(out, shape.bbox[0]);
+				wkb::writer::put(out, shape.bbox[2]);
+				wkb::writer::put(out, shape.bbox[1]);
+				wkb::writer::put(out, shape.bbox[3]);
+			}
+			wkb::write(out, shape);
+		}
+	}
+
+	struct Layer {
+		std::string name;
+		std::string column; // Geometry column
+		std::string key; // Integer primary key
+		std::string type; // geometry_type_name: POINT, POLYGON, GEOMETRY...
+		int32_t srs = 0;
+		BBox bbox = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+		bool indexed = false; // Has an rtree_<name>_<column> table
+	};
+
+	/*
+
+	Reader
+	Opens read-only and lists the feature layers. Visitors get the feature id and the Shape.
+	Rows with a NULL or empty geometry are visited with an empty Shape by forEach and skipped by search.
+
+	*/
+
+	class Reader {
+	public:
+		std::vector<Layer> layers;
+
+		Reader(const std::string& path) {
+			if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+				std::cerr << "Error opening " << path << ": " << sqlite3_errmsg(db) << std::endl;
+				sqlite3_close(db);
+				db = nullptr;
+				return;
+			}
+
+			try {
+				sqlite::Statement query = sqlite::prepare(db,
+					"SELECT c.table_name, g.column_name, g.geometry_type_name, g.srs_id, c.min_x, c.min_y, c.max_x, c.max_y"
+					" FROM gpkg_contents c JOIN gpkg_geometry_columns g ON g.table_name = c.table_name WHERE c.data_type = 'features'");
+				while (sqlite3_step(query.get()) == SQLITE_ROW) {
+					Layer layer;
+					layer.name = text(query.get(), 0);
+					layer.column = text(query.get(), 1);
+					layer.type = text(query.get(), 2);
+					layer.srs = sqlite3_column_int(query.get(), 3);
+					if (sqlite3_column_type(query.get(), 4) != SQLITE_NULL) {
+						for (int i = 0; i < 4; ++i) {
+							layer.bbox[i] = sqlite3_column_double(query.get(), 4 + i);
+						}
+					}
+					layers.push_back(std::move(layer));
+				}
+
+				for (Layer& layer : layers) {
+					sqlite::Statement columns = sqlite::prepare(db, "PRAGMA table_info(" + sqlite::quote(layer.name) + ")");
+					while (sqlite3_step(columns.get()) == SQLITE_ROW) {
+						if (sqlite3_column_int(columns.get(), 5) == 1) {
+							layer.key = text(columns.get(), 1);
+						}
+					}
+
+					sqlite::Statement rtree = sqlite::prepare(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?");
+					std::string name = "rtree_" + layer.name + "_" + layer.column;
+					sqlite3_bind_text(rtree.get(), 1, name.c_str(), -1, SQLITE_TRANSIENT);
+					layer.indexed = sqlite3_step(rtree.get()) == SQLITE_ROW;
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "Not a GeoPackage: " << path << ": " << e.what() << std::endl;
+				layers.clear();
+			}
+		}
+
+		~Reader() {
+			sqlite3_close(db);
+		}
+
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		explicit operator bool() const {
+			return db != nullptr && !layers.empty();
+		}
+
+		const Layer* layer(const std::string& name) const {
+			for (const Layer& layer : layers) {
+				if (layer.name == name) {
+					return &layer;
+				}
+			}
+			return nullptr;
+		}
+
+		// visit(id, shape) for every row in rowid order, false on error
+		template <typename Visitor>
+		bool forEach(const std::string& name, Visitor&& visit) const {
+			const Layer* layer = find(name);
+			if (layer == nullptr) {
+				return false;
+			}
+			return run(*layer, "SELECT " + sqlite::quote(layer->key) + ", " + sqlite::quote(layer->column) + " FROM " + sqlite::quote(layer->name), nullptr, [&](long long id, Shape& shape) {
+				visit(id, shape);
+			});
+		}
+
+		std::vector<Shape> read(const std::string& name) const {
+			std::vector<Shape> result;
+			result.reserve(hint(name));
+			forEach(name, [&](long long, Shape& shape) {
+				result.push_back(std::move(shape));
+			});
+			return result;
+		}
+
+		/*
+
+		Search
+		visit(id, shape) for every feature whose bbox intersects box. Candidates come from the rtree,
+		whose float boxes are rounded outwards, so they are checked again against the Shape's bbox.
+		Without an rtree every row is read and tested.
+
+		*/
+
+		template <typename Visitor>
+		bool search(const std::string& name, const BBox& box, Visitor&& visit) const {
+			const Layer* layer = find(name);
+			if (layer == nullptr) {
+				return false;
+			}
+
+			std::string sql = "SELECT t." + sqlite::quote(layer->key) + ", t." + sqlite::quote(layer->column) + " FROM " + sqlite::quote(layer->name) + " AS t";
+			if (layer->indexed) {
+				sql += " JOIN " + sqlite::quote("rtree_" + layer->name + "_" + layer->column) + " AS r ON r.id = t." + sqlite::quote(layer->key) +
+					" WHERE r.minx <= ?3 AND r.maxx >= ?1 AND r.miny <= ?4 AND r.maxy >= ?2";
+			}
+			return run(*layer, sql, layer->indexed ? &box : nullptr, [&](long long id, Shape& shape) {
+				if (!shape.empty && shape.bbox[0] <= box[2] && shape.bbox[2] >= box[0] && shape.bbox[1] <= box[3] && shape.bbox[3] >= box[1]) {
+					visit(id, shape);
+				}
+			});
+		}
+
+		std::vector<Shape> read(const std::string& name, const BBox& box) const {
+			std::vector<Shape> result;
+			search(name, box, [&](long long, Shape& shape) {
+				result.push_back(std::move(shape));
+			});
+			return result;
+		}
+
+	private:
+		sqlite3* db = nullptr;
+
+		static std::string text(sqlite3_stmt* statement, int column) {
+			const unsigned char* value = sqlite3_column_text(statement, column);
+			return value ? reinterpret_cast<const char*>(value) : "";
+		}
+
+		// Row count, SQLite counts from the b-tree pages without decoding rows
+		size_t hint(const std::string& name) const {
+			const Layer* found = layer(name);
+			if (found == nullptr) {
+				return 0;
+			}
+			try {
+				sqlite::Statement query = sqlite::prepare(db, "SELECT count(*) FROM " + sqlite::quote(found->name));
+				return sqlite3_step(query.get()) == SQLITE_ROW ? static_cast<size_t>(std::max<sqlite3_int64>(0, sqlite3_column_int64(query.get(), 0))) : 0;
+			} catch (const std::exception&) {
+				return 0;
+			}
+		}
+
+		const Layer* find(const std::string& name) const {
+			const Layer* found = layer(name);
+			if (found == nullptr) {
+				std::cerr << "GeoPackage: no feature layer " << name << std::endl;
+			}
+			return found;
+		}
+
+		template <typename Visitor>
+		bool run(const Layer& layer, const std::string& sql, const BBox* box, Visitor&& visit) const {
+			try {
+				sqlite::Statement query = sqlite::prepare(db, sql);
+				if (box != nullptr) {
+					for (int i = 0; i < 4; ++i) {
+						sqlite3_bind_double(query.get(), i + 1, (*box)[i]);
+					}
+				}
+
+				int code;
+				while ((code = sqlite3_step(query.get())) == SQLITE_ROW) {
+					const uint8_t* data = static_cast<const uint8_t*>(sqlite3_column_blob(query.get(), 1));
+					Shape shape = blob::parse(data, static_cast<size_t>(sqlite3_column_bytes(query.get(), 1)));
+					visit(static_cast<long long>(sqlite3_column_int64(query.get(), 0)), shape);
+				}
+				if (code != SQLITE_DONE) {
+					throw std::runtime_error(sqlite3_errmsg(db));
+				}
+				return true;
+			} catch (const std::exception& e) {
+				std::cerr << "GeoPackage read of " << layer.name << ": " << e.what() << std::endl;
+				return false;
+			}
+		}
+	};
+
+	struct Options {
+		std::string column = "geom";
+		int32_t srs = 4326; // -1 undefined cartesian, 0 undefined geographic
+		std::string definition; // WKT of srs when it isn't 4326, -1 or 0
+		bool rtree = true;
+	};
+
+	namespace schema {
+
+		const char* WGS84 = "GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563,AUTHORITY[\"EPSG\",\"7030\"]],AUTHORITY[\"EPSG\",\"6326\"]],"
+			"PRIMEM[\"Greenwich\",0,AUTHORITY[\"EPSG\",\"8901\"]],UNIT[\"degree\",0.0174532925199433,AUTHORITY[\"EPSG\",\"9122\"]],AUTHORITY[\"EPSG\",\"4326\"]]";
+
+		// Required tables and the three required SRS rows, the version is only set on a new file
+		void create(sqlite3* db) {
+			sqlite::Statement id = sqlite::prepare(db, "PRAGMA application_id");
+			if (sqlite3_step(id.get()) == SQLITE_ROW && sqlite3_column_int(id.get(), 0) == 0) {
+				sqlite::execute(db, "PRAGMA application_id = 1196444487"); // "GPKG"
+				sqlite::execute(db, "PRAGMA user_version = 10200");
+			}
+			sqlite::execute(db, "CREATE TABLE IF NOT EXISTS gpkg_spatial_ref_sys (srs_name TEXT NOT NULL, srs_id INTEGER NOT NULL PRIMARY KEY,"
+				" organization TEXT NOT NULL, organization_coordsys_id INTEGER NOT NULL, definition TEXT NOT NULL, description TEXT)");
+			sqlite::execute(db, "CREATE TABLE IF NOT EXISTS gpkg_contents (table_name TEXT NOT NULL PRIMARY KEY, data_type TEXT NOT NULL, identifier TEXT UNIQUE,"
+				" description TEXT DEFAULT '', last_change DATETIME NOT NULL DEFAULT (strftime('%Y-%m-%dT%H:%M:%fZ','now')),"
+				" min_x DOUBLE, min_y DOUBLE, max_x DOUBLE, max_y DOUBLE, srs_id INTEGER, CONSTRAINT fk_gc_r_srs_id FOREIGN KEY (srs_id) REFERENCES gpkg_spatial_ref_sys(srs_id))");
+			sqlite::execute(db, "CREATE TABLE IF NOT EXISTS gpkg_geometry_columns (table_name TEXT NOT NULL, column_name TEXT NOT NULL, geometry_type_name TEXT NOT NULL,"
+				" srs_id INTEGER NOT NULL, z TINYINT NOT NULL, m TINYINT NOT NULL, CONSTRAINT pk_geom_cols PRIMARY KEY (table_name, column_name),"
+				" CONSTRAINT uk_gc_table_name UNIQUE (table_name), CONSTRAINT fk_gc_tn FOREIGN KEY (table_name) REFERENCES gpkg_contents(table_name),"
+				" CONSTRAINT fk_gc_srs FOREIGN KEY (srs_id) REFERENCES gpkg_spatial_ref_sys (srs_id))");
+			sqlite::execute(db, "CREATE TABLE IF NOT EXISTS gpkg_extensions (table_name TEXT, column_name TEXT, extension_name TEXT NOT NULL,"
+				" definition TEXT NOT NULL, scope TEXT NOT NULL, CONSTRAINT ge_tce UNIQUE (table_name, column_name, extension_name))");
+			sqlite::execute(db, std::string("INSERT OR IGNORE INTO gpkg_spatial_ref_sys VALUES") +
+				" ('Undefined cartesian SRS', -1, 'NONE', -1, 'undefined', 'undefined cartesian coordinate reference system')," +
+				" ('Undefined geographic SRS', 0, 'NONE', 0, 'undefined', 'undefined geographic coordinate reference system')," +
+				" ('WGS 84 geodetic', 4326, 'EPSG', 4326, '" + WGS84 + "', 'longitude/latitude coordinates in decimal degrees on the WGS 84 spheroid')");
+		}
+
+		/*
+
+		Triggers
+		The spec's triggers keeping the rtree in step with later edits. They call ST_IsEmpty and ST_MinX .. ST_MaxY,
+		which GDAL provides and sqlite::install registers, so they are created after the bulk insert.
+
+		*/
+
+		void triggers(sqlite3* db, const std::string& table, const std::string& column, const std::string& key) {
+			std::string t = sqlite::quote(table);
+			std::string c = sqlite::quote(column);
+			std::string i = sqlite::quote(key);
+			std::string name = "rtree_" + table + "_" + column;
+			std::string r = sqlite::quote(name);
+			std::string insert = "INSERT OR REPLACE INTO " + r + " VALUES (NEW." + i + ", ST_MinX(NEW." + c + "), ST_MaxX(NEW." + c + "), ST_MinY(NEW." + c + "), ST_MaxY(NEW." + c + "));";
+			std::string present = "(NEW." + c + " NOT NULL AND NOT ST_IsEmpty(NEW." + c + "))";
+			std::string absent = "(NEW." + c + " ISNULL OR ST_IsEmpty(NEW." + c + "))";
+
+			sqlite::execute(db, "CREATE TRIGGER " + sqlite::quote(name + "_insert") + " AFTER INSERT ON " + t + " WHEN " + present + " BEGIN " + insert + " END");
+			sqlite::execute(db, "CREATE TRIGGER " + sqlite::quote(name + "_update1") + " AFTER UPDATE OF " + c + " ON " + t + " WHEN OLD." + i + " = NEW." + i + " AND " + present + " BEGIN " + insert + " END");
+			sqlite::execute(db, "CREATE TRIGGER " + sqlite::quote(name + "_update2") + " AFTER UPDATE OF " + c + " ON " + t + " WHEN OLD." + i + " = NEW." + i + " AND " + absent + " BEGIN DELETE FROM " + r + " WHERE id = OLD." + i + "; END");
+			sqlite::execute(db, "CREATE TRIGGER " + sqlite::quote(name + "_update3") + " AFTER UPDATE ON " + t + " WHEN OLD." + i + " != NEW." + i + " AND " + present + " BEGIN DELETE FROM " + r + " WHERE id = OLD." + i + "; " + insert + " END");
+			sqlite::execute(db, "CREATE TRIGGER " + sqlite::quote(name + "_update4") + " AFTER UPDATE ON " + t + " WHEN OLD." + i + " != NEW." + i + " AND " + absent + " BEGIN DELETE FROM " + r + " WHERE id IN (OLD." + i + ", NEW." + i + "); END");
+			sqlite::execute(db, "CREATE TRIGGER " + sqlite::quote(name + "_delete") + " AFTER DELETE ON " + t + " WHEN OLD." + c + " NOT NULL BEGIN DELETE FROM " + r + " WHERE id = OLD." + i + "; END");
+		}
+
+		// Common type of the Shapes, GEOMETRY when they differ
+		std::string type(const std::vector<Shape>& shapes) {
+			std::string common;
+			for (const Shape& shape : shapes) {
+				if (shape.empty) {
+					continue;
+				}
+				std::string name = shape.type == "Point" ? "POINT" : shape.type == "Line" ? "LINESTRING" : shape.type == "MultiLine" ? "MULTILINESTRING" : shape.type == "Polygon" ? "POLYGON" : "MULTIPOLYGON";
+				if (common.empty()) {
+					common = name;
+				} else if (common != name) {
+					return "GEOMETRY";
+				}
+			}
+			return common.empty() ? "GEOMETRY" : common;
+		}
+	}
+
+	/*
+
+	Write
+	Adds a feature table to path, creating the GeoPackage if needed, in one transaction with prepared statements.
+	Empty Shapes get a NULL geometry. The rtree is filled in the same pass, its triggers are added at the end.
+	False on error, nothing is left behind.
+
+	*/
+
+	bool write(const std::string& path, const std::string& name, const std::vector<Shape>& shapes, const Options& options = {}) {
+		sqlite3* db = nullptr;
+		if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+			std::cerr << "Error opening " << path << ": " << sqlite3_errmsg(db) << std::endl;
+			sqlite3_close_v2(db);
+			return false;
+		}
+
+		bool open = false;
+		try {
+			sqlite::execute(db, "BEGIN");
+			open = true;
+			schema::create(db);
+
+			if (options.srs != 4326 && options.srs != 0 && options.srs != -1) {
+				sqlite::Statement srs = sqlite::prepare(db, "INSERT OR IGNORE INTO gpkg_spatial_ref_sys VALUES (?1, ?2, 'EPSG', ?2, ?3, '')");
+				std::string srsName = "EPSG:" + std::to_string(options.srs);
+				std::string definition = options.definition.empty() ? "undefined" : options.definition;
+				sqlite3_bind_text(srs.get(), 1, srsName.c_str(), -1, SQLITE_TRANSIENT);
+				sqlite3_bind_int(srs.get(), 2, options.srs);
+				sqlite3_bind_text(srs.get(), 3, definition.c_str(), -1, SQLITE_TRANSIENT);
+				if (sqlite3_step(srs.get()) != SQLITE_DONE) {
+					throw std::runtime_error(sqlite3_errmsg(db));
+				}
+			}
+
+			std::string table = sqlite::quote(name);
+			std::string column = sqlite::quote(options.column);
+			std::string type = schema::type(shapes);
+			std::string rtree = "rtree_" + name + "_" + options.column;
+			sqlite::execute(db, "CREATE TABLE " + table + " (fid INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, " + column + " " + type + ")");
+			if (options.rtree) {
+				sqlite::execute(db, "CREATE VIRTUAL TABLE " + sqlite::quote(rtree) + " USING rtree(id, minx, maxx, miny, maxy)");
+			}
+
+			sqlite::Statement row = sqlite::prepare(db, "INSERT INTO " + table + " (" + column + ") VALUES (?)");
+			sqlite::Statement node = options.rtree ? sqlite::prepare(db, "INSERT INTO " + sqlite::quote(rtree) + " (id, minx, maxx, miny, maxy) VALUES (?, ?, ?, ?, ?)") : nullptr;
+			BBox extent = Layer().bbox;
+			std::string data;
+
+			for (const Shape& shape : shapes) {
+				sqlite3_reset(row.get());
+				if (shape.empty) {
+					sqlite3_bind_null(row.get(), 1);
+				} else {
+					data.clear();
+					blob::write(data, shape, options.srs);
+					sqlite3_bind_blob(row.get(), 1, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+				}
+				if (sqlite3_step(row.get()) != SQLITE_DONE) {
+					throw std::runtime_error(sqlite3_errmsg(db));
+				}
+				if (shape.empty) {
+					continue;
+				}
+
+				extent[0] = std::min(extent[0], shape.bbox[0]);
+				extent[1] = std::min(extent[1], shape.bbox[1]);
+				extent[2] = std::max(extent[2], shape.bbox[2]);
+				extent[3] = std::max(extent[3], shape.bbox[3]);
+
+				if (node) {
+					sqlite3_reset(node.get());
+					sqlite3_bind_int64(node.get(), 1, sqlite3_last_insert_rowid(db));
+					sqlite3_bind_double(node.get(), 2, shape.bbox[0]);
+					sqlite3_bind_double(node.get(), 3, shape.bbox[2]);
+					sqlite3_bind_double(node.get(), 4, shape.bbox[1]);
+					sqlite3_bind_double(node.get(), 5, shape.bbox[3]);
+					if (sqlite3_step(node.get()) != SQLITE_DONE) {
+						throw std::runtime_error(sqlite3_errmsg(db));
+					}
+				}
+			}
+			row.reset();
+			node.reset();
+
+			sqlite::Statement contents = sqlite::prepare(db, "INSERT INTO gpkg_contents (table_name, data_type, identifier, min_x, min_y, max_x, max_y, srs_id) VALUES (?1, 'features', ?1, ?2, ?3, ?4, ?5, ?6)");
+			sqlite3_bind_text(contents.get(), 1, name.c_str(), -1, SQLITE_TRANSIENT);
+			if (extent[0] <= extent[2]) {
+				for (int i = 0; i < 4; ++i) {
+					sqlite3_bind_double(contents.get(), i + 2, extent[i]);
+				}
+			}
+			sqlite3_bind_int(contents.get(), 6, options.srs);
+			if (sqlite3_step(contents.get()) != SQLITE_DONE) {
+				throw std::runtime_error(sqlite3_errmsg(db));
+			}
+
+			sqlite::Statement columns = sqlite::prepare(db, "INSERT INTO gpkg_geometry_columns VALUES (?, ?, ?, ?, 0, 0)");
+			sqlite3_bind_text(columns.get(), 1, name.c_str(), -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(columns.get(), 2, options.column.c_str(), -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(columns.get(), 3, type.c_str(), -1, SQLITE_TRANSIENT);
+			sqlite3_bind_int(columns.get(), 4, options.srs);
+			if (sqlite3_step(columns.get()) != SQLITE_DONE) {
+				throw std::runtime_error(sqlite3_errmsg(db));
+			}
+
+			if (options.rtree) {
+				sqlite::Statement extension = sqlite::prepare(db, "INSERT INTO gpkg_extensions VALUES (?, ?, 'gpkg_rtree_index', 'http://www.geopackage.org/spec120/#extension_rtree', 'write-only')");
+				sqlite3_bind_text(extension.get(), 1, name.c_str(), -1, SQLITE_TRANSIENT);
+				sqlite3_bind_text(extension.get(), 2, options.column.c_str(), -1, SQLITE_TRANSIENT);
+				if (sqlite3_step(extension.get()) != SQLITE_DONE) {
+					throw std::runtime_error(sqlite3_errmsg(db));
+				}
+				schema::triggers(db, name, options.column, "fid");
+			}
+
+			sqlite::execute(db, "COMMIT");
+			sqlite3_close_v2(db);
+			return true;
+		} catch (const std::exception& e) {
+			std::cerr << "GeoPackage write of " << name << ": " << e.what() << std::endl;
+			if (open) {
+				sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+			}
+			sqlite3_close_v2(db);
+			return false;
+		}
+	}
+}
+
+#endif
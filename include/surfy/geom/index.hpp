@@ -0,0 +1,461 @@
+#ifndef SURFY_GEOM_INDEX_HPP
+#define SURFY_GEOM_INDEX_HPP
+
+/*
+
+Index
+Static packed Hilbert R-tree over bounding boxes.
+Items are sorted by the Hilbert value of their bbox centre and packed into nodes of nodeSize,
+levels are stored bottom-up in flat arrays: leaves first, root last.
+
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+#include "geom.hpp"
+
+namespace surfy::geom::index {
+
+	/*
+
+	Hilbert
+	Position of x, y (16 bits each) on the Hilbert curve.
+	Fast Hilbert curve algorithm by http://threadlocalmutex.com/
+
+	*/
+
+	uint32_t hilbert(uint32_t x, uint32_t y) {
+		uint32_t a = x ^ y;
+		uint32_t b = 0xFFFF ^ a;
+		uint32_t c = 0xFFFF ^ (x | y);
+		uint32_t d = x & (y ^ 0xFFFF);
+
+		uint32_t A = a | (b >> 1);
+		uint32_t B = (a >> 1) ^ a;
+		uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+		uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+		a = A; b = B; c = C; d = D;
+		A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+		B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+		C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+		D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+		a = A; b = B; c = C; d = D;
+		A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+		B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+		C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+		D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+		a = A; b = B; c = C; d = D;
+		C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+		D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+		a = C ^ (C >> 1);
+		b = D ^ (D >> 1);
+
+		uint32_t i0 = x ^ y;
+		uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+		i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+		i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+		i0 = (i0 | (i0 << 2)) & 0x33333333;
+		i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+		i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+		i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+		i1 = (i1 | (i1 << 2)) & 0x33333333;
+		i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+		return (i1 << 1) | i0;
+	}
+
+	bool intersects(const BBox& a, const BBox& b) {
+		return a[0] <= b[2] && a[1] <= b[3] && a[2] >= b[0] && a[3] >= b[1];
+	}
+
+	// Distance from a point to the nearest point of a bbox, zero inside
+	double distance(const BBox& box, const Point& point) {
+		double dx = std::max({box[0] - point.x, .0, point.x - box[2]});
+		double dy = std::max({box[1] - point.y, .0, point.y - box[3]});
+		return std::sqrt(dx * dx + dy * dy);
+	}
+
+	struct Neighbor {
+		size_t index;
+		double distance;
+	};
+
+	/*
+
+	Packed
+	Build: add() every bbox, then finish(). Or pass a range of Shapes to the constructor.
+	boxes and indices hold all nodes, for leaves indices are item ids,
+	for inner nodes the position of the first child.
+
+	*/
+
+	class Packed {
+	public:
+		uint16_t nodeSize;
+		size_t size;
+		BBox bounds = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+		std::vector<BBox> boxes;
+		std::vector<uint64_t> indices;
+		std::vector<size_t> levels; // End position of every level, leaves first
+
+		Packed(size_t size = 0, uint16_t nodeSize = 16) : nodeSize(std::clamp<uint16_t>(nodeSize, 2, 65535)), size(size) {
+			layout();
+			boxes.reserve(levels.empty() ? 0 : levels.back());
+			indices.reserve(boxes.capacity());
+		}
+
+		// Any range of Shapes, or of pointers to Shapes
+		template <typename Iterator>
+		Packed(Iterator first, Iterator last, uint16_t nodeSize = 16) : Packed(std::distance(first, last), nodeSize) {
+			for (Iterator it = first; it != last; ++it) {
+				if constexpr (std::is_pointer_v<typename std::iterator_traits<Iterator>::value_type>) {
+					add((*it)->bbox);
+				} else {
+					add(it->bbox);
+				}
+			}
+			finish();
+		}
+
+		size_t add(const BBox& box) {
+			size_t index = boxes.size();
+			boxes.push_back(box);
+			indices.push_back(index);
+			bounds[0] = std::min(bounds[0], box[0]);
+			bounds[1] = std::min(bounds[1], box[1]);
+			bounds[2] = std::max(bounds[2], box[2]);
+			bounds[3] = std::max(bounds[3], box[3]);
+			return index;
+		}
+
+		/*
+
+		Finish
+		Sorts items along the Hilbert curve, then builds parent nodes level by level
+
+		*/
+
+		void finish() {
+			if (boxes.size() != size) {
+				throw std::runtime_error("Index: added " + std::to_string(boxes.size()) + " items instead of " + std::to_string(size));
+			}
+
+			if (size == 0) {
+				return;
+			}
+
+			if (size > nodeSize) {
+				sort();
+			}
+
+			size_t pos = 0;
+			for (size_t level = 0; level + 1 < levels.size(); ++level) {
+				size_t end = levels[level];
+				while (pos < end) {
+					BBox node = boxes[pos];
+					uint64_t first = pos;
+					for (size_t i = 0; i < nodeSize && pos < end; ++i, ++pos) {
+						const BBox& box = boxes[pos];
+						node[0] = std::min(node[0], box[0]);
+						node[1] = std::min(node[1], box[1]);
+						node[2] = std::max(node[2], box[2]);
+						node[3] = std::max(node[3], box[3]);
+					}
+					boxes.push_back(node);
+					indices.push_back(first);
+				}
+			}
+		}
+
+		/*
+
+		Search
+		visit(index) is called for every item whose bbox intersects the query.
+		If visit returns bool, false stops the search. Nothing is allocated per result,
+		pass a stack to reuse across many small queries.
+
+		*/
+
+		template <typename Visitor>
+		void search(const BBox& query, Visitor&& visit) const {
+			std::vector<size_t> stack;
+			search(query, visit, stack);
+		}
+
+		template <typename Visitor>
+		void search(const BBox& query, Visitor&& visit, std::vector<size_t>& stack) const {
+			if (boxes.empty()) {
+				return;
+			}
+
+			// Pairs of node position and level
+			stack.clear();
+			stack.reserve(levels.size() * 2);
+
+			size_t node = boxes.size() - 1;
+			size_t level = levels.size() - 1;
+
+			while (true) {
+				size_t end = std::min<size_t>(node + nodeSize, levels[level]);
+
+				for (size_t pos = node; pos < end; ++pos) {
+					if (!intersects(query, boxes[pos])) {
+						continue;
+					}
+
+					if (node < size) {
+						if constexpr (std::is_same_v<std::invoke_result_t<Visitor, size_t>, bool>) {
+							if (!visit(static_cast<size_t>(indices[pos]))) {
+								return;
+							}
+						} else {
+							visit(static_cast<size_t>(indices[pos]));
+						}
+					} else {
+						stack.push_back(indices[pos]);
+						stack.push_back(level - 1);
+					}
+				}
+
+				if (stack.empty()) {
+					break;
+				}
+
+				level = stack.back();
+				stack.pop_back();
+				node = stack.back();
+				stack.pop_back();
+			}
+		}
+
+		std::vector<size_t> search(const BBox& query) const {
+			std::vector<size_t> result;
+			search(query, [&result](size_t index) {
+				result.push_back(index);
+			});
+			return result;
+		}
+
+		/*
+
+		Nearest
+		Best-first k nearest neighbours, closest first.
+		exact(index) gives the real distance of an item, it is only called when the item's bbox
+		comes out of the queue, so candidates the bbox bound already rules out are never refined.
+		Items farther than max are skipped.
+
+		*/
+
+		template <typename Distance>
+		std::vector<Neighbor> nearest(const Point& point, size_t k, Distance&& exact, const double& max = std::numeric_limits<double>::infinity()) const {
+			std::vector<Neighbor> result;
+			if (boxes.empty() || k == 0) {
+				return result;
+			}
+
+			enum Kind { Node, Item, Exact };
+
+			// Node: entries from pos on its level, Item: leaf at pos with bbox distance, Exact: refined leaf
+			struct Candidate {
+				double distance;
+				size_t pos;
+				size_t level;
+				Kind kind;
+
+				bool operator>(const Candidate& other) const {
+					return distance > other.distance || (distance == other.distance && kind < other.kind);
+				}
+			};
+
+			std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+			queue.push({.0, boxes.size() - 1, levels.size() - 1, Node});
+
+			while (!queue.empty()) {
+				Candidate top = queue.top();
+				queue.pop();
+
+				if (top.distance > max) {
+					break;
+				}
+
+				if (top.kind == Exact) {
+					result.push_back({static_cast<size_t>(indices[top.pos]), top.distance});
+					if (result.size() == k) {
+						break;
+					}
+					continue;
+				}
+
+				if (top.kind == Item) {
+					double dist = exact(static_cast<size_t>(indices[top.pos]));
+					if (dist <= max) {
+						queue.push({dist, top.pos, 0, Exact});
+					}
+					continue;
+				}
+
+				size_t end = std::min<size_t>(top.pos + nodeSize, levels[top.level]);
+				for (size_t pos = top.pos; pos < end; ++pos) {
+					double dist = distance(boxes[pos], point);
+					if (dist > max) {
+						continue;
+					}
+
+					if (top.pos < size) {
+						queue.push({dist, pos, 0, Item});
+					} else {
+						queue.push({dist, static_cast<size_t>(indices[pos]), top.level - 1, Node});
+					}
+				}
+			}
+
+			return result;
+		}
+
+		/*
+
+		Serialize
+		"SGPR", uint8 version, uint16 nodeSize, uint64 size, boxes as 4 doubles, uint64 indices.
+		Native byte order.
+
+		*/
+
+		std::string serialize() const {
+			std::string data;
+			uint64_t count = size;
+			data.reserve(15 + boxes.size() * (sizeof(BBox) + sizeof(uint64_t)));
+			data.append("SGPR", 4);
+			data.push_back(static_cast<char>(VERSION));
+			data.append(reinterpret_cast<const char*>(&nodeSize), sizeof(nodeSize));
+			data.append(reinterpret_cast<const char*>(&count), sizeof(count));
+			data.append(reinterpret_cast<const char*>(boxes.data()), boxes.size() * sizeof(BBox));
+			data.append(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint64_t));
+			return data;
+		}
+
+		static Packed deserialize(const char* data, size_t length) {
+			if (length < 15 || std::memcmp(data, "SGPR", 4) != 0 || static_cast<uint8_t>(data[4]) != VERSION) {
+				throw std::runtime_error("Index: invalid data");
+			}
+
+			uint16_t nodeSize;
+			uint64_t count;
+			std::memcpy(&nodeSize, data + 5, sizeof(nodeSize));
+			std::memcpy(&count, data + 7, sizeof(count));
+
+			// Size is checked before anything is allocated, there are at least count nodes
+			const size_t entry = sizeof(BBox) + sizeof(uint64_t);
+			if (count > (length - 15) / entry || length != 15 + total(count, nodeSize) * entry) {
+				throw std::runtime_error("Index: invalid data length");
+			}
+
+			Packed tree(count, nodeSize);
+			size_t nodes = tree.levels.empty() ? 0 : tree.levels.back();
+			if (nodes != 0) {
+				tree.boxes.resize(nodes);
+				tree.indices.resize(nodes);
+				std::memcpy(tree.boxes.data(), data + 15, nodes * sizeof(BBox));
+				std::memcpy(tree.indices.data(), data + 15 + nodes * sizeof(BBox), nodes * sizeof(uint64_t));
+				tree.bounds = tree.boxes.back();
+			}
+
+			// Inner nodes must point into the level below, search follows them
+			for (size_t level = 1; level < tree.levels.size(); ++level) {
+				size_t first = level > 1 ? tree.levels[level - 2] : 0;
+				for (size_t pos = tree.levels[level - 1]; pos < tree.levels[level]; ++pos) {
+					if (tree.indices[pos] < first || tree.indices[pos] >= tree.levels[level - 1]) {
+						throw std::runtime_error("Index: invalid node");
+					}
+				}
+			}
+			return tree;
+		}
+
+		static Packed deserialize(const std::string& data) {
+			return deserialize(data.data(), data.size());
+		}
+
+	private:
+		static constexpr uint8_t VERSION = 1;
+
+		// Nodes of a tree of count items, the same sum as layout()
+		static size_t total(size_t count, uint16_t nodeSize) {
+			nodeSize = std::clamp<uint16_t>(nodeSize, 2, 65535);
+			if (count == 0) {
+				return 0;
+			}
+
+			size_t sum = count;
+			do {
+				count = (count + nodeSize - 1) / nodeSize;
+				sum += count;
+			} while (count != 1);
+			return sum;
+		}
+
+		// Level end positions, a single root node on top
+		void layout() {
+			levels.clear();
+			if (size == 0) {
+				return;
+			}
+
+			size_t count = size;
+			size_t total = count;
+			levels.push_back(total);
+			do {
+				count = (count + nodeSize - 1) / nodeSize;
+				total += count;
+				levels.push_back(total);
+			} while (count != 1);
+		}
+
+		// Position on a 16-bit grid, clamped: empty boxes have their centre at 0, maybe off the bounds
+		static uint32_t cell(double value) {
+			const double scale = 65535.;
+			value *= scale;
+			return value > 0 ? (value < scale ? static_cast<uint32_t>(value) : 65535) : 0;
+		}
+
+		void sort() {
+			double width = bounds[2] - bounds[0];
+			double height = bounds[3] - bounds[1];
+
+			std::vector<uint32_t> values(size);
+			for (size_t i = 0; i < size; ++i) {
+				const BBox& box = boxes[i];
+				uint32_t x = width > 0 ? cell(((box[0] + box[2]) / 2 - bounds[0]) / width) : 0;
+				uint32_t y = height > 0 ? cell(((box[1] + box[3]) / 2 - bounds[1]) / height) : 0;
+				values[i] = hilbert(x, y);
+			}
+
+			std::vector<size_t> order(size);
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [&values](size_t a, size_t b) {
+				return values[a] < values[b];
+			});
+
+			std::vector<BBox> sortedBoxes(size);
+			std::vector<uint64_t> sortedIndices(size);
+			for (size_t i = 0; i < size; ++i) {
+				sortedBoxes[i] = boxes[order[i]];
+				sortedIndices[i] = indices[order[i]];
+			}
+			boxes.swap(sortedBoxes);
+			indices.swap(sortedIndices);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef SURFY_GEOM_JOIN_HPP
+#define SURFY_GEOM_JOIN_HPP
+
+/*
+
+Join
+Points in polygons at scale.
+Polygons are indexed once (packed R-tree over bboxes, PreparedPolygon per polygon).
+Points are radix sorted along the Hilbert curve so neighbouring points hit the same tree nodes
+and polygon edges, then split into chunks run on the work-stealing pool.
+
+*/
+
+#include <atomic>
+#include <span>
+#include <stdexcept>
+#include "geom.hpp"
+#include "curve.hpp"
+#include "index.hpp"
+#include "pool.hpp"
+#include "prepared.hpp"
+
+namespace surfy::geom::join {
+
+	struct Pair {
+		size_t point;
+		size_t polygon;
+	};
+
+	struct Options {
+		size_t chunk = 16384; // Points per task
+	};
+
+	class Join {
+	public:
+		Options options;
+
+		// Work runs on workers, the library pool by default
+		Join(const std::vector<Shape>& polygons, const Options& options = {}, pool::Pool& workers = pool::shared()) : options(options), workers(workers), tree(polygons.begin(), polygons.end()), prepared(polygons.size()) {
+			pool::Group group;
+			size_t step = std::max<size_t>(1, polygons.size() / (workers.size() * 8));
+			for (size_t first = 0; first < polygons.size(); first += step) {
+				size_t last = std::min(first + step, polygons.size());
+				workers.submit(group, [this, &polygons, first, last]() {
+					for (size_t i = first; i < last; ++i) {
+						prepared[i] = PreparedPolygon(polygons[i]);
+					}
+				});
+			}
+			workers.wait(group);
+		}
+
+		size_t size() const {
+			return prepared.size();
+		}
+
+		/*
+
+		Contains
+		visit(polygon) for every polygon containing the point, stack is reused between calls
+
+		*/
+
+		template <typename Visitor>
+		void contains(const Point& point, Visitor&& visit, std::vector<size_t>& stack) const {
+			tree.search({point.x, point.y, point.x, point.y}, [&](size_t polygon) {
+				if (prepared[polygon].contains(point)) {
+					visit(polygon);
+				}
+			}, stack);
+		}
+
+		/*
+
+		Pairs
+		(point, polygon) for every point inside a polygon, in Hilbert order of the points.
+		offset is added to point indices, so a huge set can be fed in batches.
+
+		*/
+
+		std::vector<Pair> pairs(std::span<const Point> points, size_t offset = 0) const {
+			std::vector<uint32_t> sorted = order(points);
+			size_t chunk = std::max<size_t>(1, options.chunk);
+			size_t chunks = (sorted.size() + chunk - 1) / chunk;
+			std::vector<std::vector<Pair>> found(chunks);
+
+			run(sorted, [&](size_t chunk, size_t first, size_t last) {
+				std::vector<Pair>& result = found[chunk];
+				std::vector<size_t> stack;
+				for (size_t i = first; i < last; ++i) {
+					size_t index = sorted[i];
+					contains(points[index], [&](size_t polygon) {
+						result.push_back({index + offset, polygon});
+					}, stack);
+				}
+			});
+
+			size_t total = 0;
+			for (const std::vector<Pair>& result : found) {
+				total += result.size();
+			}
+
+			std::vector<Pair> result;
+			result.reserve(total);
+			for (const std::vector<Pair>& part : found) {
+				result.insert(result.end(), part.begin(), part.end());
+			}
+			return result;
+		}
+
+		/*
+
+		Counts
+		Points per polygon, added to counts (resized to the number of polygons).
+		Runs of points in the same polygon are summed locally before one atomic add.
+
+		*/
+
+		void counts(std::span<const Point> points, std::vector<size_t>& counts) const {
+			counts.resize(prepared.size(), 0);
+			std::vector<uint32_t> sorted = order(points);
+
+			run(sorted, [&](size_t, size_t first, size_t last) {
+				std::vector<size_t> stack;
+				size_t current = 0;
+				size_t run = 0;
+
+				auto flush = [&]() {
+					if (run != 0) {
+						std::atomic_ref<size_t>(counts[current]).fetch_add(run, std::memory_order_relaxed);
+						run = 0;
+					}
+				};
+
+				for (size_t i = first; i < last; ++i) {
+					contains(points[sorted[i]], [&](size_t polygon) {
+						if (polygon != current) {
+							flush();
+							current = polygon;
+						}
+						++run;
+					}, stack);
+				}
+				flush();
+			});
+		}
+
+		std::vector<size_t> counts(std::span<const Point> points) const {
+			std::vector<size_t> result;
+			counts(points, result);
+			return result;
+		}
+
+	private:
+		pool::Pool& workers;
+		index::Packed tree;
+		std::vector<PreparedPolygon> prepared;
+
+		/*
+
+		Order
+		Indices of the points inside the polygons' bounds, sorted by Hilbert key.
+		Points outside can't match and are left out here, so are NaN coordinates.
+		Keys are 32 bits and the sort is stable, so it takes 4 radix passes.
+
+		*/
+
+		std::vector<uint32_t> order(std::span<const Point> points) const {
+			if (points.size() > 0xFFFFFFFF) {
+				throw std::runtime_error("Join: more than 2^32 points, pass them in batches");
+			}
+
+			std::vector<uint32_t> sorted;
+			std::vector<uint64_t> keys;
+			if (tree.boxes.empty()) {
+				return sorted;
+			}
+
+			const BBox& bounds = tree.bounds;
+			double width = bounds[2] - bounds[0];
+			double height = bounds[3] - bounds[1];
+			const double scale = 65535.;
+
+			sorted.reserve(points.size());
+			keys.reserve(points.size());
+			for (size_t i = 0; i < points.size(); ++i) {
+				const Point& p = points[i];
+				// Negated so NaN fails too
+				if (!(p.x >= bounds[0] && p.x <= bounds[2] && p.y >= bounds[1] && p.y <= bounds[3])) {
+					continue;
+				}
+
+				uint32_t x = width > 0 ? static_cast<uint32_t>(std::clamp(scale * (p.x - bounds[0]) / width, .0, scale)) : 0;
+				uint32_t y = height > 0 ? static_cast<uint32_t>(std::clamp(scale * (p.y - bounds[1]) / height, .0, scale)) : 0;
+				keys.push_back(index::hilbert(x, y));
+				sorted.push_back(i);
+			}
+
+			curve::sort(keys, sorted, workers);
+			return sorted;
+		}
+
+		// task(chunk, first, last) for consecutive chunks of the sorted points
+		template <typename Task>
+		void run(const std::vector<uint32_t>& sorted, Task&& task) const {
+			size_t chunk = std::max<size_t>(1, options.chunk);
+			pool::Group group;
+			for (size_t first = 0, i = 0; first < sorted.size(); first += chunk, ++i) {
+				size_t last = std::min(first + chunk, sorted.size());
+				workers.submit(group, [&task, i, first, last]() {
+					task(i, first, last);
+				});
+			}
+			workers.wait(group);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,464 @@
+#ifndef SURFY_GEOM_MVT_HPP
+#define SURFY_GEOM_MVT_HPP
+
+/*
+
+Mapbox Vector Tile
+Encodes clipped and simplified Shapes into MVT 2.1 command streams and protobuf tiles.
+https://github.com/mapbox/vector-tile-spec/tree/master/2.1
+
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <variant>
+#include "geom.hpp"
+
+namespace surfy::geom::mvt {
+
+	enum GeomType : uint32_t {
+		UNKNOWN = 0,
+		POINT = 1,
+		LINESTRING = 2,
+		POLYGON = 3
+	};
+
+	enum Command : uint32_t {
+		MoveTo = 1,
+		LineTo = 2,
+		ClosePath = 7
+	};
+
+	using Value = std::variant<std::string, double, int64_t, bool>;
+	using Properties = std::map<std::string, Value>;
+
+	struct Geometry {
+		GeomType type = UNKNOWN;
+		std::vector<uint32_t> commands;
+
+		bool empty() const {
+			return commands.empty();
+		}
+	};
+
+	/*
+
+	Protobuf Writer
+	Minimal wire format writer, enough for the Tile, Layer, Feature and Value messages
+
+	*/
+
+	namespace pbf {
+
+		enum WireType : uint32_t {
+			VARINT = 0,
+			FIXED64 = 1,
+			BYTES = 2,
+			FIXED32 = 5
+		};
+
+		class Writer {
+		public:
+			std::string data;
+
+			void varint(uint64_t value) {
+				while (value >= 0x80) {
+					data.push_back(static_cast<char>((value & 0x7F) | 0x80));
+					value >>= 7;
+				}
+				data.push_back(static_cast<char>(value));
+			}
+
+			void key(uint32_t field, WireType type) {
+				varint((static_cast<uint64_t>(field) << 3) | type);
+			}
+
+			void uint(uint32_t field, uint64_t value) {
+				key(field, VARINT);
+				varint(value);
+			}
+
+			void sint(uint32_t field, int64_t value) {
+				key(field, VARINT);
+				varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+			}
+
+			void boolean(uint32_t field, bool value) {
+				key(field, VARINT);
+				data.push_back(value ? 1 : 0);
+			}
+
+			void fixed64(uint32_t field, double value) {
+				key(field, FIXED64);
+				uint64_t bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+				for (int i = 0; i < 8; ++i) {
+					data.push_back(static_cast<char>(bits >> (i * 8)));
+				}
+			}
+
+			void bytes(uint32_t field, const std::string& value) {
+				key(field, BYTES);
+				varint(value.size());
+				data.append(value);
+			}
+
+			void packed(uint32_t field, const std::vector<uint32_t>& values) {
+				if (values.empty()) {
+					return;
+				}
+
+				Writer body;
+				for (uint32_t value : values) {
+					body.varint(value);
+				}
+				bytes(field, body.data);
+			}
+		};
+	}
+
+	/*
+
+	ZigZag
+	Maps signed deltas to unsigned integers: 0, -1, 1, -2, 2 => 0, 1, 2, 3, 4
+
+	*/
+
+	uint32_t zigzag(int32_t n) {
+		return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+	}
+
+	uint32_t command(Command id, uint32_t count) {
+		return (id & 0x7) | (count << 3);
+	}
+
+	/*
+
+	Encoder
+	Projects Shape coordinates onto the tile grid and writes command integers.
+	The tile BBox is [minX, minY, maxX, maxY] in Shape coordinates with Y pointing up,
+	tile space has its origin at the top left corner with Y pointing down.
+	A BBox with no width or height projects that axis onto 0.
+
+	*/
+
+	class Encoder {
+	public:
+		struct Cell {
+			int32_t x, y;
+		};
+
+		BBox bbox;
+		uint32_t extent;
+
+		Encoder(const BBox& bbox, uint32_t extent = 4096) : bbox(bbox), extent(extent) {
+			scaleX = bbox[2] > bbox[0] ? extent / (bbox[2] - bbox[0]) : 0;
+			scaleY = bbox[3] > bbox[1] ? extent / (bbox[3] - bbox[1]) : 0;
+		}
+
+		Cell project(const Point& p) const {
+			return {
+				static_cast<int32_t>(std::lround((p.x - bbox[0]) * scaleX)),
+				static_cast<int32_t>(std::lround((bbox[3] - p.y) * scaleY))
+			};
+		}
+
+		Geometry encode(const Shape& shape) {
+			Geometry result;
+			cursor = {0, 0};
+
+			if (shape.type == "Point") {
+
+				result.type = POINT;
+				Cell cell = project(shape.geom.point);
+				result.commands.push_back(command(MoveTo, 1));
+				write(result.commands, cell);
+
+			} else if (shape.type == "Line") {
+
+				result.type = LINESTRING;
+				line(result.commands, shape.geom.line.coords);
+
+			} else if (shape.type == "MultiLine") {
+
+				result.type = LINESTRING;
+				for (const types::Line& item : shape.geom.multiLine.items) {
+					line(result.commands, item.coords);
+				}
+
+			} else if (shape.type == "Polygon") {
+
+				result.type = POLYGON;
+				polygon(result.commands, shape.geom.polygon);
+
+			} else if (shape.type == "MultiPolygon") {
+
+				result.type = POLYGON;
+				for (const types::Polygon& item : shape.geom.multiPolygon.items) {
+					polygon(result.commands, item);
+				}
+
+			}
+
+			if (result.commands.empty()) {
+				result.type = UNKNOWN;
+			}
+
+			return result;
+		}
+
+	private:
+		double scaleX, scaleY;
+		Cell cursor;
+
+		// Quantize coords and drop consecutive duplicates which collapsed into the same cell
+		std::vector<Cell> quantize(const Coords& coords) const {
+			std::vector<Cell> cells;
+			cells.reserve(coords.size());
+			for (const Point& p : coords) {
+				Cell cell = project(p);
+				if (cells.empty() || cell.x != cells.back().x || cell.y != cells.back().y) {
+					cells.push_back(cell);
+				}
+			}
+			return cells;
+		}
+
+		void write(std::vector<uint32_t>& commands, const Cell& cell) {
+			commands.push_back(zigzag(cell.x - cursor.x));
+			commands.push_back(zigzag(cell.y - cursor.y));
+			cursor = cell;
+		}
+
+		void path(std::vector<uint32_t>& commands, const std::vector<Cell>& cells, size_t size) {
+			commands.push_back(command(MoveTo, 1));
+			write(commands, cells[0]);
+			commands.push_back(command(LineTo, size - 1));
+			for (size_t i = 1; i < size; ++i) {
+				write(commands, cells[i]);
+			}
+		}
+
+		void line(std::vector<uint32_t>& commands, const Coords& coords) {
+			std::vector<Cell> cells = quantize(coords);
+			if (cells.size() < 2) {
+				return;
+			}
+			path(commands, cells, cells.size());
+		}
+
+		/*
+
+		Ring
+		Exterior rings must have positive area in tile space (clockwise on screen),
+		interior rings negative. Rings are reversed when needed.
+		Returns false if the ring collapsed.
+
+		*/
+
+		bool ring(std::vector<uint32_t>& commands, const Coords& coords, bool exterior) {
+			std::vector<Cell> cells = quantize(coords);
+
+			// ClosePath implies the closing vertex
+			if (cells.size() > 1 && cells.front().x == cells.back().x && cells.front().y == cells.back().y) {
+				cells.pop_back();
+			}
+
+			if (cells.size() < 3) {
+				return false;
+			}
+
+			int64_t area = 0;
+			size_t size = cells.size();
+			for (size_t i = 0, j = size - 1; i < size; j = i++) {
+				area += static_cast<int64_t>(cells[j].x) * cells[i].y - static_cast<int64_t>(cells[i].x) * cells[j].y;
+			}
+
+			if (area == 0) {
+				return false;
+			}
+
+			if ((area > 0) != exterior) {
+				std::reverse(cells.begin(), cells.end());
+			}
+
+			path(commands, cells, size);
+			commands.push_back(command(ClosePath, 1));
+			return true;
+		}
+
+		void polygon(std::vector<uint32_t>& commands, const types::Polygon& poly) {
+			if (!ring(commands, poly.outer.coords, true)) {
+				// Holes without an exterior ring are meaningless
+				return;
+			}
+			if (!poly.inner.coords.empty()) {
+				ring(commands, poly.inner.coords, false);
+			}
+		}
+	};
+
+	Geometry encode(const Shape& shape, const BBox& bbox, uint32_t extent = 4096) {
+		Encoder encoder(bbox, extent);
+		return encoder.encode(shape);
+	}
+
+	/*
+
+	Layer
+	Collects features, deduplicates keys and values
+
+	*/
+
+	class Layer {
+	public:
+		std::string name;
+		uint32_t version = 2;
+		size_t size = 0;
+
+		Layer(const std::string& name, const BBox& bbox, uint32_t extent = 4096) : name(name), encoder(bbox, extent) {}
+
+		/*
+
+		Add Feature
+		Returns false if geometry collapsed after quantization
+
+		*/
+
+		bool add(const Shape& shape, const Properties& properties = {}, uint64_t id = 0) {
+			Geometry geometry = encoder.encode(shape);
+			return add(geometry, properties, id);
+		}
+
+		bool add(const Geometry& geometry, const Properties& properties = {}, uint64_t id = 0) {
+			if (geometry.empty()) {
+				return false;
+			}
+
+			std::vector<uint32_t> tags;
+			tags.reserve(properties.size() * 2);
+			for (const auto& [key, value] : properties) {
+				tags.push_back(keyIndex(key));
+				tags.push_back(valueIndex(value));
+			}
+
+			pbf::Writer feature;
+			if (id != 0) {
+				feature.uint(1, id);
+			}
+			feature.packed(2, tags);
+			feature.uint(3, geometry.type);
+			feature.packed(4, geometry.commands);
+
+			features.bytes(2, feature.data);
+			++size;
+			return true;
+		}
+
+		std::string serialize() const {
+			pbf::Writer layer;
+			layer.uint(15, version);
+			layer.bytes(1, name);
+			layer.data.append(features.data);
+			for (const std::string& key : keys) {
+				layer.bytes(3, key);
+			}
+			for (const std::string& value : values) {
+				layer.bytes(4, value);
+			}
+			layer.uint(5, encoder.extent);
+			return layer.data;
+		}
+
+	private:
+		Encoder encoder;
+		pbf::Writer features;
+		std::vector<std::string> keys;
+		std::vector<std::string> values;
+		std::unordered_map<std::string, uint32_t> keysIndex;
+		std::unordered_map<std::string, uint32_t> valuesIndex;
+
+		uint32_t keyIndex(const std::string& key) {
+			auto [it, inserted] = keysIndex.try_emplace(key, keys.size());
+			if (inserted) {
+				keys.push_back(key);
+			}
+			return it->second;
+		}
+
+		// Values are deduplicated by their encoded message
+		uint32_t valueIndex(const Value& value) {
+			pbf::Writer message;
+
+			if (const std::string* str = std::get_if<std::string>(&value)) {
+				message.bytes(1, *str);
+			} else if (const double* num = std::get_if<double>(&value)) {
+				message.fixed64(3, *num);
+			} else if (const int64_t* integer = std::get_if<int64_t>(&value)) {
+				if (*integer < 0) {
+					message.sint(6, *integer);
+				} else {
+					message.uint(5, static_cast<uint64_t>(*integer));
+				}
+			} else if (const bool* flag = std::get_if<bool>(&value)) {
+				message.boolean(7, *flag);
+			}
+
+			auto [it, inserted] = valuesIndex.try_emplace(message.data, values.size());
+			if (inserted) {
+				values.push_back(message.data);
+			}
+			return it->second;
+		}
+	};
+
+	/*
+
+	Tile
+	Layers live in a deque, so a Layer& from layer() stays valid when more layers are added.
+
+	*/
+
+	class Tile {
+	public:
+		BBox bbox;
+		uint32_t extent;
+		std::deque<Layer> layers;
+
+		Tile(const BBox& bbox, uint32_t extent = 4096) : bbox(bbox), extent(extent) {}
+
+		Layer& layer(const std::string& name) {
+			for (Layer& item : layers) {
+				if (item.name == name) {
+					return item;
+				}
+			}
+			return layers.emplace_back(name, bbox, extent);
+		}
+
+		bool empty() const {
+			for (const Layer& item : layers) {
+				if (item.size != 0) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		std::string serialize() const {
+			pbf::Writer tile;
+			for (const Layer& item : layers) {
+				if (item.size != 0) {
+					tile.bytes(3, item.serialize());
+				}
+			}
+			return tile.data;
+		}
+	};
+}
+
+#endif
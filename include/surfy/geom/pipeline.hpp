@@ -0,0 +1,435 @@
+#ifndef SURFY_GEOM_PIPELINE_HPP
+#define SURFY_GEOM_PIPELINE_HPP
+
+/*
+
+Pipeline
+Streaming executor: a source, stages and a sink connected by bounded lock-free queues.
+Every stage has its own worker threads, so parse, clip, simplify and encode overlap,
+and memory stays proportional to the queue depths instead of the size of the dataset.
+
+*/
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "geom.hpp"
+
+namespace surfy::geom::pipeline {
+
+	/*
+
+	Queue
+	Bounded MPMC ring (Vyukov): every cell carries a sequence number telling producers and consumers
+	whose turn it is, so push and pop are one compare-and-swap on the happy path, no locks.
+	With one thread on each side it is a plain SPSC ring.
+	Blocking push and pop spin, then yield, then sleep while the queue is full or empty.
+
+	*/
+
+	template <typename T>
+	class Queue {
+	public:
+
+		// Capacity is rounded up to a power of two
+		Queue(size_t capacity = 1024) {
+			size_t size = 2;
+			while (size < capacity) {
+				size <<= 1;
+			}
+			mask = size - 1;
+			cells = std::make_unique<Cell[]>(size);
+			for (size_t i = 0; i < size; ++i) {
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		Queue(const Queue&) = delete;
+		Queue& operator=(const Queue&) = delete;
+
+		size_t capacity() const {
+			return mask + 1;
+		}
+
+		bool tryPush(T& value) {
+			size_t position = tail.load(std::memory_order_relaxed);
+			while (true) {
+				Cell& cell = cells[position & mask];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+				if (diff == 0) {
+					if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						cell.value = std::move(value);
+						cell.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					return false; // Full
+				} else {
+					position = tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool tryPop(T& value) {
+			size_t position = head.load(std::memory_order_relaxed);
+			while (true) {
+				Cell& cell = cells[position & mask];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+				if (diff == 0) {
+					if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						value = std::move(cell.value);
+						cell.sequence.store(position + mask + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					return false; // Empty
+				} else {
+					position = head.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Blocks while full, returns the number of times it had to wait
+		size_t push(T& value) {
+			size_t waits = 0;
+			while (!tryPush(value)) {
+				backoff(waits++);
+			}
+			return waits;
+		}
+
+		/*
+
+		Pop
+		Blocks while empty, false once the queue is closed and drained.
+		waits is increased for every time it had to wait.
+
+		*/
+
+		bool pop(T& value, size_t& waits) {
+			while (!tryPop(value)) {
+				if (closed.load(std::memory_order_acquire)) {
+					// Producers are done before close, one last look
+					return tryPop(value);
+				}
+				backoff(waits++);
+			}
+			return true;
+		}
+
+		// No more pushes: called once every producer has finished
+		void close() {
+			closed.store(true, std::memory_order_release);
+		}
+
+	private:
+
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		size_t mask;
+		alignas(64) std::atomic<size_t> head{0};
+		alignas(64) std::atomic<size_t> tail{0};
+		alignas(64) std::atomic<bool> closed{false};
+
+		static void backoff(size_t attempt) {
+			if (attempt < 64) {
+				return;
+			}
+			if (attempt < 128) {
+				std::this_thread::yield();
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	};
+
+	/*
+
+	Item
+	One record flowing through the pipeline, sequence is its position in the source.
+	text holds the input line or the encoded output, shape the geometry in between.
+
+	*/
+
+	struct Item {
+		size_t sequence = 0;
+		std::string text;
+		std::unique_ptr<Shape> shape;
+	};
+
+	// Work of a stage, false drops the item
+	using Work = std::function<bool(Item&)>;
+
+	struct Stats {
+		std::string name;
+		size_t workers = 0;
+		size_t items = 0; // Passed on
+		size_t dropped = 0; // Work returned false
+		size_t errors = 0; // Work threw, the item is dropped
+		size_t stalls = 0; // Backoff rounds on an empty input or a full output
+		double busy = 0; // Seconds in work, summed over workers
+		double seconds = 0; // Wall time of the stage
+
+		// Items per second of wall time
+		double throughput() const {
+			return seconds > 0 ? items / seconds : 0;
+		}
+	};
+
+	struct Options {
+		size_t depth = 1024; // Capacity of every queue
+	};
+
+	/*
+
+	Pipeline
+	stage() adds stages in order, run() pulls items from source until it returns false
+	and hands every finished item to sink on one thread. Items reach the sink in completion order,
+	Item::sequence gives the source order back.
+	An exception from source or sink stops the pipeline: the items in flight are drained without work,
+	every thread is joined, then run() rethrows it. Exceptions from stage work only count in Stats::errors.
+
+	*/
+
+	class Pipeline {
+	public:
+		Options options;
+
+		Pipeline(const Options& options = {}) : options(options) {}
+
+		Pipeline& stage(const std::string& name, size_t workers, Work work) {
+			stages.push_back({name, std::max<size_t>(1, workers), std::move(work)});
+			return *this;
+		}
+
+		std::vector<Stats> run(const std::function<bool(Item&)>& source, const std::function<void(Item&)>& sink) {
+			using Clock = std::chrono::steady_clock;
+			auto since = [](Clock::time_point start) {
+				return std::chrono::duration<double>(Clock::now() - start).count();
+			};
+
+			size_t count = stages.size();
+			std::vector<std::unique_ptr<Queue<Item>>> queues;
+			for (size_t i = 0; i <= count; ++i) {
+				queues.push_back(std::make_unique<Queue<Item>>(options.depth));
+			}
+
+			std::vector<Stats> stats(count + 2);
+			stats[0].name = "source";
+			stats[0].workers = 1;
+			for (size_t i = 0; i < count; ++i) {
+				stats[i + 1].name = stages[i].name;
+				stats[i + 1].workers = stages[i].workers;
+			}
+			stats[count + 1].name = "sink";
+			stats[count + 1].workers = 1;
+
+			// Per worker counters, summed into stats when the stage ends
+			std::vector<std::vector<Stats>> local(count);
+			std::vector<std::unique_ptr<std::atomic<size_t>>> running;
+			for (size_t i = 0; i < count; ++i) {
+				local[i].resize(stages[i].workers);
+				running.push_back(std::make_unique<std::atomic<size_t>>(stages[i].workers));
+			}
+
+			// Set when source or sink threw, the rest of the items are drained without work
+			std::atomic<bool> stopping{false};
+			std::exception_ptr sourceFailure;
+			std::exception_ptr sinkFailure;
+
+			Clock::time_point start = Clock::now();
+			std::vector<std::thread> threads;
+
+			threads.emplace_back([&]() {
+				Stats& stat = stats[0];
+				Queue<Item>& output = *queues[0];
+				while (!stopping.load(std::memory_order_relaxed)) {
+					Item item;
+					item.sequence = stat.items;
+					Clock::time_point begin = Clock::now();
+					try {
+						if (!source(item)) {
+							break;
+						}
+					} catch (...) {
+						sourceFailure = std::current_exception();
+						stopping.store(true, std::memory_order_relaxed);
+						break;
+					}
+					stat.busy += since(begin);
+					stat.stalls += output.push(item);
+					++stat.items;
+				}
+				output.close();
+				stat.seconds = since(start);
+			});
+
+			for (size_t s = 0; s < count; ++s) {
+				for (size_t w = 0; w < stages[s].workers; ++w) {
+					threads.emplace_back([&, s, w]() {
+						Stats& stat = local[s][w];
+						Queue<Item>& input = *queues[s];
+						Queue<Item>& output = *queues[s + 1];
+						const Work& work = stages[s].work;
+						Item item;
+
+						while (input.pop(item, stat.stalls)) {
+							if (stopping.load(std::memory_order_relaxed)) {
+								item = Item();
+								continue;
+							}
+
+							Clock::time_point begin = Clock::now();
+							bool keep = false;
+							try {
+								keep = work(item);
+								if (!keep) {
+									++stat.dropped;
+								}
+							} catch (...) {
+								++stat.errors;
+							}
+							stat.busy += since(begin);
+
+							if (keep) {
+								stat.stalls += output.push(item);
+								++stat.items;
+							}
+							item = Item();
+						}
+
+						// Last worker out closes the next queue
+						stat.seconds = since(start);
+						if (running[s]->fetch_sub(1) == 1) {
+							output.close();
+						}
+					});
+				}
+			}
+
+			// Sink on the calling thread
+			{
+				Stats& stat = stats[count + 1];
+				Queue<Item>& input = *queues[count];
+				Item item;
+				while (input.pop(item, stat.stalls)) {
+					if (!stopping.load(std::memory_order_relaxed)) {
+						Clock::time_point begin = Clock::now();
+						try {
+							sink(item);
+							++stat.items;
+						} catch (...) {
+							sinkFailure = std::current_exception();
+							stopping.store(true, std::memory_order_relaxed);
+						}
+						stat.busy += since(begin);
+					}
+					item = Item();
+				}
+				stat.seconds = since(start);
+			}
+
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+
+			if (sourceFailure) {
+				std::rethrow_exception(sourceFailure);
+			}
+			if (sinkFailure) {
+				std::rethrow_exception(sinkFailure);
+			}
+
+			for (size_t s = 0; s < count; ++s) {
+				Stats& stat = stats[s + 1];
+				for (const Stats& worker : local[s]) {
+					stat.items += worker.items;
+					stat.dropped += worker.dropped;
+					stat.errors += worker.errors;
+					stat.stalls += worker.stalls;
+					stat.busy += worker.busy;
+					stat.seconds = std::max(stat.seconds, worker.seconds);
+				}
+			}
+
+			return stats;
+		}
+
+	private:
+
+		struct Stage {
+			std::string name;
+			size_t workers;
+			Work work;
+		};
+
+		std::vector<Stage> stages;
+	};
+
+	/*
+
+	Stages
+	Work for the usual WKT ETL: parse lines, clip, simplify, encode back to WKT.
+
+	*/
+
+	// text -> shape, empty lines and unparsed geometry are dropped
+	Work parse() {
+		return [](Item& item) {
+			if (item.text.empty()) {
+				return false;
+			}
+			item.shape = std::make_unique<Shape>(item.text);
+			item.shape->source.clear();
+			item.text.clear();
+			return !item.shape->empty;
+		};
+	}
+
+	// Shapes clipped away are dropped
+	Work clip(const BBox& bbox, double buffer = 0.) {
+		return [bbox, buffer](Item& item) {
+			item.shape->clip(bbox, buffer);
+			return !item.shape->empty;
+		};
+	}
+
+	Work simplify(double tolerance) {
+		return [tolerance](Item& item) {
+			item.shape->simplify(tolerance);
+			return true;
+		};
+	}
+
+	// shape -> WKT in text, the Shape is released
+	Work encode() {
+		return [](Item& item) {
+			std::ostringstream os;
+			os.precision(17);
+			os << *item.shape;
+			item.text = os.str();
+			item.shape.reset();
+			return true;
+		};
+	}
+
+	// Source reading one item per line of input
+	std::function<bool(Item&)> lines(std::istream& input) {
+		return [&input](Item& item) {
+			return static_cast<bool>(std::getline(input, item.text));
+		};
+	}
+}
+
+#endif
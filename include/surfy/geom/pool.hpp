@@ -0,0 +1,282 @@
+#ifndef SURFY_GEOM_POOL_HPP
+#define SURFY_GEOM_POOL_HPP
+
+/*
+
+Pool
+Work-stealing thread pool.
+Every worker owns a deque: it pops its own tasks LIFO and steals from the others FIFO.
+Tasks submitted from a worker go to its own deque, so nested work stays cache-local.
+An exception thrown by a task is kept and rethrown from wait(), it never escapes a worker thread.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace surfy::geom::pool {
+
+	using Task = std::function<void()>;
+
+	// Tasks that can be waited on apart from the rest of the pool, with the first exception one of them threw
+	struct Group {
+		std::atomic<size_t> remaining{0};
+		std::atomic<bool> failed{false};
+		std::exception_ptr error;
+		std::mutex mutex;
+	};
+
+	class Pool {
+	public:
+
+		Pool(size_t threads = 0) {
+			if (threads == 0) {
+				threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+			}
+
+			for (size_t i = 0; i < threads; ++i) {
+				queues.push_back(std::make_unique<Queue>());
+			}
+
+			for (size_t i = 0; i < threads; ++i) {
+				workers.emplace_back([this, i]() { run(i); });
+			}
+		}
+
+		~Pool() {
+			wait();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			available.notify_all();
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+		}
+
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		size_t size() const {
+			return workers.size();
+		}
+
+		void submit(Task task) {
+			size_t index = (current.pool == this) ? current.index : next++ % queues.size();
+
+			pending.fetch_add(1);
+			{
+				Queue& queue = *queues[index];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.tasks.push_back(std::move(task));
+			}
+			queued.fetch_add(1);
+
+			{
+				// Pairs with the predicate check in run() so the wake-up can't be lost
+				std::lock_guard<std::mutex> lock(mutex);
+			}
+			available.notify_one();
+		}
+
+		/*
+
+		Wait
+		Blocks until every submitted task has finished, the calling thread helps by stealing tasks.
+		Then rethrows the first exception a task outside any group threw.
+		Must not be called from inside a task of the same pool.
+
+		*/
+
+		void wait() {
+			Task task;
+			while (pending.load() != 0) {
+				if (steal(current.pool == this ? current.index : queues.size(), task)) {
+					execute(task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [this]() { return pending.load() == 0 || queued.load() != 0; });
+			}
+
+			std::exception_ptr error;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				error.swap(failure);
+			}
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+
+		// Once a task of group throws, the group's tasks that haven't started are skipped
+		void submit(Group& group, Task task) {
+			group.remaining.fetch_add(1);
+			submit([this, &group, task = std::move(task)]() {
+				if (!group.failed.load()) {
+					try {
+						task();
+					} catch (...) {
+						std::lock_guard<std::mutex> lock(group.mutex);
+						if (!group.error) {
+							group.error = std::current_exception();
+						}
+						group.failed.store(true);
+					}
+				}
+				if (group.remaining.fetch_sub(1) == 1) {
+					std::lock_guard<std::mutex> lock(mutex);
+					done.notify_all();
+				}
+			});
+		}
+
+		/*
+
+		Wait for a group
+		Blocks until the tasks of group have finished, helping with any task meanwhile,
+		then rethrows the first exception they threw and clears it, so the group can be reused.
+		Safe from inside a task, so a shared pool can be used by nested and concurrent callers.
+
+		*/
+
+		void wait(Group& group) {
+			Task task;
+			while (group.remaining.load() != 0) {
+				if (steal(current.pool == this ? current.index : queues.size(), task)) {
+					execute(task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [this, &group]() { return group.remaining.load() == 0 || queued.load() != 0; });
+			}
+
+			if (group.failed.load()) {
+				std::exception_ptr error;
+				{
+					std::lock_guard<std::mutex> lock(group.mutex);
+					error.swap(group.error);
+				}
+				group.failed.store(false);
+				std::rethrow_exception(error);
+			}
+		}
+
+	private:
+
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		struct Current {
+			Pool* pool;
+			size_t index;
+		};
+
+		static inline thread_local Current current = {nullptr, 0};
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<size_t> pending{0};
+		std::atomic<size_t> queued{0};
+		std::atomic<size_t> next{0};
+		std::mutex mutex;
+		std::condition_variable available;
+		std::condition_variable done;
+		bool stopping = false;
+		std::exception_ptr failure; // First exception of a task outside any group, under mutex
+
+		bool pop(size_t index, Task& task) {
+			Queue& queue = *queues[index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) {
+				return false;
+			}
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			queued.fetch_sub(1);
+			return true;
+		}
+
+		// Own deque first (index >= size means the caller has none), then the others round robin
+		bool steal(size_t index, Task& task) {
+			size_t count = queues.size();
+			if (index < count && pop(index, task)) {
+				return true;
+			}
+
+			size_t start = (index < count) ? index + 1 : next.load();
+			for (size_t i = 0; i < count; ++i) {
+				size_t victim = (start + i) % count;
+				if (victim == index) {
+					continue;
+				}
+
+				Queue& queue = *queues[victim];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (!queue.tasks.empty()) {
+					task = std::move(queue.tasks.front());
+					queue.tasks.pop_front();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void execute(Task& task) {
+			try {
+				task();
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!failure) {
+					failure = std::current_exception();
+				}
+			}
+			task = nullptr;
+			if (pending.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> lock(mutex);
+				done.notify_all();
+			}
+		}
+
+		void run(size_t index) {
+			current = {this, index};
+			Task task;
+
+			while (true) {
+				if (steal(index, task)) {
+					execute(task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(mutex);
+				available.wait(lock, [this]() { return stopping || queued.load() != 0; });
+				if (stopping && queued.load() == 0) {
+					return;
+				}
+			}
+		}
+	};
+
+	// Pool of the library, one worker per core, started on first use
+	Pool& shared() {
+		static Pool pool;
+		return pool;
+	}
+}
+
+#endif
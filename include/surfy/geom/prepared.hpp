@@ -0,0 +1,167 @@
+#ifndef SURFY_GEOM_PREPARED_HPP
+#define SURFY_GEOM_PREPARED_HPP
+
+/*
+
+Prepared Polygon
+Polygon or MultiPolygon indexed once for many point-in-polygon tests.
+The bbox is cut into horizontal bands, every band keeps the edges crossing it,
+so a query only casts its ray against the few edges of one band.
+
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include "geom.hpp"
+
+namespace surfy::geom {
+
+	class PreparedPolygon {
+	public:
+		BBox bbox = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+
+		// Empty, contains nothing
+		PreparedPolygon() = default;
+
+		/*
+
+		Build
+		Every ring of every polygon goes in, holes included: the even-odd rule takes care of them.
+		bands = 0 picks one band per edge. Fewer bands are used when tall edges
+		would be copied into too many of them, e.g. the teeth of a comb.
+
+		*/
+
+		PreparedPolygon(const Shape& shape, size_t bands = 0) {
+			std::vector<Edge> all;
+
+			if (shape.type == "Polygon") {
+				add(shape.geom.polygon, all);
+			} else if (shape.type == "MultiPolygon") {
+				for (const types::Polygon& poly : shape.geom.multiPolygon.items) {
+					add(poly, all);
+				}
+			}
+
+			if (all.empty()) {
+				return;
+			}
+
+			if (bands == 0) {
+				bands = all.size();
+			}
+			bands = std::clamp<size_t>(bands, 1, 1 << 20);
+
+			// Tall edges sit in every band they cross: halve the bands until the copies stay within a few per edge
+			double height = bbox[3] - bbox[1];
+			size_t budget = 8 * all.size() + bands;
+			while (true) {
+				scale = height > 0 ? bands / height : 0;
+				offsets.assign(bands + 1, 0);
+				size_t total = 0;
+				for (const Edge& edge : all) {
+					total += band(edge.top) - band(edge.bottom) + 1;
+				}
+				if (total <= budget || bands == 1) {
+					break;
+				}
+				bands /= 2;
+			}
+
+			// Count, then fill, so every band is a contiguous run of edges
+			for (const Edge& edge : all) {
+				size_t last = band(edge.top);
+				for (size_t b = band(edge.bottom); b <= last; ++b) {
+					++offsets[b + 1];
+				}
+			}
+
+			for (size_t b = 0; b < bands; ++b) {
+				offsets[b + 1] += offsets[b];
+			}
+
+			edges.resize(offsets[bands]);
+			std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+			for (const Edge& edge : all) {
+				size_t last = band(edge.top);
+				for (size_t b = band(edge.bottom); b <= last; ++b) {
+					edges[fill[b]++] = edge;
+				}
+			}
+		}
+
+		/*
+
+		Contains
+		Same crossing rule as utils::inside: points on a right or lower edge may count as inside.
+		Unlike utils::inside, a point on a vertex is not inside by itself, it follows the crossing rule too.
+
+		*/
+
+		bool contains(const Point& point) const {
+			if (point.x < bbox[0] || point.x > bbox[2] || point.y < bbox[1] || point.y > bbox[3] || edges.empty()) {
+				return false;
+			}
+
+			size_t b = band(point.y);
+			bool inside = false;
+			for (size_t i = offsets[b], end = offsets[b + 1]; i < end; ++i) {
+				const Edge& edge = edges[i];
+				if ((edge.y1 > point.y) != (edge.y2 > point.y) && point.x <= edge.x1 + (point.y - edge.y1) * edge.slope) {
+					inside = !inside;
+				}
+			}
+
+			return inside;
+		}
+
+		bool empty() const {
+			return edges.empty();
+		}
+
+	private:
+
+		struct Edge {
+			double x1, y1, y2;
+			double slope; // dx / dy
+			double bottom, top;
+		};
+
+		double scale = 0;
+		std::vector<size_t> offsets; // Band b holds edges [offsets[b], offsets[b + 1])
+		std::vector<Edge> edges;
+
+		size_t band(const double& y) const {
+			double pos = (y - bbox[1]) * scale;
+			size_t last = offsets.size() - 2;
+			return pos <= 0 ? 0 : std::min(static_cast<size_t>(pos), last);
+		}
+
+		void add(const types::Polygon& poly, std::vector<Edge>& all) {
+			add(poly.outer.coords, all);
+			add(poly.inner.coords, all);
+		}
+
+		// Ring, closing edge included; horizontal edges never cross a ray and are left out
+		void add(const Coords& ring, std::vector<Edge>& all) {
+			size_t size = ring.size();
+			for (size_t i = 0, j = size - 1; i < size; j = i++) {
+				const Point& a = ring[i];
+				const Point& b = ring[j];
+
+				bbox[0] = std::min(bbox[0], a.x);
+				bbox[1] = std::min(bbox[1], a.y);
+				bbox[2] = std::max(bbox[2], a.x);
+				bbox[3] = std::max(bbox[3], a.y);
+
+				if (a.y == b.y) {
+					continue;
+				}
+
+				all.push_back({a.x, a.y, b.y, (b.x - a.x) / (b.y - a.y), std::min(a.y, b.y), std::max(a.y, b.y)});
+			}
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef SURFY_GEOM_QUADTREE_HPP
+#define SURFY_GEOM_QUADTREE_HPP
+
+/*
+
+Quadtree
+Divide and conquer clipping for huge polygons.
+The Shape is split into quadrants with the rectangle clipper, recursively and in parallel,
+until pieces fall under a vertex threshold. A box is then clipped from the smallest piece
+that contains it, so clipping a continent to thousands of tiles touches a few thousand vertices
+per tile instead of millions, and the tiles can run on every core.
+
+*/
+
+#include <array>
+#include <functional>
+#include <memory>
+#include "geom.hpp"
+#include "pool.hpp"
+
+namespace surfy::geom::clippers {
+
+	class Quadtree {
+	public:
+		size_t threshold; // Pieces with more vertices are split
+		double margin; // Quadrants overlap by this much, set to the clip buffer so buffered boxes still fit in one
+
+		// Splits run on workers, the library pool by default
+		Quadtree(const Shape& shape, size_t threshold = 4096, double margin = 0, pool::Pool& workers = pool::shared()) : threshold(std::max<size_t>(threshold, 16)), margin(margin) {
+			root = std::make_unique<Node>(shape.bbox, shape);
+			root->shape.source.clear(); // Pieces don't carry the source WKT
+			if (shape.empty) {
+				return;
+			}
+
+			pool::Group group;
+			std::function<void(Node*, uint32_t)> process;
+			process = [&](Node* node, uint32_t depth) {
+				split(*node);
+				for (std::unique_ptr<Node>& child : node->children) {
+					if (child && splittable(*child, *node, depth + 1)) {
+						Node* next = child.get();
+						workers.submit(group, [&process, next, depth]() {
+							process(next, depth + 1);
+						});
+					}
+				}
+			};
+
+			if (splittable(*root, *root, 0)) {
+				workers.submit(group, [&process, this]() {
+					process(root.get(), 0);
+				});
+			}
+			workers.wait(group);
+		}
+
+		/*
+
+		Clip
+		Shape clipped to box, from the smallest piece whose box contains it.
+		Const and thread-safe.
+
+		*/
+
+		Shape clip(const BBox& box) const {
+			const Node* node = root.get();
+			while (node->split) {
+				const Node* next = nullptr;
+				bool covered = false;
+
+				for (size_t i = 0; i < 4; ++i) {
+					if (contains(quadrant(node->box, i), box)) {
+						covered = true;
+						next = node->children[i].get();
+						break;
+					}
+				}
+
+				if (!covered) {
+					break;
+				}
+
+				if (next == nullptr) {
+					// The quadrant holding the box is empty
+					return Shape();
+				}
+				node = next;
+			}
+
+			Shape result(node->shape);
+			result.clip(box);
+			return result;
+		}
+
+		/*
+
+		Clip many boxes in parallel
+		emit(index, shape) is called from worker threads and must be thread-safe.
+
+		*/
+
+		void clip(const std::vector<BBox>& boxes, const std::function<void(size_t, Shape&)>& emit, pool::Pool& workers = pool::shared()) const {
+			pool::Group group;
+			for (size_t i = 0; i < boxes.size(); ++i) {
+				workers.submit(group, [this, &boxes, &emit, i]() {
+					Shape shape = clip(boxes[i]);
+					emit(i, shape);
+				});
+			}
+			workers.wait(group);
+		}
+
+		// Pieces in the tree, root included
+		size_t size() const {
+			size_t count = 0;
+			std::vector<const Node*> stack = {root.get()};
+			while (!stack.empty()) {
+				const Node* node = stack.back();
+				stack.pop_back();
+				++count;
+				for (const std::unique_ptr<Node>& child : node->children) {
+					if (child) {
+						stack.push_back(child.get());
+					}
+				}
+			}
+			return count;
+		}
+
+	private:
+		static constexpr uint32_t MAX_DEPTH = 24;
+
+		struct Node {
+			BBox box;
+			Shape shape; // Source clipped to box
+			bool split = false;
+			std::array<std::unique_ptr<Node>, 4> children = {}; // Quadrants: SW, SE, NW, NE, null when empty
+
+			Node(const BBox& box, const Shape& shape) : box(box), shape(shape) {}
+		};
+
+		std::unique_ptr<Node> root;
+
+		// Quadrant i of box, grown by margin and kept inside the parent
+		BBox quadrant(const BBox& box, size_t i) const {
+			double cx = (box[0] + box[2]) / 2;
+			double cy = (box[1] + box[3]) / 2;
+			BBox q = {
+				(i & 1) ? cx - margin : box[0],
+				(i & 2) ? cy - margin : box[1],
+				(i & 1) ? box[2] : cx + margin,
+				(i & 2) ? box[3] : cy + margin
+			};
+			return {std::max(q[0], box[0]), std::max(q[1], box[1]), std::min(q[2], box[2]), std::min(q[3], box[3])};
+		}
+
+		static bool contains(const BBox& outer, const BBox& inner) {
+			return inner[0] >= outer[0] && inner[1] >= outer[1] && inner[2] <= outer[2] && inner[3] <= outer[3];
+		}
+
+		// Big enough to split, and the last split actually made it smaller
+		bool splittable(const Node& node, const Node& parent, uint32_t depth) const {
+			if (node.shape.vertices <= threshold || depth >= MAX_DEPTH) {
+				return false;
+			}
+			return &node == &parent || node.shape.vertices < parent.shape.vertices;
+		}
+
+		void split(Node& node) {
+			node.split = true;
+			for (size_t i = 0; i < 4; ++i) {
+				BBox box = quadrant(node.box, i);
+				auto child = std::make_unique<Node>(box, node.shape);
+				child->shape.clip(box);
+				if (!child->shape.empty) {
+					node.children[i] = std::move(child);
+				}
+			}
+		}
+	};
+}
+
+#endif
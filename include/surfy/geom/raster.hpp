@@ -0,0 +1,304 @@
+#ifndef SURFY_GEOM_RASTER_HPP
+#define SURFY_GEOM_RASTER_HPP
+
+/*
+
+Raster
+Scanline polygon rasterizer into caller-provided 8-bit or float buffers.
+Edges go into an edge table sorted by top, rows are walked with an active edge table.
+Scratch memory lives in the Rasterizer and is reused, so drawing many polygons allocates nothing
+once it has grown to the largest one.
+
+*/
+
+#include <cstdint>
+#include <span>
+#include "geom.hpp"
+
+namespace surfy::geom::raster {
+
+	enum Rule {
+		EvenOdd,
+		NonZero
+	};
+
+	struct Options {
+		Rule rule = NonZero;
+		uint32_t samples = 0; // Anti-aliasing: sub-scanlines per row with exact horizontal coverage, 0 = pixel centres only
+		double value = 1.; // Added per fully covered pixel: float buffers add value, 8-bit ones value * 255, saturating
+	};
+
+	class Rasterizer {
+	public:
+		BBox bbox;
+		uint32_t width;
+		uint32_t height;
+		Options options;
+
+		/*
+
+		Raster
+		bbox is mapped onto width x height pixels, row-major, row 0 at the top (maxY).
+
+		*/
+
+		Rasterizer(const BBox& bbox, uint32_t width, uint32_t height, const Options& options = {}) : bbox(bbox), width(width), height(height), options(options) {
+			sx = (bbox[2] > bbox[0]) ? width / (bbox[2] - bbox[0]) : 0;
+			sy = (bbox[3] > bbox[1]) ? height / (bbox[3] - bbox[1]) : 0;
+		}
+
+		// False when the Shape isn't a Polygon or MultiPolygon, or the buffer holds fewer than width x height pixels
+		bool draw(const Shape& shape, std::span<uint8_t> buffer) {
+			return load(shape) && render(buffer);
+		}
+
+		bool draw(const Shape& shape, std::span<float> buffer) {
+			return load(shape) && render(buffer);
+		}
+
+		bool draw(const types::Polygon& poly, std::span<uint8_t> buffer) {
+			edges.clear();
+			add(poly);
+			return render(buffer);
+		}
+
+		bool draw(const types::Polygon& poly, std::span<float> buffer) {
+			edges.clear();
+			add(poly);
+			return render(buffer);
+		}
+
+		// All items in one pass, so overlapping items are filled once under NonZero
+		bool draw(const types::MultiPolygon& multi, std::span<uint8_t> buffer) {
+			edges.clear();
+			for (const types::Polygon& poly : multi.items) {
+				add(poly);
+			}
+			return render(buffer);
+		}
+
+		bool draw(const types::MultiPolygon& multi, std::span<float> buffer) {
+			edges.clear();
+			for (const types::Polygon& poly : multi.items) {
+				add(poly);
+			}
+			return render(buffer);
+		}
+
+	private:
+
+		// Edge in pixel space, top < bottom, dir is +1 downward in the source ring
+		struct Edge {
+			double top, bottom;
+			double x; // At top
+			double slope; // dx / dy
+			int dir;
+		};
+
+		struct Crossing {
+			double x;
+			int dir;
+		};
+
+		double sx, sy;
+
+		// Scratch, reused between draws
+		std::vector<Edge> edges;
+		std::vector<uint32_t> active;
+		std::vector<Crossing> crossings;
+		std::vector<float> area; // Partial pixel coverage of the current row
+		std::vector<float> cover; // Coverage deltas, prefix-summed along the row
+
+		bool load(const Shape& shape) {
+			edges.clear();
+			if (shape.type == "Polygon") {
+				add(shape.geom.polygon);
+			} else if (shape.type == "MultiPolygon") {
+				for (const types::Polygon& poly : shape.geom.multiPolygon.items) {
+					add(poly);
+				}
+			} else {
+				return false;
+			}
+			return true;
+		}
+
+		void add(const types::Polygon& poly) {
+			add(poly.outer.coords);
+			add(poly.inner.coords);
+		}
+
+		void add(const Coords& ring) {
+			size_t size = ring.size();
+			for (size_t i = 0, j = size - 1; i < size; j = i++) {
+				double x1 = (ring[j].x - bbox[0]) * sx;
+				double y1 = (bbox[3] - ring[j].y) * sy;
+				double x2 = (ring[i].x - bbox[0]) * sx;
+				double y2 = (bbox[3] - ring[i].y) * sy;
+
+				if (y1 == y2) {
+					continue;
+				}
+
+				if (y1 < y2) {
+					edges.push_back({y1, y2, x1, (x2 - x1) / (y2 - y1), 1});
+				} else {
+					edges.push_back({y2, y1, x2, (x1 - x2) / (y1 - y2), -1});
+				}
+			}
+		}
+
+		/*
+
+		Spans
+		Crossings of the scanline y, sorted, turned into filled spans by the fill rule.
+		span(from, to) is called for every filled interval.
+
+		*/
+
+		template <typename Span>
+		void spans(double y, Span&& span) {
+			crossings.clear();
+			for (uint32_t index : active) {
+				const Edge& edge = edges[index];
+				if (edge.top <= y && y < edge.bottom) {
+					crossings.push_back({edge.x + (y - edge.top) * edge.slope, edge.dir});
+				}
+			}
+
+			std::sort(crossings.begin(), crossings.end(), [](const Crossing& a, const Crossing& b) {
+				return a.x < b.x;
+			});
+
+			int winding = 0;
+			for (size_t i = 0; i + 1 < crossings.size(); ++i) {
+				winding += (options.rule == NonZero) ? crossings[i].dir : 1;
+				bool filled = (options.rule == NonZero) ? winding != 0 : (winding & 1) != 0;
+				if (filled && crossings[i + 1].x > crossings[i].x) {
+					span(crossings[i].x, crossings[i + 1].x);
+				}
+			}
+		}
+
+		static void put(uint8_t& pixel, const double& amount) {
+			int value = pixel + static_cast<int>(amount * 255. + .5);
+			pixel = static_cast<uint8_t>(std::min(value, 255));
+		}
+
+		static void put(float& pixel, const double& amount) {
+			pixel += static_cast<float>(amount);
+		}
+
+		// False only when the buffer is too small, nothing to draw is fine
+		template <typename T>
+		bool render(std::span<T> buffer) {
+			if (buffer.size() < static_cast<size_t>(width) * height) {
+				return false;
+			}
+
+			if (edges.empty() || width == 0 || height == 0) {
+				return true;
+			}
+
+			std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+				return a.top < b.top;
+			});
+
+			double bottom = .0;
+			for (const Edge& edge : edges) {
+				bottom = std::max(bottom, edge.bottom);
+			}
+
+			int64_t firstRow = std::max<int64_t>(0, static_cast<int64_t>(std::floor(edges.front().top)));
+			int64_t lastRow = std::min<int64_t>(height - 1, static_cast<int64_t>(std::ceil(bottom)));
+
+			active.clear();
+			size_t next = 0;
+			uint32_t samples = options.samples;
+
+			if (samples != 0) {
+				area.assign(width + 2, 0);
+				cover.assign(width + 2, 0);
+			}
+
+			for (int64_t row = firstRow; row <= lastRow; ++row) {
+				double rowTop = static_cast<double>(row);
+				double rowBottom = rowTop + 1;
+
+				while (next < edges.size() && edges[next].top < rowBottom) {
+					active.push_back(static_cast<uint32_t>(next++));
+				}
+				active.erase(std::remove_if(active.begin(), active.end(), [this, rowTop](uint32_t index) {
+					return edges[index].bottom <= rowTop;
+				}), active.end());
+
+				if (active.empty()) {
+					continue;
+				}
+
+				T* pixels = buffer.data() + static_cast<size_t>(row) * width;
+
+				if (samples == 0) {
+					// Pixels whose centre is inside
+					spans(rowTop + .5, [&](double from, double to) {
+						int64_t first = std::max<int64_t>(0, static_cast<int64_t>(std::ceil(from - .5)));
+						int64_t last = std::min<int64_t>(width, static_cast<int64_t>(std::ceil(to - .5)));
+						for (int64_t x = first; x < last; ++x) {
+							put(pixels[x], options.value);
+						}
+					});
+					continue;
+				}
+
+				// Every sub-scanline adds its exact horizontal coverage, weighted 1 / samples
+				float weight = static_cast<float>(options.value / samples);
+				int64_t minX = width;
+				int64_t maxX = -1;
+
+				for (uint32_t s = 0; s < samples; ++s) {
+					spans(rowTop + (s + .5) / samples, [&](double from, double to) {
+						from = std::clamp(from, .0, static_cast<double>(width));
+						to = std::clamp(to, .0, static_cast<double>(width));
+						if (to <= from) {
+							return;
+						}
+
+						int64_t first = static_cast<int64_t>(from);
+						int64_t last = static_cast<int64_t>(to);
+						minX = std::min(minX, first);
+						maxX = std::max(maxX, std::min<int64_t>(last, width - 1));
+
+						if (first == last) {
+							area[first] += static_cast<float>(to - from) * weight;
+							return;
+						}
+
+						area[first] += static_cast<float>(first + 1 - from) * weight;
+						area[last] += static_cast<float>(to - last) * weight;
+						cover[first + 1] += weight;
+						cover[last] -= weight;
+					});
+				}
+
+				float running = 0;
+				for (int64_t x = minX; x <= maxX; ++x) {
+					running += cover[x];
+					double amount = area[x] + running;
+					if (amount > 1e-6) {
+						put(pixels[x], std::min(amount, options.value));
+					}
+					area[x] = 0;
+					cover[x] = 0;
+				}
+				if (maxX >= 0) {
+					area[maxX + 1] = 0;
+					cover[maxX + 1] = 0;
+				}
+			}
+
+			return true;
+		}
+	};
+}
+
+#endif
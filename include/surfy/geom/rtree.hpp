@@ -0,0 +1,682 @@
+#ifndef SURFY_GEOM_RTREE_HPP
+#define SURFY_GEOM_RTREE_HPP
+
+/*
+
+RTree
+Dynamic R*-tree over bounding boxes with insert, remove, update and window query.
+Beckmann et al. 1990: overlap-aware ChooseSubtree, forced reinsert, margin-driven split.
+
+Nodes come from a slab pool. Concurrent readers work on published snapshots:
+writes copy the nodes they touch if a snapshot can see them (path copying),
+publish() swaps the root atomically, and replaced nodes go back to the pool
+only after every snapshot that could reach them is released (epoch-based reclamation).
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include "geom.hpp"
+#include "index.hpp"
+
+namespace surfy::geom::index {
+
+	namespace rtree {
+
+		constexpr uint32_t MAX = 16;
+		constexpr uint32_t MIN = 6; // ~40% of MAX as recommended for R*
+		constexpr uint32_t REINSERT = 5; // ~30% of MAX
+
+		struct Node;
+
+		struct Entry {
+			BBox box;
+			Node* child = nullptr; // Inner nodes
+			uint64_t id = 0; // Leaves
+		};
+
+		struct Node {
+			uint32_t level = 0; // 0 = leaf
+			uint32_t count = 0;
+			uint64_t epoch = 0; // Writer epoch the node was created in
+			std::array<Entry, MAX + 1> entries; // One extra slot for overflow
+
+			BBox bounds() const {
+				BBox box = entries[0].box;
+				for (uint32_t i = 1; i < count; ++i) {
+					extend(box, entries[i].box);
+				}
+				return box;
+			}
+
+			static void extend(BBox& box, const BBox& other) {
+				box[0] = std::min(box[0], other[0]);
+				box[1] = std::min(box[1], other[1]);
+				box[2] = std::max(box[2], other[2]);
+				box[3] = std::max(box[3], other[3]);
+			}
+		};
+
+		double area(const BBox& b) {
+			return (b[2] - b[0]) * (b[3] - b[1]);
+		}
+
+		double margin(const BBox& b) {
+			return (b[2] - b[0]) + (b[3] - b[1]);
+		}
+
+		double overlap(const BBox& a, const BBox& b) {
+			double width = std::min(a[2], b[2]) - std::max(a[0], b[0]);
+			double height = std::min(a[3], b[3]) - std::max(a[1], b[1]);
+			return (width > 0 && height > 0) ? width * height : .0;
+		}
+
+		BBox merge(const BBox& a, const BBox& b) {
+			BBox box = a;
+			Node::extend(box, b);
+			return box;
+		}
+
+		bool contains(const BBox& a, const BBox& b) {
+			return a[0] <= b[0] && a[1] <= b[1] && a[2] >= b[2] && a[3] >= b[3];
+		}
+
+		/*
+
+		Pool
+		Slab allocator, nodes are recycled through a free list.
+		Locked only when nodes are taken or returned, never by readers.
+
+		*/
+
+		class Pool {
+		public:
+			Node* allocate() {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (available.empty()) {
+					slabs.push_back(std::make_unique<Node[]>(SLAB));
+					Node* slab = slabs.back().get();
+					for (size_t i = SLAB; i > 0; --i) {
+						available.push_back(&slab[i - 1]);
+					}
+				}
+				Node* node = available.back();
+				available.pop_back();
+				return node;
+			}
+
+			void release(Node* node) {
+				std::lock_guard<std::mutex> lock(mutex);
+				available.push_back(node);
+			}
+
+			void release(const std::vector<Node*>& nodes) {
+				std::lock_guard<std::mutex> lock(mutex);
+				available.insert(available.end(), nodes.begin(), nodes.end());
+			}
+
+		private:
+			static constexpr size_t SLAB = 256;
+			std::mutex mutex;
+			std::vector<std::unique_ptr<Node[]>> slabs;
+			std::vector<Node*> available;
+		};
+
+		/*
+
+		Epoch
+		Published root. Holds the newer epoch alive, so nodes retired after this one
+		was published stay valid while any older snapshot is in use.
+
+		*/
+
+		struct Epoch {
+			Node* root = nullptr;
+			size_t size = 0;
+			std::shared_ptr<Pool> pool;
+			std::shared_ptr<Epoch> next;
+			std::vector<Node*> retired; // Reachable from this root but not from next
+
+			~Epoch() {
+				// Unlink iteratively, a long chain of released epochs must not recurse
+				std::shared_ptr<Epoch> epoch = std::move(next);
+				pool->release(retired);
+				while (epoch && epoch.use_count() == 1) {
+					epoch->pool->release(epoch->retired);
+					epoch->retired.clear();
+					epoch = std::move(epoch->next);
+				}
+			}
+		};
+
+		template <typename Visitor>
+		bool search(const Node* node, const BBox& query, Visitor& visit) {
+			for (uint32_t i = 0; i < node->count; ++i) {
+				const Entry& entry = node->entries[i];
+				if (!intersects(query, entry.box)) {
+					continue;
+				}
+
+				if (node->level == 0) {
+					if constexpr (std::is_same_v<std::invoke_result_t<Visitor, uint64_t>, bool>) {
+						if (!visit(entry.id)) {
+							return false;
+						}
+					} else {
+						visit(entry.id);
+					}
+				} else if (!search(entry.child, query, visit)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	/*
+
+	Snapshot
+	Immutable view of the tree at publish(), safe to query from any thread without locks
+
+	*/
+
+	class Snapshot {
+	public:
+		Snapshot(std::shared_ptr<const rtree::Epoch> epoch) : epoch(std::move(epoch)) {}
+
+		size_t size() const {
+			return epoch->size;
+		}
+
+		template <typename Visitor>
+		void search(const BBox& query, Visitor&& visit) const {
+			if (epoch->root != nullptr) {
+				rtree::search(epoch->root, query, visit);
+			}
+		}
+
+		std::vector<uint64_t> search(const BBox& query) const {
+			std::vector<uint64_t> result;
+			search(query, [&result](uint64_t id) {
+				result.push_back(id);
+			});
+			return result;
+		}
+
+	private:
+		std::shared_ptr<const rtree::Epoch> epoch;
+	};
+
+	/*
+
+	Dynamic
+	Items are keyed by id. Writes are serialized internally.
+	search() on the tree itself reads the working copy and must not race with writes,
+	concurrent readers use snapshot() which sees the last publish().
+
+	*/
+
+	class Dynamic {
+	public:
+
+		Dynamic() : pool(std::make_shared<rtree::Pool>()) {
+			head = std::make_shared<rtree::Epoch>();
+			head->pool = pool;
+			current.store(head);
+		}
+
+		Dynamic(const Dynamic&) = delete;
+		Dynamic& operator=(const Dynamic&) = delete;
+
+		size_t size() const {
+			return items.size();
+		}
+
+		void insert(uint64_t id, const BBox& box) {
+			std::lock_guard<std::mutex> lock(writer);
+			if (items.count(id) != 0) {
+				erase(id);
+			}
+			items[id] = box;
+			rtree::Entry entry;
+			entry.box = box;
+			entry.id = id;
+			place(entry, 0);
+		}
+
+		void insert(uint64_t id, const Shape& shape) {
+			insert(id, shape.bbox);
+		}
+
+		bool remove(uint64_t id) {
+			std::lock_guard<std::mutex> lock(writer);
+			return erase(id);
+		}
+
+		// Moves an item, inserts it if missing
+		void update(uint64_t id, const BBox& box) {
+			insert(id, box);
+		}
+
+		void update(uint64_t id, const Shape& shape) {
+			insert(id, shape.bbox);
+		}
+
+		template <typename Visitor>
+		void search(const BBox& query, Visitor&& visit) const {
+			if (root != nullptr) {
+				rtree::search(root, query, visit);
+			}
+		}
+
+		std::vector<uint64_t> search(const BBox& query) const {
+			std::vector<uint64_t> result;
+			search(query, [&result](uint64_t id) {
+				result.push_back(id);
+			});
+			return result;
+		}
+
+		/*
+
+		Publish
+		Makes all writes so far visible to new snapshots.
+		Nodes are frozen, the next write to any of them copies it first.
+
+		*/
+
+		void publish() {
+			std::lock_guard<std::mutex> lock(writer);
+			auto epoch = std::make_shared<rtree::Epoch>();
+			epoch->root = root;
+			epoch->size = items.size();
+			epoch->pool = pool;
+
+			head->retired = std::move(retired);
+			retired.clear();
+			head->next = epoch;
+			head = epoch;
+			current.store(epoch);
+			++version;
+		}
+
+		Snapshot snapshot() const {
+			return Snapshot(current.load());
+		}
+
+	private:
+		std::shared_ptr<rtree::Pool> pool;
+		std::shared_ptr<rtree::Epoch> head; // Latest published epoch, owned by the writer
+		std::atomic<std::shared_ptr<rtree::Epoch>> current;
+		std::mutex writer;
+		std::unordered_map<uint64_t, BBox> items;
+		rtree::Node* root = nullptr;
+		uint64_t version = 1; // Nodes created with this epoch are private to the writer
+		std::vector<rtree::Node*> retired; // Frozen nodes replaced since the last publish
+
+		rtree::Node* create(uint32_t level) {
+			rtree::Node* node = pool->allocate();
+			node->level = level;
+			node->count = 0;
+			node->epoch = version;
+			return node;
+		}
+
+		void drop(rtree::Node* node) {
+			if (node->epoch == version) {
+				pool->release(node);
+			} else {
+				retired.push_back(node);
+			}
+		}
+
+		// Private copy of a node, frozen nodes are copied and retired
+		rtree::Node* writable(rtree::Node*& ref) {
+			if (ref->epoch == version) {
+				return ref;
+			}
+			rtree::Node* copy = pool->allocate();
+			*copy = *ref;
+			copy->epoch = version;
+			retired.push_back(ref);
+			ref = copy;
+			return copy;
+		}
+
+		/*
+
+		Insert
+		Entry goes to a node of level, overflowing levels reinsert once per call, then split
+
+		*/
+
+		void place(const rtree::Entry& entry, uint32_t level) {
+			std::vector<std::pair<rtree::Entry, uint32_t>> pending = {{entry, level}};
+			std::vector<bool> reinserted;
+
+			while (!pending.empty()) {
+				auto [item, target] = pending.back();
+				pending.pop_back();
+
+				if (root == nullptr) {
+					root = create(0);
+				}
+
+				if (reinserted.size() <= root->level) {
+					reinserted.resize(root->level + 1, false);
+				}
+
+				rtree::Node* sibling = descend(root, item, target, reinserted, pending);
+				if (sibling != nullptr) {
+					// Root split, grow the tree
+					rtree::Node* top = create(root->level + 1);
+					top->entries[0] = {root->bounds(), root, 0};
+					top->entries[1] = {sibling->bounds(), sibling, 0};
+					top->count = 2;
+					root = top;
+				}
+			}
+		}
+
+		rtree::Node* descend(rtree::Node*& ref, const rtree::Entry& entry, uint32_t level, std::vector<bool>& reinserted, std::vector<std::pair<rtree::Entry, uint32_t>>& pending) {
+			rtree::Node* node = writable(ref);
+
+			if (node->level == level) {
+				node->entries[node->count++] = entry;
+			} else {
+				uint32_t i = choose(node, entry.box);
+				rtree::Node* sibling = descend(node->entries[i].child, entry, level, reinserted, pending);
+				node->entries[i].box = node->entries[i].child->bounds();
+				if (sibling != nullptr) {
+					node->entries[node->count++] = {sibling->bounds(), sibling, 0};
+				}
+			}
+
+			if (node->count <= rtree::MAX) {
+				return nullptr;
+			}
+
+			// Forced reinsert, not at the root and once per level
+			if (node != root && node->level < reinserted.size() && !reinserted[node->level]) {
+				reinserted[node->level] = true;
+				reinsert(node, pending);
+				return nullptr;
+			}
+
+			return split(node);
+		}
+
+		/*
+
+		ChooseSubtree
+		Above leaves: least overlap enlargement, then least area enlargement, then least area.
+		Higher: least area enlargement, then least area.
+
+		*/
+
+		uint32_t choose(const rtree::Node* node, const BBox& box) const {
+			uint32_t best = 0;
+			double bestOverlap = std::numeric_limits<double>::max();
+			double bestEnlargement = std::numeric_limits<double>::max();
+			double bestArea = std::numeric_limits<double>::max();
+
+			for (uint32_t i = 0; i < node->count; ++i) {
+				const BBox& current = node->entries[i].box;
+				BBox merged = rtree::merge(current, box);
+				double area = rtree::area(current);
+				double enlargement = rtree::area(merged) - area;
+				double overlap = .0;
+
+				if (node->level == 1) {
+					for (uint32_t j = 0; j < node->count; ++j) {
+						if (j != i) {
+							const BBox& other = node->entries[j].box;
+							overlap += rtree::overlap(merged, other) - rtree::overlap(current, other);
+						}
+					}
+				}
+
+				if (overlap < bestOverlap ||
+					(overlap == bestOverlap && (enlargement < bestEnlargement ||
+					(enlargement == bestEnlargement && area < bestArea)))) {
+					best = i;
+					bestOverlap = overlap;
+					bestEnlargement = enlargement;
+					bestArea = area;
+				}
+			}
+
+			return best;
+		}
+
+		// Farthest entries from the node centre go back to the top
+		void reinsert(rtree::Node* node, std::vector<std::pair<rtree::Entry, uint32_t>>& pending) {
+			BBox box = node->bounds();
+			double cx = (box[0] + box[2]) / 2;
+			double cy = (box[1] + box[3]) / 2;
+
+			auto distance = [cx, cy](const rtree::Entry& entry) {
+				double dx = (entry.box[0] + entry.box[2]) / 2 - cx;
+				double dy = (entry.box[1] + entry.box[3]) / 2 - cy;
+				return dx * dx + dy * dy;
+			};
+
+			std::sort(node->entries.begin(), node->entries.begin() + node->count, [&distance](const rtree::Entry& a, const rtree::Entry& b) {
+				return distance(a) < distance(b);
+			});
+
+			// Close reinsert: pending is a stack, so push the farthest first
+			for (uint32_t i = node->count; i > node->count - rtree::REINSERT; --i) {
+				pending.push_back({node->entries[i - 1], node->level});
+			}
+			node->count -= rtree::REINSERT;
+		}
+
+		/*
+
+		Split
+		Axis with the least margin sum over all distributions,
+		then the distribution with the least overlap, then the least area
+
+		*/
+
+		rtree::Node* split(rtree::Node* node) {
+			const uint32_t total = node->count;
+			auto begin = node->entries.begin();
+			auto end = begin + total;
+
+			auto byLower = [](int axis) {
+				return [axis](const rtree::Entry& a, const rtree::Entry& b) {
+					return a.box[axis] < b.box[axis] || (a.box[axis] == b.box[axis] && a.box[axis + 2] < b.box[axis + 2]);
+				};
+			};
+			auto byUpper = [](int axis) {
+				return [axis](const rtree::Entry& a, const rtree::Entry& b) {
+					return a.box[axis + 2] < b.box[axis + 2] || (a.box[axis + 2] == b.box[axis + 2] && a.box[axis] < b.box[axis]);
+				};
+			};
+
+			// Prefix and suffix bounds for each distribution
+			std::array<BBox, rtree::MAX + 1> prefix, suffix;
+			auto sweep = [&]() {
+				prefix[0] = node->entries[0].box;
+				for (uint32_t i = 1; i < total; ++i) {
+					prefix[i] = rtree::merge(prefix[i - 1], node->entries[i].box);
+				}
+				suffix[total - 1] = node->entries[total - 1].box;
+				for (uint32_t i = total - 1; i > 0; --i) {
+					suffix[i - 1] = rtree::merge(suffix[i], node->entries[i - 1].box);
+				}
+			};
+
+			auto marginSum = [&]() {
+				double sum = 0;
+				sweep();
+				for (uint32_t k = rtree::MIN; k <= total - rtree::MIN; ++k) {
+					sum += rtree::margin(prefix[k - 1]) + rtree::margin(suffix[k]);
+				}
+				return sum;
+			};
+
+			int axis = 0;
+			double bestMargin = std::numeric_limits<double>::max();
+			for (int a = 0; a < 2; ++a) {
+				std::sort(begin, end, byLower(a));
+				double sum = marginSum();
+				std::sort(begin, end, byUpper(a));
+				sum += marginSum();
+				if (sum < bestMargin) {
+					bestMargin = sum;
+					axis = a;
+				}
+			}
+
+			bool lower = true;
+			uint32_t index = rtree::MIN;
+			double bestOverlap = std::numeric_limits<double>::max();
+			double bestArea = std::numeric_limits<double>::max();
+			for (int pass = 0; pass < 2; ++pass) {
+				if (pass == 0) {
+					std::sort(begin, end, byLower(axis));
+				} else {
+					std::sort(begin, end, byUpper(axis));
+				}
+				sweep();
+
+				for (uint32_t k = rtree::MIN; k <= total - rtree::MIN; ++k) {
+					double overlap = rtree::overlap(prefix[k - 1], suffix[k]);
+					double area = rtree::area(prefix[k - 1]) + rtree::area(suffix[k]);
+					if (overlap < bestOverlap || (overlap == bestOverlap && area < bestArea)) {
+						bestOverlap = overlap;
+						bestArea = area;
+						index = k;
+						lower = (pass == 0);
+					}
+				}
+			}
+
+			if (lower) {
+				std::sort(begin, end, byLower(axis));
+			}
+
+			rtree::Node* sibling = create(node->level);
+			for (uint32_t i = index; i < total; ++i) {
+				sibling->entries[sibling->count++] = node->entries[i];
+			}
+			node->count = index;
+			return sibling;
+		}
+
+		/*
+
+		Erase
+		Finds the leaf through nodes containing the item bbox, removes the entry,
+		then condenses: underfull nodes are dissolved and their entries reinserted.
+		A bbox no node contains (e.g. NaN) falls back to a walk of the whole tree.
+		The id leaves items only once its entry is gone from the tree.
+
+		*/
+
+		bool erase(uint64_t id) {
+			auto it = items.find(id);
+			if (it == items.end() || root == nullptr) {
+				return false;
+			}
+
+			std::vector<uint32_t> path;
+			uint32_t slot = 0;
+			if (!locate(root, id, &it->second, path, slot) && !locate(root, id, nullptr, path, slot)) {
+				return false;
+			}
+			items.erase(it);
+
+			// Private copies along the path, top-down
+			std::vector<rtree::Node*> nodes = {writable(root)};
+			for (uint32_t i : path) {
+				nodes.push_back(writable(nodes.back()->entries[i].child));
+			}
+
+			rtree::Node* leaf = nodes.back();
+			leaf->entries[slot] = leaf->entries[--leaf->count];
+
+			// Condense bottom-up
+			std::vector<std::pair<rtree::Entry, uint32_t>> orphans;
+			for (size_t depth = nodes.size() - 1; depth > 0; --depth) {
+				rtree::Node* node = nodes[depth];
+				rtree::Node* parent = nodes[depth - 1];
+				uint32_t i = path[depth - 1];
+
+				if (node->count < rtree::MIN) {
+					for (uint32_t j = 0; j < node->count; ++j) {
+						orphans.push_back({node->entries[j], node->level});
+					}
+					parent->entries[i] = parent->entries[--parent->count];
+					drop(node);
+				} else {
+					parent->entries[i].box = node->bounds();
+				}
+			}
+
+			// Shrink the root
+			while (root->level > 0 && root->count == 1) {
+				rtree::Node* child = root->entries[0].child;
+				drop(root);
+				root = child;
+			}
+
+			if (root->count == 0) {
+				drop(root);
+				root = nullptr;
+			}
+
+			for (const auto& [entry, level] : orphans) {
+				if (level > 0 && (root == nullptr || level > root->level)) {
+					// Tree got shorter than the orphan subtree, take its items one by one
+					reattach(entry.child);
+				} else {
+					place(entry, level);
+				}
+			}
+
+			return true;
+		}
+
+		void reattach(rtree::Node* node) {
+			for (uint32_t i = 0; i < node->count; ++i) {
+				if (node->level == 0) {
+					place(node->entries[i], 0);
+				} else {
+					reattach(node->entries[i].child);
+				}
+			}
+			drop(node);
+		}
+
+		// Path to the leaf entry of id, through nodes containing box, or every node without one
+		bool locate(const rtree::Node* node, uint64_t id, const BBox* box, std::vector<uint32_t>& path, uint32_t& slot) const {
+			for (uint32_t i = 0; i < node->count; ++i) {
+				const rtree::Entry& entry = node->entries[i];
+				if (node->level == 0) {
+					if (entry.id == id) {
+						slot = i;
+						return true;
+					}
+				} else if (box == nullptr || rtree::contains(entry.box, *box)) {
+					path.push_back(i);
+					if (locate(entry.child, id, box, path, slot)) {
+						return true;
+					}
+					path.pop_back();
+				}
+			}
+			return false;
+		}
+	};
+}
+
+#endif
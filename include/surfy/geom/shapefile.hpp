@@ -0,0 +1,442 @@
+#ifndef SURFY_GEOM_SHAPEFILE_HPP
+#define SURFY_GEOM_SHAPEFILE_HPP
+
+/*
+
+Shapefile
+Reader for ESRI Shapefile geometry (.shp), with record offsets from the .shx index.
+The .shp is memory-mapped and records are decoded in parallel, ranges of records per task
+on a pool, the shared one unless given one.
+Z and M variants read as 2D, MultiPoint and MultiPatch have no Shape type and give empty Shapes.
+Attributes (.dbf) are not read. Assumes a little-endian host.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include "geom.hpp"
+#include "pool.hpp"
+#include "../utils/mmap.hpp"
+
+namespace surfy::geom::shapefile {
+
+	enum ShapeType : int32_t {
+		Null = 0,
+		Point = 1,
+		PolyLine = 3,
+		Polygon = 5,
+		MultiPoint = 8,
+		MultiPatch = 31
+	};
+
+	static constexpr int32_t FILE_CODE = 9994;
+	static constexpr size_t HEADER_SIZE = 100;
+
+	// 2D type of a Z (1x) or M (2x) variant, MultiPatch as is
+	ShapeType base(int32_t type) {
+		return static_cast<ShapeType>(type == MultiPatch ? type : type % 10);
+	}
+
+	int32_t big(const uint8_t* at) {
+		uint32_t value;
+		std::memcpy(&value, at, 4);
+		return static_cast<int32_t>(__builtin_bswap32(value));
+	}
+
+	template <typename T>
+	T little(const uint8_t* at) {
+		T value;
+		std::memcpy(&value, at, sizeof(T));
+		return value;
+	}
+
+	// Twice the signed area, negative for the clockwise rings the format uses as outers
+	double winding(const Coords& ring) {
+		double sum = 0;
+		for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+			sum += (ring[j].x - ring[i].x) * (ring[j].y + ring[i].y);
+		}
+		return sum;
+	}
+
+	/*
+
+	Assemble
+	Rings to polygons by winding order: clockwise rings are outers, counterclockwise ones holes,
+	each hole going to the smallest outer holding its first point. A hole no outer holds is an outer
+	with the wrong winding, and a record without clockwise rings is all outers.
+	Like Shape(std::string), a polygon keeps one hole, the last.
+
+	*/
+
+	Shape assemble(std::vector<Coords>& rings) {
+		std::vector<double> areas(rings.size());
+		std::vector<size_t> outers, holes;
+		for (size_t r = 0; r < rings.size(); ++r) {
+			areas[r] = winding(rings[r]);
+			(areas[r] <= 0 ? outers : holes).push_back(r);
+		}
+		if (outers.empty()) {
+			outers.swap(holes);
+		}
+
+		std::vector<BBox> boxes;
+		for (size_t r : outers) {
+			boxes.push_back(utils::bbox(rings[r]));
+		}
+
+		std::vector<size_t> owner(rings.size(), rings.size());
+		for (size_t h : holes) {
+			const surfy::geom::Point& p = rings[h].front();
+			double smallest = std::numeric_limits<double>::max();
+			for (size_t o = 0; o < boxes.size(); ++o) {
+				const BBox& box = boxes[o];
+				if (p.x < box[0] || p.x > box[2] || p.y < box[1] || p.y > box[3]) {
+					continue;
+				}
+				double area = std::fabs(areas[outers[o]]);
+				if (area < smallest && utils::inside(p, rings[outers[o]])) {
+					smallest = area;
+					owner[h] = outers[o];
+				}
+			}
+			if (owner[h] == rings.size()) {
+				outers.push_back(h);
+			}
+		}
+
+		std::vector<types::Polygon> polygons;
+		std::vector<size_t> slot(rings.size());
+		for (size_t o : outers) {
+			slot[o] = polygons.size();
+			polygons.emplace_back();
+			polygons.back().outer.coords = std::move(rings[o]);
+		}
+		for (size_t h : holes) {
+			if (owner[h] != rings.size()) {
+				polygons[slot[owner[h]]].inner.coords = std::move(rings[h]);
+			}
+		}
+
+		if (polygons.size() == 1) {
+			return Shape(std::move(polygons.front()));
+		}
+		types::MultiPolygon multiPolygon;
+		multiPolygon.items = std::move(polygons);
+		return Shape(std::move(multiPolygon));
+	}
+
+	/*
+
+	Decode
+	Record content (after the 8-byte record header) to a Shape.
+	Truncated or inconsistent records give empty Shapes, like unparsable WKT lines.
+
+	*/
+
+	Shape decode(const uint8_t* data, size_t size) {
+		if (size < 4) {
+			return Shape();
+		}
+
+		switch (base(little<int32_t>(data))) {
+			case Point: {
+				if (size < 20) {
+					return Shape();
+				}
+				types::Point point;
+				point.x = little<double>(data + 4);
+				point.y = little<double>(data + 12);
+				return Shape(point);
+			}
+			case PolyLine:
+			case Polygon: {
+				if (size < 44) {
+					return Shape();
+				}
+				int32_t parts = little<int32_t>(data + 36);
+				int32_t points = little<int32_t>(data + 40);
+				if (parts <= 0 || points <= 0 || 44 + 4 * static_cast<uint64_t>(parts) + 16 * static_cast<uint64_t>(points) > size) {
+					return Shape();
+				}
+
+				const uint8_t* starts = data + 44;
+				const uint8_t* xy = starts + 4 * static_cast<size_t>(parts);
+				std::vector<Coords> rings(parts);
+				for (int32_t p = 0; p < parts; ++p) {
+					int32_t first = little<int32_t>(starts + 4 * p);
+					int32_t last = p + 1 < parts ? little<int32_t>(starts + 4 * (p + 1)) : points;
+					if (first < 0 || last > points || first >= last) {
+						return Shape();
+					}
+					rings[p].resize(last - first);
+					std::memcpy(rings[p].data(), xy + 16 * static_cast<size_t>(first), 16 * static_cast<size_t>(last - first));
+				}
+
+				if (base(little<int32_t>(data)) == Polygon) {
+					return assemble(rings);
+				}
+				if (parts == 1) {
+					types::Line line;
+					line.coords = std::move(rings.front());
+					return Shape(std::move(line));
+				}
+				types::MultiLine multiLine;
+				for (Coords& part : rings) {
+					types::Line line;
+					line.coords = std::move(part);
+					multiLine.items.push_back(std::move(line));
+				}
+				return Shape(std::move(multiLine));
+			}
+			default:
+				return Shape();
+		}
+	}
+
+	/*
+
+	Reader
+	Record offsets come from the .shx next to the .shp (same name, extension case kept),
+	or from a scan of the record headers if there is none. Indices are record numbers from 0.
+	Reads run on workers, the library's shared pool unless given one.
+
+	*/
+
+	class Reader {
+	public:
+		ShapeType type = Null;
+		BBox bbox = {0, 0, 0, 0};
+
+		Reader(const std::string& path, pool::Pool& workers = pool::shared()) : file(path, false), workers(workers) {
+			const uint8_t* data = bytes();
+			size_t size = file.size();
+			if (size < HEADER_SIZE || big(data) != FILE_CODE || little<int32_t>(data + 28) != 1000) {
+				if (size != 0) {
+					std::cerr << "Not a Shapefile: " << path << std::endl;
+				}
+				return;
+			}
+
+			type = base(little<int32_t>(data + 32));
+			for (size_t i = 0; i < 4; ++i) {
+				bbox[i] = little<double>(data + 36 + 8 * i);
+			}
+			size = std::min<size_t>(size, 2 * static_cast<size_t>(static_cast<uint32_t>(big(data + 24))));
+
+			std::string index = path;
+			if (index.size() > 4) {
+				char& last = index.back();
+				last = last == 'P' ? 'X' : 'x';
+			}
+			if (!std::filesystem::exists(index) || !offsets(index, size)) {
+				for (uint64_t at = HEADER_SIZE; at + 8 <= size;) {
+					uint64_t length = 2 * static_cast<uint64_t>(static_cast<uint32_t>(big(data + at + 4)));
+					if (at + 8 + length > size) {
+						break;
+					}
+					records.push_back({at + 8, length});
+					at += 8 + length;
+				}
+			}
+			valid = true;
+		}
+
+		explicit operator bool() const {
+			return valid;
+		}
+
+		// Number of records
+		size_t size() const {
+			return records.size();
+		}
+
+		Shape shape(size_t index) const {
+			return decode(bytes() + records[index].first, records[index].second);
+		}
+
+		/*
+
+		Box
+		Bounds of a record from its header bytes, without decoding its points.
+		False for null and truncated records.
+
+		*/
+
+		bool box(size_t index, BBox& out) const {
+			const uint8_t* data = bytes() + records[index].first;
+			uint64_t size = records[index].second;
+			if (size < 4) {
+				return false;
+			}
+
+			ShapeType kind = base(little<int32_t>(data));
+			if (kind == Point && size >= 20) {
+				double x = little<double>(data + 4);
+				double y = little<double>(data + 12);
+				out = {x, y, x, y};
+				return true;
+			}
+			if (kind != Null && kind != Point && size >= 36) {
+				for (size_t i = 0; i < 4; ++i) {
+					out[i] = little<double>(data + 4 + 8 * i);
+				}
+				return true;
+			}
+			return false;
+		}
+
+		// visit(index, shape) for every record, called from worker threads
+		template <typename Visitor>
+		void forEach(Visitor&& visit) const {
+			run([&](size_t, size_t index) {
+				Shape shape = this->shape(index);
+				visit(index, shape);
+			});
+		}
+
+		// Every Shape, in file order
+		std::vector<Shape> read() const {
+			std::vector<std::vector<Shape>> found(chunks().size());
+			run([&](size_t chunk, size_t index) {
+				found[chunk].push_back(shape(index));
+			});
+			return concat(found);
+		}
+
+		/*
+
+		Search
+		visit(index, shape) for every record whose bbox intersects query, called from worker threads.
+		The record bbox is read from its header, so records outside the query are never decoded.
+
+		*/
+
+		template <typename Visitor>
+		void search(const BBox& query, Visitor&& visit) const {
+			run([&](size_t, size_t index) {
+				BBox bounds;
+				if (box(index, bounds) && intersects(bounds, query)) {
+					Shape shape = this->shape(index);
+					visit(index, shape);
+				}
+			});
+		}
+
+		// Shapes whose bbox intersects query, in file order
+		std::vector<Shape> read(const BBox& query) const {
+			std::vector<std::vector<Shape>> found(chunks().size());
+			run([&](size_t chunk, size_t index) {
+				BBox bounds;
+				if (box(index, bounds) && intersects(bounds, query)) {
+					found[chunk].push_back(shape(index));
+				}
+			});
+			return concat(found);
+		}
+
+	private:
+		surfy::utils::MappedFile file;
+		pool::Pool& workers;
+		std::vector<std::pair<uint64_t, uint64_t>> records; // (content offset, content length)
+		bool valid = false;
+
+		static constexpr size_t MIN_CHUNK = 1 << 20;
+
+		const uint8_t* bytes() const {
+			return reinterpret_cast<const uint8_t*>(file.data());
+		}
+
+		// Records from the .shx, false if it isn't one. size is the end of the .shp records
+		bool offsets(const std::string& path, uint64_t size) {
+			surfy::utils::MappedFile shx(path, false);
+			const uint8_t* entry = reinterpret_cast<const uint8_t*>(shx.data());
+			if (shx.size() < HEADER_SIZE || big(entry) != FILE_CODE) {
+				return false;
+			}
+
+			size_t count = (shx.size() - HEADER_SIZE) / 8;
+			entry += HEADER_SIZE;
+			records.reserve(count);
+			for (size_t i = 0; i < count; ++i, entry += 8) {
+				uint64_t offset = 2 * static_cast<uint64_t>(static_cast<uint32_t>(big(entry)));
+				uint64_t length = 2 * static_cast<uint64_t>(static_cast<uint32_t>(big(entry + 4)));
+				if (offset < HEADER_SIZE || offset + 8 + length > size) {
+					records.push_back({0, 0}); // Out of the file, decodes as empty
+				} else {
+					records.push_back({offset + 8, length});
+				}
+			}
+			return true;
+		}
+
+		static bool intersects(const BBox& a, const BBox& b) {
+			return a[0] <= b[2] && a[2] >= b[0] && a[1] <= b[3] && a[3] >= b[1];
+		}
+
+		// [first, last) record ranges of about the same bytes, a few per worker of the pool
+		std::vector<std::pair<size_t, size_t>> chunks() const {
+			std::vector<std::pair<size_t, size_t>> result;
+			if (records.empty()) {
+				return result;
+			}
+
+			size_t count = std::clamp<size_t>(file.size() / MIN_CHUNK, 1, workers.size() * 4);
+			uint64_t step = file.size() / count + 1;
+
+			size_t first = 0;
+			uint64_t bytes = 0;
+			for (size_t i = 0; i < records.size(); ++i) {
+				bytes += records[i].second + 8;
+				if (bytes >= step) {
+					result.push_back({first, i + 1});
+					first = i + 1;
+					bytes = 0;
+				}
+			}
+			if (first < records.size()) {
+				result.push_back({first, records.size()});
+			}
+			return result;
+		}
+
+		static std::vector<Shape> concat(std::vector<std::vector<Shape>>& found) {
+			size_t total = 0;
+			for (const std::vector<Shape>& part : found) {
+				total += part.size();
+			}
+
+			std::vector<Shape> result;
+			result.reserve(total);
+			for (std::vector<Shape>& part : found) {
+				for (Shape& shape : part) {
+					result.push_back(std::move(shape));
+				}
+				std::vector<Shape>().swap(part);
+			}
+			return result;
+		}
+
+		// task(chunk, index) for every record
+		template <typename Task>
+		void run(Task&& task) const {
+			std::vector<std::pair<size_t, size_t>> ranges = chunks();
+			if (ranges.empty()) {
+				return;
+			}
+
+			pool::Group group;
+			for (size_t chunk = 0; chunk < ranges.size(); ++chunk) {
+				workers.submit(group, [&task, &ranges, chunk]() {
+					for (size_t index = ranges[chunk].first; index < ranges[chunk].second; ++index) {
+						task(chunk, index);
+					}
+				});
+			}
+			workers.wait(group);
+		}
+	};
+}
+
+#endif
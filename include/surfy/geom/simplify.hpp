@@ -69,4 +69,140 @@ namespace surfy::geom {
 
 		// return result;
 	}
+
+	/*
+
+	Significance
+	Per-vertex Douglas-Peucker weights of every line and ring of a Shape, computed once.
+	Vertex counts for any tolerance are answered by binary search, so a budget can be
+	met without re-running the algorithm on each probe.
+
+	*/
+
+	class Significance {
+	public:
+		std::vector<double> sorted; // All weights, ascending
+
+		Significance(const Shape& shape) {
+			visit(shape, [this](const Coords& coords) {
+				std::vector<double>& ring = weights.emplace_back();
+				utils::significance(coords, ring);
+				sorted.insert(sorted.end(), ring.begin(), ring.end());
+			});
+			std::sort(sorted.begin(), sorted.end());
+		}
+
+		// Vertices kept at tolerance
+		size_t count(const double& tolerance) const {
+			return sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), tolerance);
+		}
+
+		// Smallest tolerance keeping at most limit vertices, endpoints are always kept
+		double tolerance(const size_t& limit) const {
+			return search({this}, limit);
+		}
+
+		/*
+
+		Tolerance for many Shapes
+		Binary search over the merged weights of a whole tile
+
+		*/
+
+		static double search(const std::vector<const Significance*>& items, const size_t& limit) {
+			auto count = [&items](const double& tolerance) {
+				size_t total = 0;
+				for (const Significance* item : items) {
+					total += item->count(tolerance);
+				}
+				return total;
+			};
+
+			if (count(.0) <= limit) {
+				return .0;
+			}
+
+			std::vector<double> candidates;
+			for (const Significance* item : items) {
+				for (const double& weight : item->sorted) {
+					if (std::isfinite(weight)) {
+						candidates.push_back(weight);
+					}
+				}
+			}
+
+			if (candidates.empty()) {
+				return .0;
+			}
+
+			std::sort(candidates.begin(), candidates.end());
+
+			// count() decreases with tolerance: find the first candidate within limit
+			size_t low = 0;
+			size_t high = candidates.size() - 1;
+			while (low < high) {
+				size_t mid = (low + high) / 2;
+				if (count(candidates[mid]) <= limit) {
+					high = mid;
+				} else {
+					low = mid + 1;
+				}
+			}
+
+			return candidates[low];
+		}
+
+		// Simplify Shape (the one weights were computed for) at tolerance
+		void apply(Shape& shape, const double& tolerance) const {
+			size_t i = 0;
+			visit(shape, [this, &i, &tolerance](Coords& coords) {
+				Coords filtered;
+				utils::filter(coords, weights[i++], tolerance, filtered);
+				coords = filtered;
+			});
+			shape.refresh();
+		}
+
+	private:
+		std::vector<std::vector<double>> weights;
+
+		// Lines and rings in a stable order, ShapeT is Shape or const Shape
+		template <typename ShapeT, typename Callback>
+		static void visit(ShapeT& shape, Callback callback) {
+			if (shape.type == "Line") {
+				callback(shape.geom.line.coords);
+			} else if (shape.type == "MultiLine") {
+				for (auto& line : shape.geom.multiLine.items) {
+					callback(line.coords);
+				}
+			} else if (shape.type == "Polygon") {
+				callback(shape.geom.polygon.outer.coords);
+				callback(shape.geom.polygon.inner.coords);
+			} else if (shape.type == "MultiPolygon") {
+				for (auto& poly : shape.geom.multiPolygon.items) {
+					callback(poly.outer.coords);
+					callback(poly.inner.coords);
+				}
+			}
+		}
+	};
+
+	/*
+
+	Simplify to Budget
+	Returns the tolerance that was applied
+
+	*/
+
+	double Shape::simplify(const Budget& budget) {
+		size_t limit = budget.limit();
+		if (limit == 0 || vertices <= limit) {
+			return .0;
+		}
+
+		Significance significance(*this);
+		double tolerance = significance.tolerance(limit);
+		significance.apply(*this, tolerance);
+		return tolerance;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,517 @@
+#ifndef SURFY_GEOM_SQLITE_HPP
+#define SURFY_GEOM_SQLITE_HPP
+
+/*
+
+SQLite
+Geometry functions for SQL on Shape, and a bulk loader filling a table and its R*Tree.
+Geometry arguments are WKT text, WKB or GeoPackage blobs, geometry results come back as WKT for text and WKB for blobs.
+With SURFY_GEOM_SQLITE_EXTENSION defined this header is a loadable extension on its own,
+without it install() registers the functions on a connection of a program linked with -lsqlite3.
+
+*/
+
+#ifdef SURFY_GEOM_SQLITE_EXTENSION
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#else
+#include <sqlite3.h>
+#endif
+
+#include <charconv>
+#include <memory>
+#include <span>
+#include "geom.hpp"
+#include "wkb.hpp"
+#include "wkt.hpp"
+
+namespace surfy::geom::sqlite {
+
+	/*
+
+	GeoPackage blob
+	Header (magic, flags, SRS id, optional envelope), then WKB. Envelope sizes by flag: none, xy, xyz, xym, xyzm.
+	The empty flag gives an empty Shape, a bad magic or a blob shorter than its header throws.
+
+	*/
+
+	Shape geopackage(const uint8_t* data, size_t size) {
+		if (size < 8 || data[0] != 'G' || data[1] != 'P') {
+			throw std::runtime_error("GeoPackage: invalid geometry blob");
+		}
+
+		uint8_t flags = data[3];
+		const size_t envelopes[8] = {0, 32, 48, 48, 64, 0, 0, 0};
+		size_t header = 8 + envelopes[(flags >> 1) & 7];
+		if (flags & 0x10) {
+			return Shape();
+		}
+		if (size < header) {
+			throw std::runtime_error("GeoPackage: truncated geometry blob");
+		}
+		return wkb::parse(data + header, size - header);
+	}
+
+	/*
+
+	Shape
+	Geometry argument: WKT text, WKB blob or GeoPackage blob (header, then WKB), NULL gives an empty Shape.
+
+	*/
+
+	Shape shape(sqlite3_value* value) {
+		switch (sqlite3_value_type(value)) {
+			case SQLITE_TEXT: {
+				const char* text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+				return wkt::parse(std::string_view(text, sqlite3_value_bytes(value)));
+			}
+			case SQLITE_BLOB: {
+				const uint8_t* blob = static_cast<const uint8_t*>(sqlite3_value_blob(value));
+				size_t size = static_cast<size_t>(sqlite3_value_bytes(value));
+				if (size >= 2 && blob[0] == 'G' && blob[1] == 'P') {
+					return geopackage(blob, size);
+				}
+				return wkb::parse(blob, size);
+			}
+		}
+		return Shape();
+	}
+
+	// WKB blob or WKT text, NULL for an empty Shape
+	void result(sqlite3_context* context, const Shape& shape, bool blob) {
+		if (shape.empty) {
+			sqlite3_result_null(context);
+		} else if (blob) {
+			std::string data = wkb::encode(shape);
+			sqlite3_result_blob(context, data.data(), static_cast<int>(data.size()), SQLITE_TRANSIENT);
+		} else {
+			std::ostringstream os;
+			os << shape;
+			std::string text = os.str();
+			sqlite3_result_text(context, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+		}
+	}
+
+	namespace functions {
+
+		// Runs body, exceptions become SQL errors
+		template <typename Body>
+		void guard(sqlite3_context* context, Body&& body) {
+			try {
+				body();
+			} catch (const std::exception& e) {
+				sqlite3_result_error(context, e.what(), -1);
+			}
+		}
+
+		bool blob(sqlite3_value* value) {
+			return sqlite3_value_type(value) == SQLITE_BLOB;
+		}
+
+		BBox bbox(sqlite3_value** argv) {
+			return {sqlite3_value_double(argv[0]), sqlite3_value_double(argv[1]), sqlite3_value_double(argv[2]), sqlite3_value_double(argv[3])};
+		}
+
+		/*
+
+		Clip
+		geom_clip(g, minx, miny, maxx, maxy [, buffer]) clips to a box, geom_clip(g, mask) to the outer ring of a Polygon.
+		The mask ring is turned counterclockwise, the orientation Shape::clip expects.
+
+		*/
+
+		void clip(sqlite3_context* context, int argc, sqlite3_value** argv) {
+			guard(context, [&]() {
+				Shape shape = sqlite::shape(argv[0]);
+				if (shape.empty) {
+					sqlite3_result_null(context);
+					return;
+				}
+
+				if (argc == 2) {
+					Shape mask = sqlite::shape(argv[1]);
+					if (mask.type != "Polygon" || mask.geom.polygon.outer.coords.size() < 3) {
+						throw std::runtime_error("geom_clip: mask must be a Polygon");
+					}
+					Coords ring = mask.geom.polygon.outer.coords;
+					if (ring.front().x == ring.back().x && ring.front().y == ring.back().y) {
+						ring.pop_back();
+					}
+					double area = 0;
+					for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+						area += ring[j].x * ring[i].y - ring[i].x * ring[j].y;
+					}
+					if (area < 0) {
+						std::reverse(ring.begin(), ring.end());
+					}
+					shape.clip(ring);
+				} else {
+					shape.clip(bbox(argv + 1), argc == 6 ? sqlite3_value_double(argv[5]) : 0.);
+				}
+				result(context, shape, blob(argv[0]));
+			});
+		}
+
+		// geom_simplify(g, tolerance)
+		void simplify(sqlite3_context* context, int, sqlite3_value** argv) {
+			guard(context, [&]() {
+				Shape shape = sqlite::shape(argv[0]);
+				if (!shape.empty) {
+					shape.simplify(sqlite3_value_double(argv[1]));
+				}
+				result(context, shape, blob(argv[0]));
+			});
+		}
+
+		// geom_wkt(g), geom_wkb(g)
+		void wkt(sqlite3_context* context, int, sqlite3_value** argv) {
+			guard(context, [&]() {
+				result(context, sqlite::shape(argv[0]), false);
+			});
+		}
+
+		void wkb(sqlite3_context* context, int, sqlite3_value** argv) {
+			guard(context, [&]() {
+				result(context, sqlite::shape(argv[0]), true);
+			});
+		}
+
+		/*
+
+		Measures
+		geom_area, geom_length, geom_vertices, geom_type, geom_minx .. geom_maxy and geom_bbox as "[minx,miny,maxx,maxy]".
+		NULL in gives NULL out, bbox values are NULL for an empty Shape.
+
+		*/
+
+		template <typename Measure>
+		void measure(sqlite3_context* context, sqlite3_value* value, Measure&& measure) {
+			if (sqlite3_value_type(value) == SQLITE_NULL) {
+				sqlite3_result_null(context);
+				return;
+			}
+			guard(context, [&]() {
+				measure(sqlite::shape(value));
+			});
+		}
+
+		void area(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				sqlite3_result_double(context, shape.area);
+			});
+		}
+
+		void length(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				sqlite3_result_double(context, shape.length);
+			});
+		}
+
+		void vertices(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				sqlite3_result_int64(context, shape.vertices);
+			});
+		}
+
+		void type(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				sqlite3_result_text(context, shape.type.c_str(), -1, SQLITE_TRANSIENT);
+			});
+		}
+
+		template <size_t Side>
+		void side(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				if (shape.empty) {
+					sqlite3_result_null(context);
+				} else {
+					sqlite3_result_double(context, shape.bbox[Side]);
+				}
+			});
+		}
+
+		void bbox(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				if (shape.empty) {
+					sqlite3_result_null(context);
+					return;
+				}
+				char buffer[128];
+				char* at = buffer;
+				*at++ = '[';
+				for (size_t i = 0; i < 4; ++i) {
+					at = std::to_chars(at, buffer + sizeof(buffer), shape.bbox[i]).ptr;
+					*at++ = i < 3 ? ',' : ']';
+				}
+				sqlite3_result_text(context, buffer, static_cast<int>(at - buffer), SQLITE_TRANSIENT);
+			});
+		}
+
+		// ST_IsEmpty(g) for the GeoPackage rtree triggers, ST_MinX .. ST_MaxY are geom_minx .. geom_maxy
+		void isEmpty(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				sqlite3_result_int(context, shape.empty);
+			});
+		}
+
+		// geom_intersects(g, minx, miny, maxx, maxy): bboxes intersect
+		void intersects(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				BBox box = bbox(argv + 1);
+				sqlite3_result_int(context, !shape.empty && shape.bbox[0] <= box[2] && shape.bbox[2] >= box[0] && shape.bbox[1] <= box[3] && shape.bbox[3] >= box[1]);
+			});
+		}
+
+		// geom_distance(g, x, y), zero inside polygons
+		void distance(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				if (shape.empty) {
+					sqlite3_result_null(context);
+				} else {
+					sqlite3_result_double(context, shape.distance({sqlite3_value_double(argv[1]), sqlite3_value_double(argv[2])}));
+				}
+			});
+		}
+
+		// geom_contains(g, x, y), polygons only
+		void contains(sqlite3_context* context, int, sqlite3_value** argv) {
+			measure(context, argv[0], [&](const Shape& shape) {
+				bool polygon = shape.type == "Polygon" || shape.type == "MultiPolygon";
+				sqlite3_result_int(context, polygon && shape.distance({sqlite3_value_double(argv[1]), sqlite3_value_double(argv[2])}) == 0);
+			});
+		}
+	}
+
+	/*
+
+	Install
+	Registers the geom_ functions on db, deterministic so they can be used in indexes and generated columns.
+	Also ST_IsEmpty and ST_MinX .. ST_MaxY, which the rtree triggers of GeoPackage files call on every edit.
+
+	*/
+
+	int install(sqlite3* db) {
+		using Function = void (*)(sqlite3_context*, int, sqlite3_value**);
+		struct Entry {
+			const char* name;
+			int arguments;
+			Function function;
+		};
+
+		const Entry entries[] = {
+			{"geom_clip", 2, functions::clip},
+			{"geom_clip", 5, functions::clip},
+			{"geom_clip", 6, functions::clip},
+			{"geom_simplify", 2, functions::simplify},
+			{"geom_wkt", 1, functions::wkt},
+			{"geom_wkb", 1, functions::wkb},
+			{"geom_area", 1, functions::area},
+			{"geom_length", 1, functions::length},
+			{"geom_vertices", 1, functions::vertices},
+			{"geom_type", 1, functions::type},
+			{"geom_bbox", 1, functions::bbox},
+			{"geom_minx", 1, functions::side<0>},
+			{"geom_miny", 1, functions::side<1>},
+			{"geom_maxx", 1, functions::side<2>},
+			{"geom_maxy", 1, functions::side<3>},
+			{"geom_intersects", 5, functions::intersects},
+			{"geom_distance", 3, functions::distance},
+			{"geom_contains", 3, functions::contains},
+			{"ST_IsEmpty", 1, functions::isEmpty},
+			{"ST_MinX", 1, functions::side<0>},
+			{"ST_MinY", 1, functions::side<1>},
+			{"ST_MaxX", 1, functions::side<2>},
+			{"ST_MaxY", 1, functions::side<3>}
+		};
+
+		int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+#ifdef SQLITE_INNOCUOUS
+		flags |= SQLITE_INNOCUOUS;
+#endif
+
+		for (const Entry& entry : entries) {
+			int code = sqlite3_create_function(db, entry.name, entry.arguments, flags, nullptr, entry.function, nullptr, nullptr);
+			if (code != SQLITE_OK) {
+				return code;
+			}
+		}
+		return SQLITE_OK;
+	}
+
+	struct Finalize {
+		void operator()(sqlite3_stmt* statement) const {
+			sqlite3_finalize(statement);
+		}
+	};
+
+	using Statement = std::unique_ptr<sqlite3_stmt, Finalize>;
+
+	Statement prepare(sqlite3* db, const std::string& sql) {
+		sqlite3_stmt* statement = nullptr;
+		if (sqlite3_prepare_v2(db, sql.c_str(), -1, &statement, nullptr) != SQLITE_OK) {
+			throw std::runtime_error(sqlite3_errmsg(db));
+		}
+		return Statement(statement);
+	}
+
+	void execute(sqlite3* db, const std::string& sql) {
+		char* error = nullptr;
+		if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK) {
+			std::string message = error ? error : sqlite3_errmsg(db);
+			sqlite3_free(error);
+			throw std::runtime_error(message);
+		}
+	}
+
+	// Identifier in double quotes
+	std::string quote(const std::string& name) {
+		std::string quoted = "\"";
+		for (char c : name) {
+			quoted += c;
+			if (c == '"') {
+				quoted += '"';
+			}
+		}
+		return quoted + "\"";
+	}
+
+	struct Options {
+		std::string geometry = "geom"; // Geometry column
+		bool wkb = true; // WKB blobs, else WKT text
+		bool rtree = true; // <table>_rtree R*Tree on the bboxes
+	};
+
+	/*
+
+	Load
+	Creates table (id INTEGER PRIMARY KEY, geometry, minx, miny, maxx, maxy) and its R*Tree if missing,
+	then inserts every Shape with prepared statements in one transaction.
+	Empty Shapes get a NULL geometry and stay out of the tree.
+	Returns the number of rows inserted, -1 on error after rolling back.
+
+	*/
+
+	long long load(sqlite3* db, const std::string& table, std::span<const Shape> shapes, const Options& options = {}) {
+		std::string rtree = quote(table + "_rtree");
+		bool open = false;
+
+		try {
+			execute(db, "CREATE TABLE IF NOT EXISTS " + quote(table) + " (id INTEGER PRIMARY KEY, " + quote(options.geometry) + (options.wkb ? " BLOB" : " TEXT") + ", minx REAL, miny REAL, maxx REAL, maxy REAL)");
+			if (options.rtree) {
+				execute(db, "CREATE VIRTUAL TABLE IF NOT EXISTS " + rtree + " USING rtree(id, minx, maxx, miny, maxy)");
+			}
+
+			execute(db, "BEGIN");
+			open = true;
+
+			Statement row = prepare(db, "INSERT INTO " + quote(table) + " (" + quote(options.geometry) + ", minx, miny, maxx, maxy) VALUES (?, ?, ?, ?, ?)");
+			Statement node = options.rtree ? prepare(db, "INSERT INTO " + rtree + " (id, minx, maxx, miny, maxy) VALUES (?, ?, ?, ?, ?)") : nullptr;
+
+			std::string data;
+			for (const Shape& shape : shapes) {
+				sqlite3_reset(row.get());
+				if (shape.empty) {
+					for (int i = 1; i <= 5; ++i) {
+						sqlite3_bind_null(row.get(), i);
+					}
+				} else {
+					data.clear();
+					if (options.wkb) {
+						wkb::write(data, shape);
+						sqlite3_bind_blob(row.get(), 1, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+					} else {
+						std::ostringstream os;
+						os << shape;
+						data = os.str();
+						sqlite3_bind_text(row.get(), 1, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+					}
+					for (int i = 0; i < 4; ++i) {
+						sqlite3_bind_double(row.get(), i + 2, shape.bbox[i]);
+					}
+				}
+				if (sqlite3_step(row.get()) != SQLITE_DONE) {
+					throw std::runtime_error(sqlite3_errmsg(db));
+				}
+
+				if (node && !shape.empty) {
+					sqlite3_reset(node.get());
+					sqlite3_bind_int64(node.get(), 1, sqlite3_last_insert_rowid(db));
+					sqlite3_bind_double(node.get(), 2, shape.bbox[0]);
+					sqlite3_bind_double(node.get(), 3, shape.bbox[2]);
+					sqlite3_bind_double(node.get(), 4, shape.bbox[1]);
+					sqlite3_bind_double(node.get(), 5, shape.bbox[3]);
+					if (sqlite3_step(node.get()) != SQLITE_DONE) {
+						throw std::runtime_error(sqlite3_errmsg(db));
+					}
+				}
+			}
+
+			row.reset();
+			node.reset();
+			execute(db, "COMMIT");
+			return static_cast<long long>(shapes.size());
+		} catch (const std::exception& e) {
+			std::cerr << "SQLite load into " << table << ": " << e.what() << std::endl;
+			if (open) {
+				sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+			}
+			return -1;
+		}
+	}
+
+	/*
+
+	Search
+	visit(id, shape) for every row of a loaded table whose bbox intersects box, candidates from the R*Tree.
+	The R*Tree rounds its boxes outwards to floats, so they are checked again against the row's bbox.
+	Tables loaded with options.rtree false are scanned on their minx .. maxy columns.
+
+	*/
+
+	template <typename Visitor>
+	bool search(sqlite3* db, const std::string& table, const BBox& box, Visitor&& visit, const Options& options = {}) {
+		try {
+			std::string sql = "SELECT t.id, t." + quote(options.geometry) + " FROM " + quote(table) + " AS t";
+			if (options.rtree) {
+				sql += " JOIN " + quote(table + "_rtree") + " AS r ON r.id = t.id WHERE r.minx <= ?3 AND r.maxx >= ?1 AND r.miny <= ?4 AND r.maxy >= ?2 AND";
+			} else {
+				sql += " WHERE";
+			}
+			Statement query = prepare(db, sql + " t.minx <= ?3 AND t.maxx >= ?1 AND t.miny <= ?4 AND t.maxy >= ?2");
+			for (int i = 0; i < 4; ++i) {
+				sqlite3_bind_double(query.get(), i + 1, box[i]);
+			}
+
+			int code;
+			while ((code = sqlite3_step(query.get())) == SQLITE_ROW) {
+				Shape shape = sqlite::shape(sqlite3_column_value(query.get(), 1));
+				visit(static_cast<long long>(sqlite3_column_int64(query.get(), 0)), shape);
+			}
+			if (code != SQLITE_DONE) {
+				throw std::runtime_error(sqlite3_errmsg(db));
+			}
+			return true;
+		} catch (const std::exception& e) {
+			std::cerr << "SQLite search in " << table << ": " << e.what() << std::endl;
+			return false;
+		}
+	}
+}
+
+#ifdef SURFY_GEOM_SQLITE_EXTENSION
+extern "C" {
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+	int sqlite3_extension_init(sqlite3* db, char** error, const sqlite3_api_routines* api) {
+		SQLITE_EXTENSION_INIT2(api);
+		int code = surfy::geom::sqlite::install(db);
+		if (code != SQLITE_OK && error != nullptr) {
+			*error = sqlite3_mprintf("surfy geom: %s", sqlite3_errmsg(db));
+		}
+		return code;
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,506 @@
+#ifndef SURFY_GEOM_STORE_HPP
+#define SURFY_GEOM_STORE_HPP
+
+/*
+
+Store
+Native on-disk Shapes: the arrays of wkt::Columns (type tags, geometry -> part -> ring -> point offsets, points),
+bboxes and an optional packed R-tree, each in a 64-byte aligned section listed in the header.
+Opening maps the file and checks the header, nothing is parsed or copied: Views read straight from the mapping,
+and processes mapping the same file share its pages through the page cache.
+Native byte order and struct layout, a cache format for the machine that wrote it, not an interchange format.
+
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include "geom.hpp"
+#include "index.hpp"
+#include "wkt.hpp"
+#include "../utils/mmap.hpp"
+
+namespace surfy::geom::store {
+
+	static_assert(sizeof(size_t) == sizeof(uint64_t), "Offsets are written as size_t");
+	static_assert(sizeof(Point) == 2 * sizeof(double) && sizeof(BBox) == 4 * sizeof(double));
+
+	enum Section {
+		Types, // uint8 Shape::typeID per shape
+		Geometries, // uint64 count + 1, into parts
+		Parts, // uint64 parts + 1, into rings
+		Rings, // uint64 rings + 1, into points
+		Points, // Point
+		Boxes, // BBox per shape
+		Nodes, // BBox per tree node
+		Indices, // uint64 per tree node, shape for leaves, first child for the others
+		Sections
+	};
+
+	struct Header {
+		char magic[4] = {'S', 'G', 'S', 'T'};
+		uint32_t version = 1;
+		uint64_t count = 0;
+		uint64_t parts = 0;
+		uint64_t rings = 0;
+		uint64_t points = 0;
+		uint64_t items = 0; // Shapes in the tree, the non-empty ones
+		uint64_t nodes = 0; // 0 without a tree
+		uint64_t nodeSize = 0;
+		BBox bounds = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+		uint64_t offsets[Sections] = {};
+		uint64_t sizes[Sections] = {};
+	};
+
+	struct Options {
+		uint16_t nodeSize = 16; // 0 writes no tree
+	};
+
+	/*
+
+	Write
+	Bboxes are computed from the points, the tree is an index::Packed over the non-empty Shapes
+	with leaves pointing at Shape positions.
+
+	*/
+
+	bool write(const std::string& path, const wkt::Columns& columns, const Options& options = {}) {
+		std::ofstream out(path, std::ios::binary);
+		if (!out.is_open()) {
+			std::cerr << "Error opening " << path << std::endl;
+			return false;
+		}
+
+		Header header;
+		header.count = columns.size();
+		header.parts = columns.parts.size() - 1;
+		header.rings = columns.rings.size() - 1;
+		header.points = columns.points.size();
+
+		std::vector<BBox> boxes(columns.size(), header.bounds);
+		std::vector<size_t> ids;
+		for (size_t i = 0; i < columns.size(); ++i) {
+			size_t first = columns.rings[columns.parts[columns.geometries[i]]];
+			size_t last = columns.rings[columns.parts[columns.geometries[i + 1]]];
+			BBox& box = boxes[i];
+			for (size_t p = first; p < last; ++p) {
+				const Point& point = columns.points[p];
+				box[0] = std::min(box[0], point.x);
+				box[1] = std::min(box[1], point.y);
+				box[2] = std::max(box[2], point.x);
+				box[3] = std::max(box[3], point.y);
+			}
+			if (first != last) {
+				ids.push_back(i);
+				header.bounds[0] = std::min(header.bounds[0], box[0]);
+				header.bounds[1] = std::min(header.bounds[1], box[1]);
+				header.bounds[2] = std::max(header.bounds[2], box[2]);
+				header.bounds[3] = std::max(header.bounds[3], box[3]);
+			}
+		}
+
+		index::Packed tree(options.nodeSize != 0 ? ids.size() : 0, std::max<uint16_t>(options.nodeSize, 2));
+		if (options.nodeSize != 0) {
+			for (size_t id : ids) {
+				tree.add(boxes[id]);
+			}
+			tree.finish();
+			for (size_t pos = 0; pos < tree.size; ++pos) {
+				tree.indices[pos] = ids[tree.indices[pos]];
+			}
+			header.items = tree.size;
+			header.nodes = tree.boxes.size();
+			header.nodeSize = header.nodes != 0 ? tree.nodeSize : 0;
+		}
+
+		const void* data[Sections] = {columns.types.data(), columns.geometries.data(), columns.parts.data(), columns.rings.data(), columns.points.data(), boxes.data(), tree.boxes.data(), tree.indices.data()};
+		header.sizes[Types] = columns.types.size();
+		header.sizes[Geometries] = columns.geometries.size() * sizeof(uint64_t);
+		header.sizes[Parts] = columns.parts.size() * sizeof(uint64_t);
+		header.sizes[Rings] = columns.rings.size() * sizeof(uint64_t);
+		header.sizes[Points] = columns.points.size() * sizeof(Point);
+		header.sizes[Boxes] = boxes.size() * sizeof(BBox);
+		header.sizes[Nodes] = header.nodes * sizeof(BBox);
+		header.sizes[Indices] = header.nodes * sizeof(uint64_t);
+
+		uint64_t offset = sizeof(Header);
+		for (size_t s = 0; s < Sections; ++s) {
+			offset = (offset + 63) / 64 * 64;
+			header.offsets[s] = offset;
+			offset += header.sizes[s];
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		uint64_t written = sizeof(Header);
+		const char zeros[64] = {};
+		for (size_t s = 0; s < Sections; ++s) {
+			out.write(zeros, static_cast<std::streamsize>(header.offsets[s] - written));
+			out.write(static_cast<const char*>(data[s]), static_cast<std::streamsize>(header.sizes[s]));
+			written = header.offsets[s] + header.sizes[s];
+		}
+		return out.good();
+	}
+
+	bool write(const std::string& path, const std::vector<Shape>& shapes, const Options& options = {}) {
+		wkt::Columns columns;
+		for (const Shape& shape : shapes) {
+			columns.add(shape);
+		}
+		return write(path, columns, options);
+	}
+
+	/*
+
+	View
+	Read-only Shape in the mapping: parts, rings as spans of points, bbox.
+	Valid as long as the Store it came from. shape() copies it out into a Shape.
+
+	*/
+
+	class View {
+	public:
+		const uint8_t typeID;
+		const BBox& bbox;
+
+		View(uint8_t typeID, const BBox& bbox, std::span<const uint64_t> parts, const uint64_t* rings, const Point* points) : typeID(typeID), bbox(bbox), partOffsets(parts), ringOffsets(rings), points(points) {}
+
+		std::string_view type() const {
+			static const std::string_view names[] = {"Dummy", "Point", "Line", "MultiLine", "Polygon", "MultiPolygon"};
+			return typeID < 6 ? names[typeID] : names[0];
+		}
+
+		bool empty() const {
+			return parts() == 0;
+		}
+
+		size_t parts() const {
+			return partOffsets.size() - 1;
+		}
+
+		// Rings of a part, a line is a part with one ring
+		size_t rings(size_t part) const {
+			return partOffsets[part + 1] - partOffsets[part];
+		}
+
+		std::span<const Point> ring(size_t part, size_t ring = 0) const {
+			size_t index = partOffsets[part] + ring;
+			return {points + ringOffsets[index], points + ringOffsets[index + 1]};
+		}
+
+		// Even-odd over every ring, holes and parts included, false for anything but polygons
+		bool contains(const Point& point) const {
+			if ((typeID != 4 && typeID != 5) || point.x < bbox[0] || point.x > bbox[2] || point.y < bbox[1] || point.y > bbox[3]) {
+				return false;
+			}
+
+			bool inside = false;
+			for (uint64_t r = partOffsets.front(); r < partOffsets.back(); ++r) {
+				std::span<const Point> coords = {points + ringOffsets[r], points + ringOffsets[r + 1]};
+				for (size_t i = 0, j = coords.size() - 1; i < coords.size(); j = i++) {
+					const Point& a = coords[i];
+					const Point& b = coords[j];
+					if ((a.y > point.y) != (b.y > point.y) && point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x) {
+						inside = !inside;
+					}
+				}
+			}
+			return inside;
+		}
+
+		Shape shape() const {
+			auto coords = [this](size_t part, size_t ring) {
+				std::span<const Point> span = this->ring(part, ring);
+				return Coords(span.begin(), span.end());
+			};
+			auto polygon = [&](size_t part) {
+				types::Polygon poly;
+				for (size_t r = 0; r < rings(part); ++r) {
+					if (r == 0) {
+						poly.outer.coords = coords(part, r);
+					} else {
+						poly.inner.coords = coords(part, r);
+					}
+				}
+				return poly;
+			};
+
+			if (empty()) {
+				return Shape();
+			}
+
+			switch (typeID) {
+				case 1: {
+					types::Point point;
+					point.x = ring(0).front().x;
+					point.y = ring(0).front().y;
+					return Shape(point);
+				}
+				case 2: {
+					types::Line line;
+					line.coords = coords(0, 0);
+					return Shape(std::move(line));
+				}
+				case 3: {
+					types::MultiLine multiLine;
+					for (size_t part = 0; part < parts(); ++part) {
+						types::Line line;
+						line.coords = coords(part, 0);
+						multiLine.items.push_back(std::move(line));
+					}
+					return Shape(std::move(multiLine));
+				}
+				case 4:
+					return Shape(polygon(0));
+				case 5: {
+					types::MultiPolygon multiPolygon;
+					for (size_t part = 0; part < parts(); ++part) {
+						multiPolygon.items.push_back(polygon(part));
+					}
+					return Shape(std::move(multiPolygon));
+				}
+			}
+			return Shape();
+		}
+
+	private:
+		std::span<const uint64_t> partOffsets; // Offsets of this shape's parts into rings, one past the last included
+		const uint64_t* ringOffsets;
+		const Point* points;
+	};
+
+	/*
+
+	Store
+	Opens a file written by write(). The header and section bounds are checked on open,
+	the offsets themselves only by verify(), which reads every one of them.
+
+	*/
+
+	class Store {
+	public:
+		Header header;
+
+		Store(const std::string& path) : file(path, false) {
+			if (file.empty()) {
+				return;
+			}
+			if (file.size() < sizeof(Header)) {
+				throw std::runtime_error("Store: invalid file");
+			}
+			std::memcpy(&header, file.data(), sizeof(Header));
+			if (std::memcmp(header.magic, "SGST", 4) != 0 || header.version != 1) {
+				throw std::runtime_error("Store: invalid file");
+			}
+
+			uint64_t expected[Sections] = {header.count, (header.count + 1) * sizeof(uint64_t), (header.parts + 1) * sizeof(uint64_t), (header.rings + 1) * sizeof(uint64_t), header.points * sizeof(Point), header.count * sizeof(BBox), header.nodes * sizeof(BBox), header.nodes * sizeof(uint64_t)};
+			for (size_t s = 0; s < Sections; ++s) {
+				if (header.sizes[s] != expected[s] || header.offsets[s] % 64 != 0 || header.offsets[s] > file.size() || header.sizes[s] > file.size() - header.offsets[s]) {
+					throw std::runtime_error("Store: section out of bounds");
+				}
+			}
+
+			types = section<uint8_t>(Types);
+			geometries = section<uint64_t>(Geometries);
+			parts = section<uint64_t>(Parts);
+			rings = section<uint64_t>(Rings);
+			points = section<Point>(Points);
+			boxes = section<BBox>(Boxes);
+			nodes = section<BBox>(Nodes);
+			indices = section<uint64_t>(Indices);
+
+			if (geometries[header.count] != header.parts || parts[header.parts] != header.rings || rings[header.rings] != header.points) {
+				throw std::runtime_error("Store: invalid offsets");
+			}
+
+			if (header.nodes != 0) {
+				uint64_t count = header.items;
+				uint64_t total = count;
+				levels.push_back(total);
+				if (header.nodeSize < 2) {
+					throw std::runtime_error("Store: invalid index");
+				}
+				do {
+					count = (count + header.nodeSize - 1) / header.nodeSize;
+					total += count;
+					levels.push_back(total);
+				} while (count != 1);
+				if (total != header.nodes) {
+					throw std::runtime_error("Store: invalid index");
+				}
+			}
+		}
+
+		size_t size() const {
+			return types == nullptr ? 0 : header.count;
+		}
+
+		bool indexed() const {
+			return header.nodes != 0;
+		}
+
+		View operator[](size_t index) const {
+			uint64_t first = geometries[index];
+			return View(types[index], boxes[index], {parts + first, geometries[index + 1] - first + 1}, rings, points);
+		}
+
+		const BBox& bbox(size_t index) const {
+			return boxes[index];
+		}
+
+		Shape shape(size_t index) const {
+			return (*this)[index].shape();
+		}
+
+		std::vector<Shape> read() const {
+			std::vector<Shape> result;
+			result.reserve(size());
+			for (size_t i = 0; i < size(); ++i) {
+				result.push_back(shape(i));
+			}
+			return result;
+		}
+
+		/*
+
+		Search
+		visit(index) for every Shape whose bbox intersects the query, the walk of index::Packed::search
+		over the mapped nodes. If visit returns bool, false stops the search.
+		Without a tree every bbox is tested.
+
+		*/
+
+		template <typename Visitor>
+		void search(const BBox& query, Visitor&& visit) const {
+			auto call = [&visit](size_t index) {
+				if constexpr (std::is_same_v<std::invoke_result_t<Visitor, size_t>, bool>) {
+					return visit(index);
+				} else {
+					visit(index);
+					return true;
+				}
+			};
+
+			if (!indexed()) {
+				for (size_t i = 0; i < size(); ++i) {
+					if (index::intersects(query, boxes[i]) && !call(i)) {
+						return;
+					}
+				}
+				return;
+			}
+
+			// Pairs of node position and level
+			std::vector<uint64_t> stack;
+			uint64_t node = header.nodes - 1;
+			size_t level = levels.size() - 1;
+
+			while (true) {
+				uint64_t end = std::min<uint64_t>(node + header.nodeSize, levels[level]);
+
+				for (uint64_t pos = node; pos < end; ++pos) {
+					if (!index::intersects(query, nodes[pos])) {
+						continue;
+					}
+
+					if (node < header.items) {
+						if (!call(static_cast<size_t>(indices[pos]))) {
+							return;
+						}
+					} else {
+						stack.push_back(indices[pos]);
+						stack.push_back(level - 1);
+					}
+				}
+
+				if (stack.empty()) {
+					break;
+				}
+
+				level = static_cast<size_t>(stack.back());
+				stack.pop_back();
+				node = stack.back();
+				stack.pop_back();
+			}
+		}
+
+		std::vector<size_t> search(const BBox& query) const {
+			std::vector<size_t> result;
+			search(query, [&result](size_t index) {
+				result.push_back(index);
+			});
+			return result;
+		}
+
+		// Polygons containing point, through the tree
+		std::vector<size_t> containing(const Point& point) const {
+			std::vector<size_t> result;
+			search({point.x, point.y, point.x, point.y}, [&](size_t index) {
+				if ((*this)[index].contains(point)) {
+					result.push_back(index);
+				}
+			});
+			return result;
+		}
+
+		/*
+
+		Verify
+		Every offset in range and non-decreasing, every tree link inside the tree.
+		For files that may have been truncated or tampered with, before trusting the Views.
+
+		*/
+
+		bool verify() const {
+			auto sorted = [](const uint64_t* offsets, uint64_t count, uint64_t total) {
+				if (offsets[0] != 0) {
+					return false;
+				}
+				for (uint64_t i = 0; i < count; ++i) {
+					if (offsets[i] > offsets[i + 1]) {
+						return false;
+					}
+				}
+				return offsets[count] == total;
+			};
+
+			if (!sorted(geometries, header.count, header.parts) || !sorted(parts, header.parts, header.rings) || !sorted(rings, header.rings, header.points)) {
+				return false;
+			}
+			for (uint64_t pos = 0; pos < header.items; ++pos) {
+				if (indices[pos] >= header.count) {
+					return false;
+				}
+			}
+			for (size_t level = 1; level < levels.size(); ++level) {
+				uint64_t children = level > 1 ? levels[level - 2] : 0;
+				for (uint64_t pos = levels[level - 1]; pos < levels[level]; ++pos) {
+					if (indices[pos] < children || indices[pos] >= levels[level - 1]) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+	private:
+		surfy::utils::MappedFile file;
+		const uint8_t* types = nullptr;
+		const uint64_t* geometries = nullptr;
+		const uint64_t* parts = nullptr;
+		const uint64_t* rings = nullptr;
+		const Point* points = nullptr;
+		const BBox* boxes = nullptr;
+		const BBox* nodes = nullptr;
+		const uint64_t* indices = nullptr;
+		std::vector<uint64_t> levels; // End position of every level, leaves first
+
+		// Sections are 64-byte aligned in a page-aligned mapping, so they are read in place
+		template <typename T>
+		const T* section(Section s) const {
+			return reinterpret_cast<const T*>(file.data() + header.offsets[s]);
+		}
+	};
+}
+
+#endif
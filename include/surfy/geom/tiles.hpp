@@ -0,0 +1,481 @@
+#ifndef SURFY_GEOM_TILES_HPP
+#define SURFY_GEOM_TILES_HPP
+
+/*
+
+Tiles
+Web Mercator tile math and vector tile pyramid builder.
+Shapes are added in lon/lat (EPSG:4326), projected once to EPSG:3857,
+then clipped, simplified and encoded per tile on a work-stealing pool.
+
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "geom.hpp"
+#include "filter.hpp"
+#include "mvt.hpp"
+#include "pool.hpp"
+
+namespace surfy::geom::tiles {
+
+	// Half of the Web Mercator world width in meters
+	constexpr double R = 20037508.342789244;
+	constexpr double MAX_LAT = 85.0511287798066;
+	constexpr double PI = 3.14159265358979323846;
+
+	struct TileID {
+		uint32_t z, x, y;
+
+		uint64_t key() const {
+			return (static_cast<uint64_t>(z) << 58) | (static_cast<uint64_t>(x) << 29) | y;
+		}
+
+		bool operator==(const TileID& other) const {
+			return z == other.z && x == other.x && y == other.y;
+		}
+
+		bool operator<(const TileID& other) const {
+			return key() < other.key();
+		}
+	};
+
+	/*
+
+	Mercator
+	Lon/Lat to EPSG:3857 meters, latitude is clamped to the square world
+
+	*/
+
+	Point mercator(const Point& p) {
+		double lat = std::clamp(p.y, -MAX_LAT, MAX_LAT);
+		return {
+			p.x * R / 180.,
+			std::log(std::tan(PI / 4. + lat * PI / 360.)) * R / PI
+		};
+	}
+
+	void mercator(Coords& coords) {
+		for (Point& p : coords) {
+			p = mercator(p);
+		}
+	}
+
+	// Project Shape in place and update its bbox
+	void project(Shape& shape) {
+		if (shape.type == "Point") {
+			Point p = mercator(shape.geom.point);
+			shape.geom.point.x = p.x;
+			shape.geom.point.y = p.y;
+		} else if (shape.type == "Line") {
+			mercator(shape.geom.line.coords);
+		} else if (shape.type == "MultiLine") {
+			for (types::Line& line : shape.geom.multiLine.items) {
+				mercator(line.coords);
+			}
+		} else if (shape.type == "Polygon") {
+			mercator(shape.geom.polygon.outer.coords);
+			mercator(shape.geom.polygon.inner.coords);
+		} else if (shape.type == "MultiPolygon") {
+			for (types::Polygon& poly : shape.geom.multiPolygon.items) {
+				mercator(poly.outer.coords);
+				mercator(poly.inner.coords);
+			}
+		}
+		shape.refresh();
+	}
+
+	// Tile width in meters at zoom
+	double size(uint32_t z) {
+		return 2. * R / static_cast<double>(1ULL << z);
+	}
+
+	// Tile bounds in EPSG:3857, XYZ scheme (Y counts from the top)
+	BBox bbox(const TileID& tile) {
+		double side = size(tile.z);
+		double minX = -R + tile.x * side;
+		double maxY = R - tile.y * side;
+		return {minX, maxY - side, minX + side, maxY};
+	}
+
+	/*
+
+	Buffered BBox
+	Tile bounds expanded by buffer, given in tile extent units like MVT coordinates.
+	Clipping to it keeps strokes and outlines continuous across tile edges.
+
+	*/
+
+	BBox bbox(const TileID& tile, uint32_t extent, uint32_t buffer) {
+		BBox box = bbox(tile);
+		double margin = size(tile.z) * buffer / extent;
+		return {box[0] - margin, box[1] - margin, box[2] + margin, box[3] + margin};
+	}
+
+	// Square pixel in EPSG:3857 at zoom, for tiles rendered at pixels wide
+	double pixelArea(uint32_t z, uint32_t pixels = 256) {
+		double side = size(z) / pixels;
+		return side * side;
+	}
+
+	/*
+
+	Range
+	Tiles covered by a bbox in EPSG:3857: [minX, minY, maxX, maxY] in tile numbers
+
+	*/
+
+	std::array<uint32_t, 4> range(const BBox& box, uint32_t z) {
+		double side = size(z);
+		int64_t last = (1LL << z) - 1;
+
+		auto clamp = [last](double value) {
+			return static_cast<uint32_t>(std::clamp<int64_t>(static_cast<int64_t>(std::floor(value)), 0, last));
+		};
+
+		return {
+			clamp((box[0] + R) / side),
+			clamp((R - box[3]) / side),
+			clamp((box[2] + R) / side),
+			clamp((R - box[1]) / side)
+		};
+	}
+
+	/*
+
+	Pyramid
+
+	*/
+
+	struct Options {
+		uint32_t minZoom = 0;
+		uint32_t maxZoom = 14;
+		uint32_t extent = 4096;
+		uint32_t buffer = 64; // Clip margin around every tile in extent units
+		double tolerance = 1.; // Douglas-Peucker tolerance in tile extent units, scaled per zoom
+		Budget budget; // Max vertices or bytes per tile, raises tolerance when exceeded
+		double tiny = 0.; // Below maxZoom drop polygons under this area in square pixels of a 256px tile, 0 keeps all
+		filter::Mode tinyMode = filter::Drop;
+		std::string layer = "default";
+	};
+
+	struct Stats {
+		size_t tiles = 0; // Tiles emitted, tiles left without features after filtering aren't written or counted
+		size_t features = 0;
+		filter::Stats dropped; // Tiny features, summed over all tiles
+	};
+
+	class Pyramid {
+	public:
+		Options options;
+
+		// Tiles are built on workers, the library's shared pool unless given one
+		Pyramid(const Options& options = {}, pool::Pool& workers = pool::shared()) : options(options), workers(workers) {}
+
+		/*
+
+		Add Shape
+		Lon/Lat Shapes are projected to EPSG:3857, pass projected = true if already done
+
+		*/
+
+		void add(const Shape& shape, const mvt::Properties& properties = {}, uint64_t id = 0, bool projected = false) {
+			if (shape.empty) {
+				return;
+			}
+
+			features.push_back({shape, properties, id});
+			if (!projected) {
+				project(features.back().shape);
+			}
+		}
+
+		size_t size() const {
+			return features.size();
+		}
+
+		/*
+
+		Build
+		Clips every feature to the buffered minZoom tiles, then descends: children are clipped
+		from their parent's clipped geometry instead of the original (overzoom reuse), so deep
+		zooms only touch the few vertices left in the parent tile.
+		emit(tile, pbf) is called from worker threads and must be thread-safe.
+		If emit throws, tiles not yet started are skipped and build rethrows the first exception.
+
+		*/
+
+		Stats build(const std::function<void(const TileID&, std::string&&)>& emit) {
+			std::atomic<size_t> tilesCount{0};
+			std::atomic<size_t> featuresCount{0};
+			filter::Stats dropped;
+			std::mutex droppedMutex;
+
+			pool::Group group;
+
+			std::function<void(const TileID&, std::shared_ptr<std::vector<Clipped>>)> process;
+			process = [&](const TileID& id, std::shared_ptr<std::vector<Clipped>> items) {
+				size_t encoded = 0;
+				filter::Stats filtered;
+				std::string pbf = encode(id, *items, encoded, filtered);
+				if (filtered.features + filtered.parts + filtered.collapsed != 0) {
+					std::lock_guard<std::mutex> lock(droppedMutex);
+					dropped += filtered;
+				}
+
+				if (encoded != 0) {
+					tilesCount.fetch_add(1);
+					featuresCount.fetch_add(encoded);
+					emit(id, std::move(pbf));
+				}
+
+				if (id.z >= options.maxZoom) {
+					return;
+				}
+
+				for (uint32_t i = 0; i < 4; ++i) {
+					TileID child = {id.z + 1, id.x * 2 + (i & 1), id.y * 2 + (i >> 1)};
+					auto clipped = std::make_shared<std::vector<Clipped>>(descend(child, *items));
+					if (!clipped->empty()) {
+						workers.submit(group, [&process, child, clipped]() {
+							process(child, clipped);
+						});
+					}
+				}
+			};
+
+			for (auto& [id, items] : assign()) {
+				auto clipped = std::make_shared<std::vector<Clipped>>(std::move(items));
+				workers.submit(group, [&process, id, clipped]() {
+					process(id, clipped);
+				});
+			}
+			workers.wait(group);
+
+			return {tilesCount.load(), featuresCount.load(), dropped};
+		}
+
+		// Directory of {dir}/{z}/{x}/{y}.pbf files
+		Stats write(const std::string& dir) {
+			return build([&dir](const TileID& tile, std::string&& pbf) {
+				std::filesystem::path folder = std::filesystem::path(dir) / std::to_string(tile.z) / std::to_string(tile.x);
+				std::filesystem::create_directories(folder);
+				std::ofstream file(folder / (std::to_string(tile.y) + ".pbf"), std::ios::binary);
+				file.write(pbf.data(), pbf.size());
+			});
+		}
+
+		/*
+
+		Archive
+		Single file: tile blobs, then a directory sorted by z/x/y, then a footer.
+		Directory entry: uint8 z, uint32 x, uint32 y, uint64 offset, uint32 length.
+		Footer: uint64 directory offset, uint64 entries, "SGTA". Little-endian.
+
+		*/
+
+		Stats archive(const std::string& path) {
+			struct Entry {
+				TileID tile;
+				uint64_t offset;
+				uint32_t length;
+			};
+
+			std::ofstream file(path, std::ios::binary);
+			if (!file.is_open()) {
+				std::cerr << "Error opening archive. " << path << std::endl;
+				return {};
+			}
+
+			std::vector<Entry> entries;
+			uint64_t offset = 0;
+			std::mutex mutex;
+
+			Stats stats = build([&](const TileID& tile, std::string&& pbf) {
+				std::lock_guard<std::mutex> lock(mutex);
+				file.write(pbf.data(), pbf.size());
+				entries.push_back({tile, offset, static_cast<uint32_t>(pbf.size())});
+				offset += pbf.size();
+			});
+
+			std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+				return a.tile < b.tile;
+			});
+
+			auto put = [&file](auto value) {
+				file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+			};
+
+			for (const Entry& entry : entries) {
+				put(static_cast<uint8_t>(entry.tile.z));
+				put(entry.tile.x);
+				put(entry.tile.y);
+				put(entry.offset);
+				put(entry.length);
+			}
+			put(offset);
+			put(static_cast<uint64_t>(entries.size()));
+			file.write("SGTA", 4);
+
+			return stats;
+		}
+
+	private:
+		struct Feature {
+			Shape shape;
+			mvt::Properties properties;
+			uint64_t id;
+		};
+
+		std::vector<Feature> features;
+		pool::Pool& workers;
+
+		// Feature geometry clipped to a buffered tile
+		struct Clipped {
+			uint32_t index;
+			Shape shape;
+			bool tiny = false; // Under the tile threshold, kept unclipped for the children
+		};
+
+		BBox buffered(const TileID& id) const {
+			return bbox(id, options.extent, options.buffer);
+		}
+
+		// Tiny polygon area at zoom, maxZoom keeps everything
+		double threshold(uint32_t z) const {
+			return (options.tiny > 0 && z < options.maxZoom) ? options.tiny * pixelArea(z) : .0;
+		}
+
+		/*
+
+		Clip to a tile, Shapes inside the box are copied as is.
+		Tiny Shapes skip clipping: they won't be drawn at this zoom and are cheap for the children.
+
+		*/
+
+		bool clip(const Shape& source, const BBox& box, std::vector<Clipped>& items, uint32_t index, uint32_t z) const {
+			const BBox& b = source.bbox;
+			if (b[2] < box[0] || b[0] > box[2] || b[3] < box[1] || b[1] > box[3]) {
+				return false;
+			}
+
+			double area = threshold(z);
+			if (area > 0 && filter::Tiny(area).below(source)) {
+				items.push_back({index, source, true});
+				return true;
+			}
+
+			items.push_back({index, source});
+			Shape& shape = items.back().shape;
+			shape.clip(box);
+			if (shape.empty) {
+				items.pop_back();
+				return false;
+			}
+			return true;
+		}
+
+		// MinZoom tiles with features clipped from the originals, in z/x/y order
+		std::vector<std::pair<TileID, std::vector<Clipped>>> assign() const {
+			std::unordered_map<uint64_t, size_t> index;
+			std::vector<std::pair<TileID, std::vector<Clipped>>> jobs;
+			uint32_t z = options.minZoom;
+			double margin = tiles::size(z) * options.buffer / options.extent;
+
+			for (uint32_t i = 0; i < features.size(); ++i) {
+				const Shape& shape = features[i].shape;
+				const BBox& b = shape.bbox;
+				std::array<uint32_t, 4> tiles = range({b[0] - margin, b[1] - margin, b[2] + margin, b[3] + margin}, z);
+
+				for (uint32_t x = tiles[0]; x <= tiles[2]; ++x) {
+					for (uint32_t y = tiles[1]; y <= tiles[3]; ++y) {
+						TileID tile = {z, x, y};
+						auto [it, inserted] = index.try_emplace(tile.key(), jobs.size());
+						if (inserted) {
+							jobs.push_back({tile, {}});
+						}
+						clip(shape, buffered(tile), jobs[it->second].second, i, z);
+					}
+				}
+			}
+
+			std::sort(jobs.begin(), jobs.end(), [](const auto& a, const auto& b) {
+				return a.first < b.first;
+			});
+
+			return jobs;
+		}
+
+		// Child buffered box lies inside the parent's one, so parent geometry is enough
+		std::vector<Clipped> descend(const TileID& child, const std::vector<Clipped>& parent) const {
+			std::vector<Clipped> items;
+			BBox box = buffered(child);
+			for (const Clipped& item : parent) {
+				clip(item.shape, box, items, item.index, child.z);
+			}
+			return items;
+		}
+
+		std::string encode(const TileID& id, const std::vector<Clipped>& items, size_t& encoded, filter::Stats& dropped) const {
+			double tolerance = options.tolerance * tiles::size(id.z) / options.extent;
+
+			mvt::Tile tile(bbox(id), options.extent);
+			mvt::Layer& layer = tile.layer(options.layer);
+
+			// Tiny features go before any simplify work
+			filter::Tiny tiny(threshold(id.z), options.tinyMode, bbox(id));
+			std::vector<Clipped> shapes;
+			shapes.reserve(items.size());
+			for (const Clipped& item : items) {
+				if (item.tiny && tiny.mode == filter::Drop) {
+					++tiny.stats.features;
+					tiny.stats.vertices += item.shape.vertices;
+					continue;
+				}
+
+				shapes.push_back({item.index, item.shape});
+				if (tiny.area > 0 && !tiny.apply(shapes.back().shape)) {
+					shapes.pop_back();
+				}
+			}
+			dropped = tiny.stats;
+
+			// Per tile budget: raise the tolerance until the whole tile fits
+			std::vector<Significance> weights;
+			size_t limit = options.budget.limit();
+			if (limit != 0) {
+				std::vector<const Significance*> probes;
+				weights.reserve(shapes.size());
+				for (const Clipped& item : shapes) {
+					probes.push_back(&weights.emplace_back(item.shape));
+				}
+				tolerance = std::max(tolerance, Significance::search(probes, limit));
+			}
+
+			for (size_t i = 0; i < shapes.size(); ++i) {
+				Shape& shape = shapes[i].shape;
+				const Feature& feature = features[shapes[i].index];
+
+				if (limit != 0) {
+					weights[i].apply(shape, tolerance);
+				} else if (tolerance > 0) {
+					shape.simplify(tolerance);
+				}
+
+				if (layer.add(shape, feature.properties, feature.id)) {
+					++encoded;
+				}
+			}
+
+			return tile.serialize();
+		}
+	};
+}
+
+#endif
@@ -17,6 +17,17 @@ namespace surfy::geom::utils {
 		return (front.x == back.x && front.y == back.y);
 	}
 
+	/*
+
+	Mask
+	Counterclockwise clip mask from BBox: BottomLeft, BottomRight, TopRight, TopLeft
+
+	*/
+
+	Coords mask(const BBox& bbox) {
+		return {{bbox[0], bbox[1]}, {bbox[2], bbox[1]}, {bbox[2], bbox[3]}, {bbox[0], bbox[3]}};
+	}
+
 	BBox bbox(const Coords& coords) {
 		
 		if (coords.empty()) {
@@ -105,15 +116,16 @@ namespace surfy::geom::utils {
 	*/
 
 	float area(const Coords& coords, size_t size = 0) {
-		float area = .0;
+		// Signed sum, so concave rings don't count folds twice
+		double area = .0;
 		if (size == 0) {
 			size = coords.size();
 		}
 		for (int i = 0; i < size; ++i) {
 			int j = (i + 1) % size;
-			area += std::fabs(coords[i].x * coords[j].y - coords[j].x * coords[i].y);
+			area += coords[i].x * coords[j].y - coords[j].x * coords[i].y;
 		}
-		return area / 2;
+		return std::fabs(area) / 2;
 	}
 
 	/*
@@ -228,11 +240,46 @@ namespace surfy::geom::utils {
 
 	/*
 
+	Distance from Point to Line
+	Closest segment by the same projection as maxDistance, closed adds the last to first segment of a ring
+
+	*/
+
+	double distance(const Point& point, const Coords& coords, const bool& closed) {
+		size_t size = coords.size();
+		if (size == 0) {
+			return std::numeric_limits<double>::infinity();
+		}
+
+		if (size == 1) {
+			return distance(point, coords[0]);
+		}
+
+		double dist = std::numeric_limits<double>::infinity();
+		for (size_t i = 0; i + 1 < size; ++i) {
+			dist = std::min(dist, maxDistance(coords[i], coords[i + 1], point));
+		}
+
+		if (closed) {
+			dist = std::min(dist, maxDistance(coords[size - 1], coords[0], point));
+		}
+
+		return dist;
+	}
+
+	/*
+
 	Douglas-Peucker simplification algorithm
 
 	*/
 
 	void simplify(const Coords& points, const double& epsilon, Coords& simplified) {
+		if (points.size() < 3) {
+			// Nothing to simplify, e.g. a ring emptied by clip
+			simplified.insert(simplified.end(), points.begin(), points.end());
+			return;
+		}
+
 		// Find the point with the maximum distance
 		double maxDist = 0;
 		int index = 0;
@@ -265,6 +312,65 @@ namespace surfy::geom::utils {
 		}
 	}
 
+	/*
+
+	Significance
+	Douglas-Peucker run once, recording for every vertex the tolerance below which it is kept.
+	Weights are capped by the parent split, so keeping weights > epsilon
+	gives exactly what simplify(points, epsilon) returns. Endpoints never go away.
+
+	*/
+
+	void significance(const Coords& points, std::vector<double>& weights) {
+		size_t size = points.size();
+		weights.assign(size, .0);
+		if (size == 0) {
+			return;
+		}
+
+		weights[0] = std::numeric_limits<double>::infinity();
+		weights[size - 1] = std::numeric_limits<double>::infinity();
+
+		struct Range {
+			size_t first, last;
+			double weight;
+		};
+
+		std::vector<Range> stack = {{0, size - 1, std::numeric_limits<double>::infinity()}};
+		while (!stack.empty()) {
+			Range range = stack.back();
+			stack.pop_back();
+
+			double maxDist = 0;
+			size_t index = 0;
+			for (size_t i = range.first + 1; i < range.last; ++i) {
+				double dist = maxDistance(points[range.first], points[range.last], points[i]);
+				if (dist > maxDist) {
+					maxDist = dist;
+					index = i;
+				}
+			}
+
+			if (index == 0) {
+				continue;
+			}
+
+			double weight = std::min(maxDist, range.weight);
+			weights[index] = weight;
+			stack.push_back({range.first, index, weight});
+			stack.push_back({index, range.last, weight});
+		}
+	}
+
+	// Keep vertices more significant than tolerance
+	void filter(const Coords& points, const std::vector<double>& weights, const double& tolerance, Coords& filtered) {
+		for (size_t i = 0; i < points.size(); ++i) {
+			if (weights[i] > tolerance) {
+				filtered.push_back(points[i]);
+			}
+		}
+	}
+
 }
 
 #endif
\ No newline at end of file
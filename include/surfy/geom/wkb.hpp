@@ -0,0 +1,300 @@
+#ifndef SURFY_GEOM_WKB_HPP
+#define SURFY_GEOM_WKB_HPP
+
+/*
+
+WKB
+Well-known binary to Shape and back. Reads either byte order, ISO (1001, 2001, 3001) and EWKB (high bits)
+Z and M flags, and an EWKB SRID, extra ordinates are skipped. Writes little-endian 2D.
+MultiPoint and GeometryCollection have no Shape type and give an empty Shape.
+
+*/
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include "geom.hpp"
+
+namespace surfy::geom::wkb {
+
+	enum Type : uint32_t {
+		Point = 1,
+		LineString = 2,
+		Polygon = 3,
+		MultiPoint = 4,
+		MultiLineString = 5,
+		MultiPolygon = 6,
+		GeometryCollection = 7
+	};
+
+	namespace reader {
+
+		struct Cursor {
+			const uint8_t* at;
+			const uint8_t* end;
+			bool swap = false;
+			size_t dimensions = 2;
+
+			void need(size_t bytes) const {
+				if (bytes > static_cast<size_t>(end - at)) {
+					throw std::runtime_error("WKB: truncated geometry");
+				}
+			}
+
+			uint8_t byte() {
+				need(1);
+				return *at++;
+			}
+
+			uint32_t u32() {
+				need(4);
+				uint32_t value;
+				std::memcpy(&value, at, 4);
+				at += 4;
+				return swap ? __builtin_bswap32(value) : value;
+			}
+
+			double f64() {
+				need(8);
+				uint64_t bits;
+				std::memcpy(&bits, at, 8);
+				at += 8;
+				if (swap) {
+					bits = __builtin_bswap64(bits);
+				}
+				double value;
+				std::memcpy(&value, &bits, 8);
+				return value;
+			}
+
+			// Count of items of at least bytes each, checked against what is left
+			uint32_t count(size_t bytes) {
+				uint32_t n = u32();
+				need(static_cast<size_t>(n) * bytes);
+				return n;
+			}
+
+			// Byte order and type, sets swap and dimensions, returns the 2D type
+			uint32_t header() {
+				uint8_t order = byte();
+				if (order > 1) {
+					throw std::runtime_error("WKB: invalid byte order");
+				}
+				swap = (order == 1) != (std::endian::native == std::endian::little);
+
+				uint32_t type = u32();
+				bool z = type & 0x80000000;
+				bool m = type & 0x40000000;
+				if (type & 0x20000000) {
+					u32(); // SRID
+				}
+				type &= 0x0FFFFFFF;
+				z = z || type / 1000 == 1 || type / 1000 == 3;
+				m = m || type / 1000 == 2 || type / 1000 == 3;
+				dimensions = 2 + z + m;
+				return type % 1000;
+			}
+
+			surfy::geom::Point point() {
+				surfy::geom::Point p;
+				p.x = f64();
+				p.y = f64();
+				for (size_t i = 2; i < dimensions; ++i) {
+					f64();
+				}
+				return p;
+			}
+
+			Coords coords() {
+				uint32_t n = count(dimensions * 8);
+				Coords result;
+				result.reserve(n);
+				for (uint32_t i = 0; i < n; ++i) {
+					result.push_back(point());
+				}
+				return result;
+			}
+
+			// First ring outer, like Shape(std::string) a later ring is the hole
+			types::Polygon polygon() {
+				types::Polygon poly;
+				uint32_t rings = count(4);
+				for (uint32_t r = 0; r < rings; ++r) {
+					if (r == 0) {
+						poly.outer.coords = coords();
+					} else {
+						poly.inner.coords = coords();
+					}
+				}
+				return poly;
+			}
+
+			Shape geometry() {
+				switch (header()) {
+					case Point: {
+						surfy::geom::Point p = point();
+						if (std::isnan(p.x) || std::isnan(p.y)) {
+							return Shape();
+						}
+						types::Point item;
+						item.x = p.x;
+						item.y = p.y;
+						return Shape(item);
+					}
+					case LineString: {
+						types::Line line;
+						line.coords = coords();
+						return Shape(std::move(line));
+					}
+					case Polygon:
+						return Shape(polygon());
+					case MultiLineString: {
+						types::MultiLine multiLine;
+						uint32_t n = count(9);
+						for (uint32_t i = 0; i < n; ++i) {
+							member(LineString);
+							types::Line line;
+							line.coords = coords();
+							multiLine.items.push_back(std::move(line));
+						}
+						return Shape(std::move(multiLine));
+					}
+					case MultiPolygon: {
+						types::MultiPolygon multiPolygon;
+						uint32_t n = count(9);
+						for (uint32_t i = 0; i < n; ++i) {
+							member(Polygon);
+							multiPolygon.items.push_back(polygon());
+						}
+						return Shape(std::move(multiPolygon));
+					}
+					case MultiPoint:
+					case GeometryCollection:
+						return Shape();
+				}
+				throw std::runtime_error("WKB: unknown geometry type");
+			}
+
+			// Member of a multi geometry, with its own header
+			void member(uint32_t expected) {
+				if (header() != expected) {
+					throw std::runtime_error("WKB: unexpected member type");
+				}
+			}
+		};
+	}
+
+	/*
+
+	Parse
+	Throws std::runtime_error on truncated or invalid input.
+	used, if given, gets the number of bytes the geometry took.
+
+	*/
+
+	Shape parse(const uint8_t* data, size_t size, size_t* used = nullptr) {
+		reader::Cursor cursor = {data, data + size};
+		Shape shape = cursor.geometry();
+		if (used != nullptr) {
+			*used = static_cast<size_t>(cursor.at - data);
+		}
+		return shape;
+	}
+
+	Shape parse(std::string_view data) {
+		return parse(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+	}
+
+	namespace writer {
+
+		template <typename T>
+		void put(std::string& out, T value) {
+			if constexpr (std::endian::native == std::endian::big) {
+				uint8_t bytes[sizeof(T)];
+				std::memcpy(bytes, &value, sizeof(T));
+				std::reverse(bytes, bytes + sizeof(T));
+				out.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+			} else {
+				out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+			}
+		}
+
+		void header(std::string& out, uint32_t type) {
+			out.push_back(1);
+			put(out, type);
+		}
+
+		// Polygon rings are closed if they aren't
+		void coords(std::string& out, const Coords& coords, bool closed) {
+			bool close = closed && coords.size() > 1 && (coords.front().x != coords.back().x || coords.front().y != coords.back().y);
+			put(out, static_cast<uint32_t>(coords.size() + close));
+			for (const surfy::geom::Point& p : coords) {
+				put(out, p.x);
+				put(out, p.y);
+			}
+			if (close) {
+				put(out, coords.front().x);
+				put(out, coords.front().y);
+			}
+		}
+
+		void polygon(std::string& out, const types::Polygon& poly) {
+			header(out, Polygon);
+			if (poly.outer.coords.empty()) {
+				put(out, uint32_t(0));
+				return;
+			}
+			put(out, static_cast<uint32_t>(poly.inner.coords.empty() ? 1 : 2));
+			coords(out, poly.outer.coords, true);
+			if (!poly.inner.coords.empty()) {
+				coords(out, poly.inner.coords, true);
+			}
+		}
+	}
+
+	/*
+
+	Write
+	Appends shape to out. An empty Shape is an empty GeometryCollection, an empty Point is NaN NaN.
+
+	*/
+
+	void write(std::string& out, const Shape& shape) {
+		if (shape.type == "Point") {
+			writer::header(out, Point);
+			writer::put(out, shape.empty ? std::numeric_limits<double>::quiet_NaN() : shape.geom.point.x);
+			writer::put(out, shape.empty ? std::numeric_limits<double>::quiet_NaN() : shape.geom.point.y);
+		} else if (shape.type == "Line") {
+			writer::header(out, LineString);
+			writer::coords(out, shape.geom.line.coords, false);
+		} else if (shape.type == "MultiLine") {
+			writer::header(out, MultiLineString);
+			writer::put(out, static_cast<uint32_t>(shape.geom.multiLine.items.size()));
+			for (const types::Line& line : shape.geom.multiLine.items) {
+				writer::header(out, LineString);
+				writer::coords(out, line.coords, false);
+			}
+		} else if (shape.type == "Polygon") {
+			writer::polygon(out, shape.geom.polygon);
+		} else if (shape.type == "MultiPolygon") {
+			writer::header(out, MultiPolygon);
+			writer::put(out, static_cast<uint32_t>(shape.geom.multiPolygon.items.size()));
+			for (const types::Polygon& poly : shape.geom.multiPolygon.items) {
+				writer::polygon(out, poly);
+			}
+		} else {
+			writer::header(out, GeometryCollection);
+			writer::put(out, uint32_t(0));
+		}
+	}
+
+	std::string encode(const Shape& shape) {
+		std::string out;
+		write(out, shape);
+		return out;
+	}
+}
+
+#endif
@@ -0,0 +1,554 @@
+#ifndef SURFY_GEOM_WKT_HPP
+#define SURFY_GEOM_WKT_HPP
+
+/*
+
+WKT
+Parser working in place on a string_view, numbers with from_chars, no copies of the text.
+Reader memory-maps a WKT-per-line (or CSV with a WKT column) file, splits it into
+newline-aligned chunks and parses them on a pool, the shared one unless given one, into Shapes or flat Columns.
+
+*/
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include "geom.hpp"
+#include "pool.hpp"
+#include "../utils/mmap.hpp"
+
+namespace surfy::geom::wkt {
+
+	/*
+
+	Columns
+	Geometries in flat arrays: geometry -> parts (lines or polygons) -> rings -> points.
+	Offsets start with 0 and end with the total, so geometry i has parts geometries[i] .. geometries[i + 1].
+	A Point is one part with one ring of one point, a Polygon one part with its rings.
+
+	*/
+
+	struct Columns {
+		std::vector<uint8_t> types; // Shape::typeID, 0 when the text didn't parse
+		std::vector<size_t> geometries = {0};
+		std::vector<size_t> parts = {0};
+		std::vector<size_t> rings = {0};
+		std::vector<Point> points;
+
+		size_t size() const {
+			return types.size();
+		}
+
+		void clear() {
+			types.clear();
+			geometries.assign(1, 0);
+			parts.assign(1, 0);
+			rings.assign(1, 0);
+			points.clear();
+		}
+
+		// Append other, offsets shifted
+		void append(const Columns& other) {
+			size_t partBase = parts.size() - 1;
+			size_t ringBase = rings.size() - 1;
+			size_t pointBase = points.size();
+
+			types.insert(types.end(), other.types.begin(), other.types.end());
+			for (size_t i = 1; i < other.geometries.size(); ++i) {
+				geometries.push_back(other.geometries[i] + partBase);
+			}
+			for (size_t i = 1; i < other.parts.size(); ++i) {
+				parts.push_back(other.parts[i] + ringBase);
+			}
+			for (size_t i = 1; i < other.rings.size(); ++i) {
+				rings.push_back(other.rings[i] + pointBase);
+			}
+			points.insert(points.end(), other.points.begin(), other.points.end());
+		}
+
+		// Append a Shape, the inverse of shape()
+		void add(const Shape& shape) {
+			auto ring = [this](const Coords& coords) {
+				if (!coords.empty()) {
+					points.insert(points.end(), coords.begin(), coords.end());
+					rings.push_back(points.size());
+				}
+			};
+			auto polygon = [&](const types::Polygon& poly) {
+				ring(poly.outer.coords);
+				ring(poly.inner.coords);
+				parts.push_back(rings.size() - 1);
+			};
+
+			types.push_back(static_cast<uint8_t>(shape.typeID));
+			switch (shape.typeID) {
+				case 1:
+					if (!shape.empty) {
+						ring({{shape.geom.point.x, shape.geom.point.y}});
+						parts.push_back(rings.size() - 1);
+					}
+					break;
+				case 2:
+					if (!shape.geom.line.coords.empty()) {
+						ring(shape.geom.line.coords);
+						parts.push_back(rings.size() - 1);
+					}
+					break;
+				case 3:
+					for (const types::Line& line : shape.geom.multiLine.items) {
+						if (!line.coords.empty()) {
+							ring(line.coords);
+							parts.push_back(rings.size() - 1);
+						}
+					}
+					break;
+				case 4:
+					if (!shape.geom.polygon.outer.coords.empty()) {
+						polygon(shape.geom.polygon);
+					}
+					break;
+				case 5:
+					for (const types::Polygon& poly : shape.geom.multiPolygon.items) {
+						if (!poly.outer.coords.empty()) {
+							polygon(poly);
+						}
+					}
+					break;
+			}
+			geometries.push_back(parts.size() - 1);
+		}
+
+		Coords ring(size_t index) const {
+			return Coords(points.begin() + rings[index], points.begin() + rings[index + 1]);
+		}
+
+		// Polygon of a part: first ring outer, like Shape(std::string) a later ring is the hole
+		types::Polygon polygon(size_t part) const {
+			types::Polygon poly;
+			for (size_t r = parts[part]; r < parts[part + 1]; ++r) {
+				if (r == parts[part]) {
+					poly.outer.coords = ring(r);
+				} else {
+					poly.inner.coords = ring(r);
+				}
+			}
+			return poly;
+		}
+
+		Shape shape(size_t index) const {
+			size_t first = geometries[index];
+			size_t last = geometries[index + 1];
+
+			switch (types[index]) {
+				case 1: {
+					if (first == last || rings[parts[first] + 1] == rings[parts[first]]) {
+						return Shape();
+					}
+					types::Point point;
+					point.x = points[rings[parts[first]]].x;
+					point.y = points[rings[parts[first]]].y;
+					return Shape(point);
+				}
+				case 2: {
+					types::Line line;
+					if (first != last) {
+						line.coords = ring(parts[first]);
+					}
+					return Shape(std::move(line));
+				}
+				case 3: {
+					types::MultiLine multiLine;
+					for (size_t part = first; part < last; ++part) {
+						types::Line line;
+						line.coords = ring(parts[part]);
+						multiLine.items.push_back(std::move(line));
+					}
+					return Shape(std::move(multiLine));
+				}
+				case 4: {
+					return Shape(first != last ? polygon(first) : types::Polygon());
+				}
+				case 5: {
+					types::MultiPolygon multiPolygon;
+					for (size_t part = first; part < last; ++part) {
+						multiPolygon.items.push_back(polygon(part));
+					}
+					return Shape(std::move(multiPolygon));
+				}
+			}
+			return Shape();
+		}
+	};
+
+	namespace parser {
+
+		struct Cursor {
+			const char* at;
+			const char* end;
+
+			void skip() {
+				while (at < end && (*at == ' ' || *at == '\t' || *at == '\r' || *at == '\n')) {
+					++at;
+				}
+			}
+
+			bool take(char c) {
+				skip();
+				if (at < end && *at == c) {
+					++at;
+					return true;
+				}
+				return false;
+			}
+
+			// Upper-cased keyword, empty if none
+			std::string_view word(char* buffer, size_t capacity) {
+				skip();
+				size_t length = 0;
+				while (at < end && std::isalpha(static_cast<unsigned char>(*at))) {
+					if (length < capacity) {
+						buffer[length++] = static_cast<char>(std::toupper(static_cast<unsigned char>(*at)));
+					}
+					++at;
+				}
+				return {buffer, length};
+			}
+
+			bool number(double& value) {
+				skip();
+				if (at < end && *at == '+') {
+					++at;
+				}
+				std::from_chars_result result = std::from_chars(at, end, value);
+				if (result.ec != std::errc()) {
+					return false;
+				}
+				at = result.ptr;
+				return true;
+			}
+		};
+
+		// (x y, x y, ...), Z and M ordinates are skipped
+		bool ring(Cursor& cursor, Columns& out) {
+			if (!cursor.take('(')) {
+				return false;
+			}
+			do {
+				Point p;
+				if (!cursor.number(p.x) || !cursor.number(p.y)) {
+					return false;
+				}
+				double extra;
+				while (cursor.number(extra)) {}
+				out.points.push_back(p);
+			} while (cursor.take(','));
+
+			if (!cursor.take(')')) {
+				return false;
+			}
+			out.rings.push_back(out.points.size());
+			return true;
+		}
+
+		// ((ring), (ring), ...) as one part
+		bool rings(Cursor& cursor, Columns& out) {
+			if (!cursor.take('(')) {
+				return false;
+			}
+			do {
+				if (!ring(cursor, out)) {
+					return false;
+				}
+			} while (cursor.take(','));
+
+			if (!cursor.take(')')) {
+				return false;
+			}
+			out.parts.push_back(out.rings.size() - 1);
+			return true;
+		}
+
+		bool body(Cursor& cursor, uint8_t type, Columns& out) {
+			switch (type) {
+				case 1:
+				case 2:
+					if (!ring(cursor, out)) {
+						return false;
+					}
+					out.parts.push_back(out.rings.size() - 1);
+					return true;
+				case 4:
+					return rings(cursor, out);
+				case 3:
+				case 5:
+					if (!cursor.take('(')) {
+						return false;
+					}
+					do {
+						if (type == 3) {
+							if (!ring(cursor, out)) {
+								return false;
+							}
+							out.parts.push_back(out.rings.size() - 1);
+						} else if (!rings(cursor, out)) {
+							return false;
+						}
+					} while (cursor.take(','));
+					return cursor.take(')');
+			}
+			return false;
+		}
+
+		uint8_t type(std::string_view word) {
+			if (word == "POINT") {
+				return 1;
+			} else if (word == "LINESTRING") {
+				return 2;
+			} else if (word == "MULTILINESTRING") {
+				return 3;
+			} else if (word == "POLYGON") {
+				return 4;
+			} else if (word == "MULTIPOLYGON") {
+				return 5;
+			}
+			return 0;
+		}
+	}
+
+	/*
+
+	Parse
+	One geometry appended to columns. Text that doesn't parse (or a type Shape can't hold,
+	like MULTIPOINT) is appended as type 0 with no parts, and false is returned.
+
+	*/
+
+	bool parse(std::string_view text, Columns& out) {
+		parser::Cursor cursor = {text.data(), text.data() + text.size()};
+		size_t points = out.points.size();
+		size_t rings = out.rings.size();
+		size_t parts = out.parts.size();
+
+		char buffer[32];
+		uint8_t type = parser::type(cursor.word(buffer, sizeof(buffer)));
+
+		// Dimension tag: Z, M or ZM
+		parser::Cursor tag = cursor;
+		std::string_view dimension = tag.word(buffer, sizeof(buffer));
+		if (dimension == "Z" || dimension == "M" || dimension == "ZM") {
+			cursor = tag;
+		}
+
+		bool parsed = type != 0;
+		if (parsed) {
+			tag = cursor;
+			if (tag.word(buffer, sizeof(buffer)) != "EMPTY") {
+				parsed = parser::body(cursor, type, out);
+			}
+		}
+
+		if (!parsed) {
+			out.points.resize(points);
+			out.rings.resize(rings);
+			out.parts.resize(parts);
+			type = 0;
+		}
+
+		out.types.push_back(type);
+		out.geometries.push_back(out.parts.size() - 1);
+		return parsed;
+	}
+
+	Shape parse(std::string_view text) {
+		thread_local Columns scratch;
+		scratch.clear();
+		parse(text, scratch);
+		return scratch.shape(0);
+	}
+
+	struct Options {
+		int column = -1; // CSV column holding the WKT, -1 = every line is WKT
+		char delimiter = ',';
+		bool header = false; // Skip the first line
+	};
+
+	/*
+
+	Reader
+	Blank lines are skipped, lines that don't parse give empty Shapes (type Dummy).
+
+	*/
+
+	class Reader {
+	public:
+		Options options;
+
+		Reader(const std::string& path, const Options& options = {}, pool::Pool& workers = pool::shared()) : options(options), file(path), workers(workers) {}
+
+		// Bytes mapped, 0 if the file couldn't be opened
+		size_t size() const {
+			return file.size();
+		}
+
+		/*
+
+		For Each
+		visit(offset, shape) for every line, offset is where the line starts in the file,
+		so it orders the Shapes like the file. Called from worker threads.
+
+		*/
+
+		template <typename Visitor>
+		void forEach(Visitor&& visit) const {
+			run([&](size_t, std::string_view wkt, size_t offset, Columns& scratch) {
+				scratch.clear();
+				parse(wkt, scratch);
+				Shape shape = scratch.shape(0);
+				visit(offset, shape);
+			});
+		}
+
+		// Every Shape, in file order
+		std::vector<Shape> read() const {
+			std::vector<std::vector<Shape>> found(chunks().size());
+			run([&](size_t chunk, std::string_view wkt, size_t, Columns& scratch) {
+				scratch.clear();
+				parse(wkt, scratch);
+				found[chunk].push_back(scratch.shape(0));
+			});
+
+			size_t total = 0;
+			for (const std::vector<Shape>& part : found) {
+				total += part.size();
+			}
+
+			std::vector<Shape> result;
+			result.reserve(total);
+			for (std::vector<Shape>& part : found) {
+				for (Shape& shape : part) {
+					result.push_back(std::move(shape));
+				}
+				std::vector<Shape>().swap(part);
+			}
+			return result;
+		}
+
+		// Every geometry in flat arrays, in file order
+		Columns columns() const {
+			std::vector<Columns> found(chunks().size());
+			run([&](size_t chunk, std::string_view wkt, size_t, Columns&) {
+				parse(wkt, found[chunk]);
+			});
+
+			Columns result;
+			for (Columns& part : found) {
+				result.append(part);
+				part = Columns();
+			}
+			return result;
+		}
+
+	private:
+		surfy::utils::MappedFile file;
+		pool::Pool& workers;
+
+		static constexpr size_t MIN_CHUNK = 1 << 20;
+
+		// Newline-aligned [first, last) byte ranges, a few per worker
+		std::vector<std::pair<size_t, size_t>> chunks() const {
+			std::vector<std::pair<size_t, size_t>> result;
+			size_t size = file.size();
+			if (size == 0) {
+				return result;
+			}
+
+			size_t count = std::clamp<size_t>(size / MIN_CHUNK, 1, workers.size() * 4);
+			size_t step = size / count;
+			const char* data = file.data();
+
+			size_t first = 0;
+			for (size_t i = 1; i <= count && first < size; ++i) {
+				size_t last = (i == count) ? size : std::max(first, i * step);
+				if (last < size) {
+					const void* newline = std::memchr(data + last, '\n', size - last);
+					last = newline ? static_cast<const char*>(newline) - data + 1 : size;
+				}
+				result.push_back({first, last});
+				first = last;
+			}
+			return result;
+		}
+
+		// WKT of a line: the whole line, or its CSV column (quotes stripped)
+		std::string_view field(std::string_view line) const {
+			if (options.column < 0) {
+				return line;
+			}
+
+			size_t at = 0;
+			for (int column = 0; at <= line.size(); ++column) {
+				bool quoted = at < line.size() && line[at] == '"';
+				size_t start = quoted ? at + 1 : at;
+				size_t end = quoted ? line.find('"', start) : line.find(options.delimiter, start);
+				if (end == std::string_view::npos) {
+					end = line.size();
+				}
+
+				if (column == options.column) {
+					return line.substr(start, end - start);
+				}
+
+				at = quoted ? line.find(options.delimiter, end) : end;
+				if (at == std::string_view::npos) {
+					break;
+				}
+				++at;
+			}
+			return {};
+		}
+
+		// task(chunk, wkt, offset, scratch) for every non-blank line
+		template <typename Task>
+		void run(Task&& task) const {
+			std::vector<std::pair<size_t, size_t>> ranges = chunks();
+			if (ranges.empty()) {
+				return;
+			}
+
+			pool::Group group;
+			for (size_t chunk = 0; chunk < ranges.size(); ++chunk) {
+				workers.submit(group, [this, &task, &ranges, chunk]() {
+					Columns scratch;
+					const char* data = file.data();
+					size_t at = ranges[chunk].first;
+					size_t end = ranges[chunk].second;
+
+					while (at < end) {
+						const void* newline = std::memchr(data + at, '\n', end - at);
+						size_t next = newline ? static_cast<const char*>(newline) - data : end;
+						std::string_view line(data + at, next - at);
+						size_t offset = at;
+						at = next + 1;
+
+						if (offset == 0 && options.header) {
+							continue;
+						}
+						if (!line.empty() && line.back() == '\r') {
+							line.remove_suffix(1);
+						}
+						if (line.find_first_not_of(" \t") == std::string_view::npos) {
+							continue;
+						}
+
+						task(chunk, field(line), offset, scratch);
+					}
+				});
+			}
+			workers.wait(group);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SURFY_UTILS_MMAP_HPP
+#define SURFY_UTILS_MMAP_HPP
+
+/*
+
+Memory-mapped file
+Read-only view of a whole file, pages are read in by the kernel as they are touched.
+
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace surfy::utils {
+
+	class MappedFile {
+	public:
+
+		// Sequential hints the kernel to read ahead aggressively
+		MappedFile(const std::string& path, bool sequential = true) {
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				std::cerr << "Error opening " << path << ": " << std::strerror(errno) << std::endl;
+				return;
+			}
+
+			struct stat info;
+			if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+				void* mapped = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapped == MAP_FAILED) {
+					std::cerr << "Error mapping " << path << ": " << std::strerror(errno) << std::endl;
+				} else {
+					bytes = static_cast<const char*>(mapped);
+					length = static_cast<size_t>(info.st_size);
+					if (sequential) {
+						::madvise(mapped, length, MADV_SEQUENTIAL);
+					}
+				}
+			}
+			::close(fd);
+		}
+
+		~MappedFile() {
+			if (bytes != nullptr) {
+				::munmap(const_cast<char*>(bytes), length);
+			}
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept : bytes(other.bytes), length(other.length) {
+			other.bytes = nullptr;
+			other.length = 0;
+		}
+
+		const char* data() const {
+			return bytes;
+		}
+
+		size_t size() const {
+			return length;
+		}
+
+		bool empty() const {
+			return length == 0;
+		}
+
+		std::string_view view() const {
+			return {bytes, length};
+		}
+
+	private:
+		const char* bytes = nullptr;
+		size_t length = 0;
+	};
+}
+
+#endif
@@ -1,6 +1,12 @@
 #ifndef SURFY_UTILS_PRINT_HPP
 #define SURFY_UTILS_PRINT_HPP
 
+#include <array>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
 namespace surfy::utils {
 
 	std::mutex print_mutex;
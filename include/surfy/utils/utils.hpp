@@ -5,5 +5,6 @@ namespace surfy::utils { }
 
 #include "print.hpp"
 #include "json.hpp"
+#include "mmap.hpp"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <random>
+
+#include "../include/surfy/geom/geom.hpp"
+#include "../include/surfy/geom/batch.hpp"
+namespace sg = surfy::geom;
+
+/*
+
+Bench
+Timings of batch operations against the per-item loops they replace.
+
+*/
+
+template <typename Callback>
+double measure(Callback&& callback, int rounds = 5) {
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < rounds; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		callback();
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+void insideBench() {
+	std::cout << "\n#### Inside Bench ####\n" << std::endl;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> random(-12, 12);
+
+	for (int vertices : {16, 256, 4096}) {
+		sg::Coords ring;
+		for (int i = 0; i < vertices; ++i) {
+			double angle = 2 * M_PI * i / vertices;
+			double radius = 8 + 3 * std::sin(7 * angle);
+			ring.push_back({radius * std::cos(angle), radius * std::sin(angle)});
+		}
+
+		std::vector<sg::Point> points(200000);
+		for (sg::Point& point : points) {
+			point = {random(rng), random(rng)};
+		}
+
+		std::vector<uint8_t> loop(points.size());
+		std::vector<uint8_t> batch(points.size());
+
+		double loopTime = measure([&]() {
+			for (size_t i = 0; i < points.size(); ++i) {
+				loop[i] = sg::utils::inside(points[i], ring);
+			}
+		});
+
+		sg::batch::Edges edges(ring);
+		double batchTime = measure([&]() {
+			sg::batch::inside(points, edges, batch);
+		});
+
+		std::cout << vertices << " vertices, " << points.size() << " points: "
+			<< "utils::inside " << loopTime << " ms, batch::inside " << batchTime << " ms, x" << loopTime / batchTime
+			<< (loop == batch ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+int main() {
+	insideBench();
+	return 0;
+}
@@ -1,16 +1,51 @@
 #include "../include/json.hpp"
 using json = nlohmann::ordered_json;
 
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+
 #include "../include/surfy/utils/print.hpp"
-using surfy::print;
+using surfy::utils::print;
 
 #include "../include/surfy/geom/geom.hpp"
+#include "../include/surfy/geom/mvt.hpp"
+#include "../include/surfy/geom/tiles.hpp"
+#include "../include/surfy/geom/filter.hpp"
+#include "../include/surfy/geom/index.hpp"
+#include "../include/surfy/geom/rtree.hpp"
+#include "../include/surfy/geom/prepared.hpp"
+#include "../include/surfy/geom/join.hpp"
+#include "../include/surfy/geom/curve.hpp"
+#include "../include/surfy/geom/cover.hpp"
+#include "../include/surfy/geom/raster.hpp"
+#include "../include/surfy/geom/quadtree.hpp"
+#include "../include/surfy/geom/batch.hpp"
+#include "../include/surfy/geom/pipeline.hpp"
+#include "../include/surfy/geom/wkt.hpp"
+#include "../include/surfy/geom/geojson.hpp"
+#include "../include/surfy/geom/flatgeobuf.hpp"
+#include "../include/surfy/geom/store.hpp"
+#include "../include/surfy/geom/sqlite.hpp"
+#include "../include/surfy/geom/gpkg.hpp"
+#include "../include/surfy/geom/shapefile.hpp"
 namespace sg = surfy::geom;
 
 
 // Global Config
 json config;
 
+// Failed checks, returned from main
+int failures = 0;
+
+void check(const std::string& name, bool passed) {
+	if (!passed) {
+		++failures;
+	}
+	print(passed ? "ok  " : "FAIL", name);
+}
+
 void pointTest() {
 	print("\n\n#### Point Test ####\n\n");
 
@@ -41,11 +76,12 @@ void pointTest() {
 	sg::Shape mask("POLYGON ((0 0, 0 1, 1 1, 1 0, 0 0))");
 	print("Mask:", mask);
 	
-	sg::Shape clippedPointOutside = sg::clip(point, mask);
+	sg::Shape clippedPointOutside(point);
+	clippedPointOutside.clip(mask.geom.polygon.outer.coords);
 	print("Clipped Point (Outside Mask)", clippedPointOutside);
 	
 	sg::Shape pointInside("POINT (.5 .5)");
-	sg::clip(pointInside, mask);
+	pointInside.clip(mask.geom.polygon.outer.coords);
 	print("\nPoint (Inside Mask):", pointInside);
 	print("\n");
 
@@ -96,7 +132,7 @@ void lineTest() {
 	sg::Shape mask("POLYGON ((0 0, 0 6, 6 6, 6 0, 0 0))");
 	print("Mask:", mask);
 	
-	sg::clip(line4clip, mask);
+	line4clip.clip(mask.geom.polygon.outer.coords);
 	print("Clipped Line:", line4clip);
 	print("\n");
 
@@ -109,7 +145,7 @@ void lineTest() {
 	sg::Shape line4clip_closed("LINESTRING (0 0, 0 10, 10 10, 10 0, 0 0)");
 	print("Clip Closed Line:", line4clip_closed);
 
-	sg::clip(line4clip_closed, mask);
+	line4clip_closed.clip(mask.geom.polygon.outer.coords);
 	print("Clipped Closed Line:", line4clip_closed);
 	print("\n");
 
@@ -123,7 +159,7 @@ void lineTest() {
 	print("Complex Line:", complexLine);
 
 	complexLine.simplify(2);
-	print("Simplified Line:", simpleLine);
+	print("Simplified Line:", complexLine);
 }
 
 void multiLineTest() {
@@ -140,7 +176,7 @@ void multiLineTest() {
 
 	json items = json::array();
 	for (int i=0; i < multiLine.size; ++i) {
-		sg::Line& line = multiLine.geom.multiLine.items[i];
+		sg::types::Line& line = multiLine.geom.multiLine.items[i];
 		json item = {
 			{ "wkt", line.wkt() },
 			{ "empty", line.empty },
@@ -171,7 +207,7 @@ void multiLineTest() {
 	sg::Shape mask("POLYGON ((0 0, 0 6, 6 6, 6 0, 0 0))");
 	print("Mask: ", mask);
 	
-	sg::clip(multiLine, mask);
+	multiLine.clip(mask.geom.polygon.outer.coords);
 	print("Clipped Line:", multiLine);
 	print("\n");
 
@@ -230,7 +266,7 @@ void polygonTest() {
 	sg::Shape mask("POLYGON ((0 0, 0 6, 6 6, 6 0, 0 0))");
 	print("Mask: ", mask);
 	
-	sg::clip(poly, mask);
+	poly.clip(mask.geom.polygon.outer.coords);
 	print("Clipped Polygon:", poly);
 	print("\n");
 
@@ -258,7 +294,7 @@ void multiPolygonTest() {
 	json items = json::array();
 
 	for (int i=0; i < multiPolygon.size; ++i) {
-		sg::Polygon& poly = multiPolygon.geom.multiPolygon.items[i];
+		sg::types::Polygon& poly = multiPolygon.geom.multiPolygon.items[i];
 		json item = {
 			{ "wkt", poly.wkt() },
 			{ "empty", poly.empty },
@@ -304,7 +340,7 @@ void multiPolygonTest() {
 	sg::Shape mask("POLYGON ((20 20, 20 40, 40 40, 40 20, 20 20))");
 	print("Mask: ", mask);
 	
-	sg::clip(multiPolygon, mask);
+	multiPolygon.clip(mask.geom.polygon.outer.coords);
 	print("Clipped MultiPolygon:", multiPolygon);
 	print("\n");
 
@@ -331,6 +367,2088 @@ void prune() {
 	print("Pruned Line", line); // LINESTRING (0 0, 3 3, 4 3, 7 0)
 }
 
+/*
+
+MVT Test
+Command encoding from the spec examples, layer references and a degenerate tile box
+
+*/
+
+void mvtTest() {
+	print("\n\n#### MVT Test ####\n\n");
+
+	// Spec example: Point (25 17) is MoveTo(1) 50 34, Y flips in tile space
+	sg::BBox box = {0, 0, 4096, 4096};
+	sg::mvt::Geometry point = sg::mvt::encode(sg::Shape("POINT (25 4079)"), box);
+	check("Point commands", point.type == sg::mvt::POINT && point.commands == std::vector<uint32_t>{9, 50, 34});
+
+	// Spec example: LineString (2 2, 2 10, 10 10)
+	sg::mvt::Geometry line = sg::mvt::encode(sg::Shape("LINESTRING (2 4094, 2 4086, 10 4086)"), box);
+	check("Line commands", line.commands == std::vector<uint32_t>{9, 4, 4, 18, 0, 16, 16, 0});
+
+	// Spec example: Polygon (3 6, 8 12, 20 34), exterior clockwise on screen
+	sg::mvt::Geometry poly = sg::mvt::encode(sg::Shape("POLYGON ((3 4090, 8 4084, 20 4062, 3 4090))"), box);
+	check("Polygon commands", poly.commands == std::vector<uint32_t>{9, 6, 12, 18, 10, 12, 24, 44, 15});
+
+	// Zero-width box must not divide by zero
+	sg::mvt::Geometry flat = sg::mvt::encode(sg::Shape("POINT (5 5)"), {5, 0, 5, 10});
+	check("Zero-width box", flat.commands == std::vector<uint32_t>{9, 0, 4096});
+
+	// A layer reference survives adding more layers
+	sg::mvt::Tile tile(box);
+	sg::mvt::Layer& first = tile.layer("a");
+	for (int i = 0; i < 64; ++i) {
+		tile.layer("layer" + std::to_string(i));
+	}
+	first.add(sg::Shape("POINT (1 1)"), {{"name", std::string("a")}});
+	check("Layer reference stays valid", tile.layers.front().size == 1 && &tile.layer("a") == &first);
+	check("Tile serializes only non-empty layers", !tile.empty() && tile.serialize().size() > 0);
+}
+
+/*
+
+Tiles Test
+Pyramid stats against the emitted tiles, shared pool against a pool of its own
+
+*/
+
+std::map<std::tuple<uint32_t, uint32_t, uint32_t>, std::string> buildTiles(sg::tiles::Pyramid& pyramid, sg::tiles::Stats& stats) {
+	std::map<std::tuple<uint32_t, uint32_t, uint32_t>, std::string> tiles;
+	std::mutex mutex;
+	stats = pyramid.build([&](const sg::tiles::TileID& id, std::string&& pbf) {
+		std::lock_guard<std::mutex> lock(mutex);
+		tiles[{id.z, id.x, id.y}] = std::move(pbf);
+	});
+	return tiles;
+}
+
+void tilesTest() {
+	print("\n\n#### Tiles Test ####\n\n");
+
+	sg::tiles::Options options;
+	options.minZoom = 0;
+	options.maxZoom = 6;
+
+	sg::pool::Pool workers(2);
+	sg::tiles::Pyramid shared(options);
+	sg::tiles::Pyramid own(options, workers);
+	for (sg::tiles::Pyramid* pyramid : {&shared, &own}) {
+		pyramid->add(sg::Shape("POLYGON ((-0.1 51.5, 0.1 51.5, 0.1 51.6, -0.1 51.6, -0.1 51.5))"), {{"name", std::string("London")}}, 1);
+		pyramid->add(sg::Shape("LINESTRING (-10 40, 0 45, 10 42)"), {}, 2);
+		pyramid->add(sg::Shape("POINT (2.35 48.85)"), {}, 3);
+	}
+
+	sg::tiles::Stats sharedStats, ownStats;
+	auto sharedTiles = buildTiles(shared, sharedStats);
+	auto ownTiles = buildTiles(own, ownStats);
+
+	check("Stats count emitted tiles", sharedStats.tiles == sharedTiles.size() && sharedStats.tiles > 0);
+	check("Own pool builds the same tiles", sharedTiles == ownTiles && ownStats.tiles == sharedStats.tiles && ownStats.features == sharedStats.features);
+
+	bool thrown = false;
+	try {
+		own.build([](const sg::tiles::TileID&, std::string&&) {
+			throw std::runtime_error("emit");
+		});
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	sg::tiles::Stats againStats;
+	check("A throwing emit reaches build's caller, the pool builds again", thrown && buildTiles(own, againStats) == ownTiles);
+}
+
+/*
+
+Buffered Clip Test
+clip(BBox, buffer) on every geometry type, and pyramid tiles clipped from their parent
+against the same tiles clipped from the source
+
+*/
+
+bool within(const sg::BBox& inner, const sg::BBox& outer) {
+	return inner[0] >= outer[0] - 1e-9 && inner[1] >= outer[1] - 1e-9 && inner[2] <= outer[2] + 1e-9 && inner[3] <= outer[3] + 1e-9;
+}
+
+void bufferedClipTest() {
+	print("\n\n#### Buffered Clip Test ####\n\n");
+
+	sg::BBox box = {0, 0, 10, 10};
+	sg::BBox expanded = {-2, -2, 12, 12};
+
+	sg::Shape inside("POINT (11 11)");
+	inside.clip(box, 2.);
+	sg::Shape outside("POINT (13 5)");
+	outside.clip(box, 2.);
+	check("Point in the buffer is kept", !inside.empty && inside.geom.point.x == 11);
+	check("Point past the buffer is dropped", outside.empty);
+
+	sg::Shape line("LINESTRING (-5 5, 5 5, 15 5)");
+	line.clip(box, 2.);
+	check("Line clipped to the buffer", !line.empty && within(line.bbox, expanded) && std::fabs(line.length - 14) < 1e-9);
+
+	sg::Shape uturn("LINESTRING (0 5, 20 5, 20 8, 0 8)");
+	uturn.clip(box, 0.);
+	check("Line leaving and re-entering becomes a MultiLine", uturn.type == "MultiLine" && uturn.size == 2 && std::fabs(uturn.length - 20) < 1e-9);
+
+	sg::Shape multiLine("MULTILINESTRING ((-5 1, 15 1), (5 -5, 5 15), (20 20, 30 30))");
+	multiLine.clip(box, 2.);
+	check("MultiLine clipped to the buffer", !multiLine.empty && within(multiLine.bbox, expanded) && std::fabs(multiLine.length - 28) < 1e-9);
+
+	sg::Shape poly("POLYGON ((-10 -10, 20 -10, 20 20, -10 20, -10 -10), (1 1, 1 3, 3 3, 3 1, 1 1))");
+	poly.clip(box, 2.);
+	check("Polygon clipped to the buffer", poly.bbox == expanded && std::fabs(poly.geom.polygon.outer.area - 196) < 1e-9);
+
+	sg::Shape multiPolygon("MULTIPOLYGON (((-5 -5, 5 -5, 5 5, -5 5, -5 -5)), ((8 8, 20 8, 20 20, 8 20, 8 8)))");
+	multiPolygon.clip(box, 2.);
+	check("MultiPolygon clipped to the buffer", within(multiPolygon.bbox, expanded) && std::fabs(multiPolygon.area - (49 + 16)) < 1e-9);
+
+	sg::Shape untouched("POLYGON ((0 0, 1 0, 1 1, 0 1, 0 0))");
+	untouched.clip(box, 2.);
+	check("Shape inside the buffer is untouched", untouched.vertices == 5);
+
+	// Pyramid without simplify: children from the parent equal children from the source
+	sg::tiles::Options options;
+	options.minZoom = 2;
+	options.maxZoom = 7;
+	options.tolerance = 0;
+
+	std::vector<std::string> sources = {
+		"POLYGON ((-3 50, 4 50, 4 55, 1 53, -3 55, -3 50), (0 51, 1 51, 1 52, 0 52, 0 51))",
+		"LINESTRING (-4 48, 0 52, 5 49, 8 54)",
+		"MULTIPOLYGON (((10 40, 12 40, 12 42, 10 42, 10 40)), ((13 41, 16 41, 14 45, 13 41)))"
+	};
+
+	sg::tiles::Pyramid pyramid(options);
+	for (size_t i = 0; i < sources.size(); ++i) {
+		pyramid.add(sg::Shape(sources[i]), {}, i + 1);
+	}
+
+	sg::tiles::Stats stats;
+	auto tiles = buildTiles(pyramid, stats);
+
+	// Every tile clipped through its ancestors, as the pyramid does, against the source clipped once
+	size_t same = 0, checked = 0, features = 0;
+	std::set<std::tuple<uint32_t, uint32_t, uint32_t>> expected;
+	for (uint32_t z = options.minZoom; z <= options.maxZoom; ++z) {
+		std::array<uint32_t, 4> range = sg::tiles::range({-1e6, 4e6, 2e6, 7.5e6}, z);
+		for (uint32_t x = range[0]; x <= range[2]; ++x) {
+			for (uint32_t y = range[1]; y <= range[3]; ++y) {
+				sg::tiles::TileID id = {z, x, y};
+				sg::mvt::Tile tile(sg::tiles::bbox(id), options.extent);
+				sg::mvt::Layer& layer = tile.layer(options.layer);
+				bool equal = true;
+
+				for (size_t i = 0; i < sources.size(); ++i) {
+					sg::Shape direct(sources[i]);
+					sg::tiles::project(direct);
+					sg::Shape chained(direct);
+					direct.clip(sg::tiles::bbox(id, options.extent, options.buffer));
+					for (uint32_t level = options.minZoom; level <= z && !chained.empty; ++level) {
+						uint32_t shift = z - level;
+						chained.clip(sg::tiles::bbox({level, x >> shift, y >> shift}, options.extent, options.buffer));
+					}
+
+					// Clipped rings may start elsewhere and Sutherland-Hodgman leaves zero-width spikes
+					// along the box edge, so rings compare by area, lines by length and bbox
+					double scale = std::max(1., direct.area + direct.length);
+					bool lines = direct.type == "Line" || direct.type == "MultiLine";
+					equal = equal && direct.empty == chained.empty && std::fabs(direct.area - chained.area) < 1e-9 * scale;
+					if (lines && !direct.empty) {
+						equal = equal && std::fabs(direct.length - chained.length) < 1e-9 * scale;
+						for (size_t k = 0; k < 4; ++k) {
+							equal = equal && std::fabs(direct.bbox[k] - chained.bbox[k]) < 1e-6;
+						}
+					}
+					if (!direct.empty) {
+						layer.add(direct, {}, i + 1);
+					}
+				}
+
+				same += equal;
+				++checked;
+				features += layer.size;
+				if (layer.size != 0) {
+					expected.insert({z, x, y});
+				}
+			}
+		}
+	}
+
+	std::set<std::tuple<uint32_t, uint32_t, uint32_t>> emitted;
+	for (const auto& [key, pbf] : tiles) {
+		emitted.insert(key);
+	}
+	check("Parent reuse clips like the source", same == checked && emitted.size() > 20);
+	check("Parent reuse emits the same tiles and features", emitted == expected && features == stats.features);
+}
+
+/*
+
+Significance Test
+Weights kept above a tolerance against Douglas-Peucker at that tolerance, and budgets
+
+*/
+
+sg::Coords randomWalk(std::mt19937& random, size_t size) {
+	std::normal_distribution<double> step(0, 1);
+	sg::Coords coords = {{0, 0}};
+	for (size_t i = 1; i < size; ++i) {
+		coords.push_back({coords.back().x + 1 + step(random), coords.back().y + step(random) * 3});
+	}
+	return coords;
+}
+
+void significanceTest() {
+	print("\n\n#### Significance Test ####\n\n");
+
+	std::mt19937 random(29);
+	size_t matches = 0, runs = 0;
+	for (size_t line = 0; line < 50; ++line) {
+		sg::Coords coords = randomWalk(random, 300);
+		std::vector<double> weights;
+		sg::utils::significance(coords, weights);
+
+		for (double tolerance : {0.1, 0.5, 1., 2., 5., 20.}) {
+			sg::Coords simplified, filtered;
+			sg::utils::simplify(coords, tolerance, simplified);
+			sg::utils::filter(coords, weights, tolerance, filtered);
+			bool equal = simplified.size() == filtered.size();
+			for (size_t i = 0; equal && i < simplified.size(); ++i) {
+				equal = simplified[i].x == filtered[i].x && simplified[i].y == filtered[i].y;
+			}
+			matches += equal;
+			++runs;
+		}
+	}
+	check("Weights match Douglas-Peucker at every tolerance", matches == runs);
+
+	// Vertex budget
+	sg::types::Line walk;
+	walk.coords = randomWalk(random, 2000);
+	sg::Shape line(std::move(walk));
+	sg::Shape bytes(line);
+	double tolerance = line.simplify(sg::Budget{.vertices = 100});
+	check("Vertex budget is respected", line.vertices <= 100 && line.vertices > 50 && tolerance > 0);
+
+	// Byte budget at 4 bytes per vertex
+	bytes.simplify(sg::Budget{.bytes = 800});
+	check("Byte budget is respected", bytes.vertices <= 200 && bytes.vertices > 100);
+
+	// Shapes under budget are left alone
+	sg::Shape small("LINESTRING (0 0, 1 1, 2 0, 3 1)");
+	check("Shape under budget is untouched", small.simplify(sg::Budget{.vertices = 10}) == 0 && small.vertices == 4);
+
+	// One tolerance for many Shapes
+	std::vector<sg::Shape> shapes;
+	for (size_t i = 0; i < 10; ++i) {
+		sg::types::Line item;
+		item.coords = randomWalk(random, 500);
+		shapes.emplace_back(std::move(item));
+	}
+	std::vector<sg::Significance> all(shapes.begin(), shapes.end());
+	std::vector<const sg::Significance*> probes;
+	for (const sg::Significance& item : all) {
+		probes.push_back(&item);
+	}
+	double shared = sg::Significance::search(probes, 400);
+	size_t total = 0;
+	for (size_t i = 0; i < shapes.size(); ++i) {
+		all[i].apply(shapes[i], shared);
+		total += shapes[i].vertices;
+	}
+	check("Tile budget over many Shapes is respected", total <= 400 && total > 200);
+}
+
+/*
+
+Filter Test
+Tiny features, MultiPolygon items, collapsed squares and the signed ring area they rely on
+
+*/
+
+void filterTest() {
+	print("\n\n#### Filter Test ####\n\n");
+
+	// Concave ring away from the origin: the signed Gauss sum, not the sum of absolute terms
+	sg::Shape concave("POLYGON ((100 100, 104 100, 104 101, 101 101, 101 104, 100 104, 100 100))");
+	check("Concave ring area", std::fabs(concave.area - 7) < 1e-9);
+	sg::Shape clockwise("POLYGON ((100 100, 100 104, 101 104, 101 101, 104 101, 104 100, 100 100))");
+	check("Clockwise ring area", std::fabs(clockwise.area - 7) < 1e-9);
+
+	sg::filter::Tiny tiny(1.);
+	sg::Shape small("POLYGON ((0 0, 0.5 0, 0.5 0.5, 0 0.5, 0 0))");
+	sg::Shape big("POLYGON ((0 0, 2 0, 2 2, 0 2, 0 0))");
+	check("Tiny polygon is dropped", !tiny.apply(small) && tiny.stats.features == 1);
+	check("Large polygon is kept", tiny.apply(big) && big.vertices == 5);
+
+	// Big item keeps its geometry when moved forward
+	sg::Shape mixed("MULTIPOLYGON (((0 0, 0.1 0, 0.1 0.1, 0 0.1, 0 0)), ((10 10, 13 10, 13 13, 10 13, 10 10)), ((20 20, 20.1 20, 20.1 20.1, 20 20.1, 20 20)))");
+	sg::filter::Tiny items(1.);
+	check("Tiny MultiPolygon items are removed", items.apply(mixed) && mixed.size == 1 && std::fabs(mixed.area - 9) < 1e-9 && items.stats.parts == 2);
+
+	// Together above the threshold, every item below it
+	sg::Shape allTiny("MULTIPOLYGON (((0 0, 0.6 0, 0.6 0.6, 0 0.6, 0 0)), ((5 5, 5.6 5, 5.6 5.6, 5 5.6, 5 5)), ((9 0, 9.6 0, 9.6 0.6, 9 0.6, 9 0)))");
+	sg::filter::Tiny all(1.);
+	check("MultiPolygon without items is dropped", !all.apply(allTiny) && allTiny.empty && all.stats.features == 1 && all.stats.parts == 3);
+
+	// Collapsed square stays inside the tile
+	sg::BBox tile = {0, 0, 10, 10};
+	sg::filter::Tiny squares(4., sg::filter::Collapse, tile);
+	bool inside = true;
+	for (int i = 0; i < 8; ++i) {
+		sg::Shape corner("POLYGON ((9.5 9.5, 11 9.5, 11 11, 9.5 11, 9.5 9.5))");
+		if (squares.apply(corner)) {
+			inside = inside && corner.bbox[0] >= tile[0] && corner.bbox[1] >= tile[1] && corner.bbox[2] <= tile[2] && corner.bbox[3] <= tile[3];
+		}
+	}
+	check("Collapsed squares stay in the tile", inside && squares.stats.collapsed == 4);
+}
+
+/*
+
+Index Test
+Packed tree queries against brute force, with empty Shapes far from the origin,
+and serialized trees that don't add up
+
+*/
+
+// Random boxes of up to size, around x, y
+std::vector<sg::Shape> randomBoxes(std::mt19937& random, size_t count, double x, double y, double spread, double size) {
+	std::uniform_real_distribution<double> position(-spread, spread);
+	std::uniform_real_distribution<double> side(0, size);
+	std::vector<sg::Shape> shapes;
+	for (size_t i = 0; i < count; ++i) {
+		double minX = x + position(random);
+		double minY = y + position(random);
+		sg::types::Polygon poly;
+		double w = side(random), h = side(random);
+		poly.outer.coords = {{minX, minY}, {minX + w, minY}, {minX + w, minY + h}, {minX, minY + h}, {minX, minY}};
+		shapes.emplace_back(std::move(poly));
+	}
+	return shapes;
+}
+
+std::vector<size_t> bruteSearch(const std::vector<sg::Shape>& shapes, const sg::BBox& query) {
+	std::vector<size_t> result;
+	for (size_t i = 0; i < shapes.size(); ++i) {
+		if (!shapes[i].empty && sg::index::intersects(query, shapes[i].bbox)) {
+			result.push_back(i);
+		}
+	}
+	return result;
+}
+
+void indexTest() {
+	print("\n\n#### Index Test ####\n\n");
+
+	std::mt19937 random(31);
+	std::vector<sg::Shape> boxes = randomBoxes(random, 5000, 1000, 2000, 100, 5);
+	std::vector<sg::Shape> shapes;
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		if (i % 97 == 0) {
+			shapes.emplace_back();
+		}
+		shapes.push_back(std::move(boxes[i]));
+	}
+
+	sg::index::Packed tree(shapes.begin(), shapes.end());
+	std::uniform_real_distribution<double> position(-110, 110);
+	size_t same = 0;
+	for (int q = 0; q < 200; ++q) {
+		double x = 1000 + position(random), y = 2000 + position(random);
+		sg::BBox query = {x, y, x + 20, y + 20};
+		std::vector<size_t> found = tree.search(query);
+		std::sort(found.begin(), found.end());
+		same += found == bruteSearch(shapes, query);
+	}
+	check("Packed search with empty Shapes off the origin", same == 200);
+
+	std::string data = tree.serialize();
+	sg::index::Packed loaded = sg::index::Packed::deserialize(data);
+	check("Serialized tree round trip", loaded.size == tree.size && loaded.search({1000, 2000, 1050, 2050}) == tree.search({1000, 2000, 1050, 2050}));
+
+	auto rejects = [](const std::string& bytes) {
+		try {
+			sg::index::Packed::deserialize(bytes);
+		} catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	};
+
+	std::string huge = data;
+	uint64_t count = uint64_t(1) << 60;
+	std::memcpy(huge.data() + 7, &count, sizeof(count));
+	check("Crafted count is rejected before allocating", rejects(huge));
+	check("Truncated data is rejected", rejects(data.substr(0, data.size() - 8)));
+
+	std::string broken = data;
+	uint64_t node = uint64_t(1) << 40;
+	std::memcpy(broken.data() + broken.size() - sizeof(node), &node, sizeof(node));
+	check("Inner node out of the tree is rejected", rejects(broken));
+}
+
+/*
+
+Nearest Test
+k nearest neighbours against ranking every Shape by its exact distance,
+boxes and lines mixed so the bbox bound and the real distance disagree
+
+*/
+
+void nearestTest() {
+	print("\n\n#### Nearest Test ####\n\n");
+
+	std::mt19937 random(33);
+	std::vector<sg::Shape> shapes = randomBoxes(random, 3000, 0, 0, 500, 30);
+	std::uniform_real_distribution<double> position(-500, 500);
+	for (int i = 0; i < 500; ++i) {
+		double x = position(random), y = position(random);
+		sg::types::Line line;
+		line.coords = {{x, y}, {x + 40, y + 35}};
+		shapes.emplace_back(std::move(line));
+	}
+
+	sg::index::Packed tree(shapes.begin(), shapes.end());
+	size_t same = 0, bounded = 0, queries = 100;
+	for (size_t q = 0; q < queries; ++q) {
+		sg::Point point = {position(random) * 1.2, position(random) * 1.2};
+		auto exact = [&](size_t i) {
+			return shapes[i].distance(point);
+		};
+
+		std::vector<double> brute;
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			brute.push_back(exact(i));
+		}
+		std::sort(brute.begin(), brute.end());
+
+		// Ties can swap indices, so rank by distance and check each index really is that far
+		std::vector<sg::index::Neighbor> found = tree.nearest(point, 10, exact);
+		bool match = found.size() == 10;
+		for (size_t i = 0; match && i < found.size(); ++i) {
+			match = found[i].distance == brute[i] && exact(found[i].index) == found[i].distance;
+		}
+		same += match;
+
+		double max = brute[4];
+		std::vector<sg::index::Neighbor> near = tree.nearest(point, 100, exact, max);
+		size_t within = std::upper_bound(brute.begin(), brute.end(), max) - brute.begin();
+		bounded += near.size() == within && near.back().distance <= max;
+	}
+	check("Nearest ranks like brute force", same == queries);
+	check("Nearest stops at max distance", bounded == queries);
+	check("Nearest on k = 0", tree.nearest({0, 0}, 0, [](size_t) { return .0; }).empty());
+}
+
+/*
+
+Prepared Test
+PreparedPolygon against utils::inside on random points, for star polygons,
+a polygon with a hole and a comb whose teeth cross every band
+
+*/
+
+void preparedTest() {
+	print("\n\n#### Prepared Test ####\n\n");
+
+	std::mt19937 random(34);
+	std::uniform_real_distribution<double> unit(0, 1);
+
+	auto agrees = [&](const sg::Shape& shape, size_t count) {
+		sg::PreparedPolygon prepared(shape);
+		const sg::types::Polygon& poly = shape.geom.polygon;
+		double w = shape.bbox[2] - shape.bbox[0], h = shape.bbox[3] - shape.bbox[1];
+		size_t same = 0;
+		for (size_t i = 0; i < count; ++i) {
+			sg::Point point = {shape.bbox[0] - w * .1 + unit(random) * w * 1.2, shape.bbox[1] - h * .1 + unit(random) * h * 1.2};
+			bool expected = sg::utils::inside(point, poly.outer.coords) && (poly.inner.coords.empty() || !sg::utils::inside(point, poly.inner.coords));
+			same += prepared.contains(point) == expected;
+		}
+		return same == count;
+	};
+
+	size_t stars = 0;
+	for (int s = 0; s < 50; ++s) {
+		sg::types::Polygon star;
+		size_t size = 3 + s * 7;
+		for (size_t i = 0; i < size; ++i) {
+			double angle = 2 * M_PI * i / size, radius = 10 + unit(random) * 90;
+			star.outer.coords.push_back({radius * std::cos(angle), radius * std::sin(angle)});
+		}
+		star.outer.coords.push_back(star.outer.coords.front());
+		stars += agrees(sg::Shape(std::move(star)), 2000);
+	}
+	check("Prepared star polygons match utils::inside", stars == 50);
+
+	sg::Shape holed("POLYGON ((0 0, 10 0, 10 10, 0 10, 0 0), (3 3, 7 3, 7 7, 3 7, 3 3))");
+	sg::PreparedPolygon prepared(holed);
+	check("Prepared polygon with a hole", agrees(holed, 20000) && prepared.contains({1, 1}) && !prepared.contains({5, 5}));
+
+	// Every tooth edge spans the whole height: one band per edge would copy each edge into every band
+	sg::types::Polygon comb;
+	size_t teeth = 20000;
+	comb.outer.coords.push_back({0, 0});
+	for (size_t i = 0; i < teeth; ++i) {
+		comb.outer.coords.push_back({i * 2. + 1, 0});
+		comb.outer.coords.push_back({i * 2. + 1, 1000});
+		comb.outer.coords.push_back({i * 2. + 2, 1000});
+		comb.outer.coords.push_back({i * 2. + 2, 0});
+	}
+	comb.outer.coords.push_back({teeth * 2. + 1, 0});
+	comb.outer.coords.push_back({teeth * 2. + 1, -10});
+	comb.outer.coords.push_back({0, -10});
+	comb.outer.coords.push_back({0, 0});
+	check("Prepared comb matches utils::inside", agrees(sg::Shape(std::move(comb)), 500));
+
+	check("Prepared empty Shape contains nothing", !sg::PreparedPolygon(sg::Shape()).contains({0, 0}));
+}
+
+/*
+
+Curve Test
+Hilbert and Morton keys against known values and the textbook xy2d walk,
+radix sort against std::stable_sort, moved Shapes in curve order
+
+*/
+
+uint64_t hilbertReference(uint64_t x, uint64_t y) {
+	uint64_t d = 0;
+	for (uint64_t s = uint64_t(1) << 31; s > 0; s /= 2) {
+		uint64_t rx = (x & s) > 0, ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+void curveTest() {
+	print("\n\n#### Curve Test ####\n\n");
+
+	const uint32_t F = 0xFFFFFFFF;
+	check("Morton known keys", sg::curve::morton(0, 0) == 0 && sg::curve::morton(1, 0) == 1 && sg::curve::morton(0, 1) == 2 && sg::curve::morton(3, 3) == 15 && sg::curve::morton(F, 0) == 0x5555555555555555ull && sg::curve::morton(F, F) == ~0ull);
+	check("Hilbert known keys", sg::curve::hilbert(0, 0) == 0 && sg::curve::hilbert(1, 0) == 1 && sg::curve::hilbert(1, 1) == 2 && sg::curve::hilbert(0, 1) == 3 && sg::curve::hilbert(5, 9) == 0x78 && sg::curve::hilbert(0, F) == 0x5555555555555555ull && sg::curve::hilbert(F, F) == 0xAAAAAAAAAAAAAAAAull && sg::curve::hilbert(F, 0) == ~0ull);
+
+	std::mt19937_64 random(37);
+	size_t same = 0;
+	for (int i = 0; i < 10000; ++i) {
+		uint32_t x = random(), y = random();
+		same += sg::curve::hilbert(x, y) == hilbertReference(x, y);
+	}
+	check("Hilbert against xy2d", same == 10000);
+
+	// Consecutive keys are neighbouring cells
+	std::vector<std::pair<uint64_t, std::pair<uint32_t, uint32_t>>> grid;
+	for (uint32_t x = 0; x < 64; ++x) {
+		for (uint32_t y = 0; y < 64; ++y) {
+			grid.push_back({sg::curve::hilbert(x, y), {x, y}});
+		}
+	}
+	std::sort(grid.begin(), grid.end());
+	bool adjacent = true;
+	for (size_t i = 1; i < grid.size(); ++i) {
+		auto [x0, y0] = grid[i - 1].second;
+		auto [x1, y1] = grid[i].second;
+		adjacent = adjacent && grid[i].first == i && std::abs(int(x1) - int(x0)) + std::abs(int(y1) - int(y0)) == 1;
+	}
+	check("Hilbert steps between neighbours", adjacent);
+
+	// Large enough for several blocks, and low-bit keys that skip passes
+	sg::pool::Pool workers(4);
+	for (uint64_t mask : {~0ull, 0xFFFFull, 0xFF00FF0000ull}) {
+		std::vector<uint64_t> keys(300000);
+		for (uint64_t& key : keys) {
+			key = random() & mask;
+		}
+		std::vector<uint32_t> values(keys.size());
+		std::iota(values.begin(), values.end(), 0);
+
+		std::vector<std::pair<uint64_t, uint32_t>> expected;
+		for (size_t i = 0; i < keys.size(); ++i) {
+			expected.push_back({keys[i], values[i]});
+		}
+		std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) {
+			return a.first < b.first;
+		});
+
+		std::vector<uint64_t> only = keys;
+		sg::curve::sort(only);
+		sg::curve::sort(keys, values, workers);
+
+		bool sorted = only.size() == expected.size();
+		for (size_t i = 0; sorted && i < expected.size(); ++i) {
+			sorted = only[i] == expected[i].first && keys[i] == expected[i].first && values[i] == expected[i].second;
+		}
+		check("Radix sort equals std::stable_sort", sorted);
+	}
+
+	std::mt19937 shapesRandom(37);
+	std::vector<sg::Shape> shapes = randomBoxes(shapesRandom, 2000, 0, 0, 100, 5);
+	std::vector<size_t> order = sg::curve::order(shapes);
+	std::vector<uint64_t> keys = sg::curve::keys(shapes);
+	std::vector<sg::BBox> boxes;
+	for (size_t index : order) {
+		boxes.push_back(shapes[index].bbox);
+	}
+	sg::curve::sort(shapes);
+	bool moved = std::is_sorted(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return keys[a] < keys[b];
+	});
+	for (size_t i = 0; i < shapes.size(); ++i) {
+		moved = moved && shapes[i].bbox == boxes[i] && shapes[i].geom.polygon.outer.coords.size() == 5;
+	}
+	check("Shapes sorted along the curve", moved);
+}
+
+/*
+
+Cover Test
+Geohash level 12, 30 bits per axis: cells are distinct, sorted, inside the polygon when interior,
+cover its area together, and the cell under a point has the reference geohash
+
+*/
+
+std::string geohashReference(double lon, double lat, size_t length) {
+	static const char* BASE32 = "0123456789bcdefghjkmnpqrstuvwxyz";
+	double lonRange[2] = {-180, 180}, latRange[2] = {-90, 90};
+	std::string result;
+	int value = 0;
+	for (size_t bit = 0; bit < length * 5; ++bit) {
+		double* range = bit % 2 == 0 ? lonRange : latRange;
+		double v = bit % 2 == 0 ? lon : lat;
+		double mid = (range[0] + range[1]) / 2;
+		value <<= 1;
+		if (v >= mid) {
+			value |= 1;
+			range[0] = mid;
+		} else {
+			range[1] = mid;
+		}
+		if (bit % 5 == 4) {
+			result.push_back(BASE32[value]);
+			value = 0;
+		}
+	}
+	return result;
+}
+
+void coverTest() {
+	print("\n\n#### Cover Test ####\n\n");
+
+	sg::cover::Grid grid(sg::cover::Geohash);
+	check("Geohash reference", geohashReference(10.40744, 57.64911, 11) == "u4pruydqqvj");
+
+	double lon = 10.40744, lat = 57.64911, side = .00001;
+	sg::types::Polygon square;
+	square.outer.coords = {{lon, lat}, {lon + side, lat}, {lon + side, lat + side}, {lon, lat + side}, {lon, lat}};
+	sg::Shape shape(std::move(square));
+
+	sg::cover::Covering covering = grid.cover(shape, 12);
+	std::vector<sg::cover::Cell> all = covering.interior;
+	all.insert(all.end(), covering.boundary.begin(), covering.boundary.end());
+	std::vector<sg::cover::Cell> unique = all;
+	std::sort(unique.begin(), unique.end());
+	unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+	double inner = 0, total = 0;
+	bool inside = true;
+	for (const sg::cover::Cell& cell : covering.interior) {
+		sg::BBox box = grid.bbox(cell);
+		inner += (box[2] - box[0]) * (box[3] - box[1]);
+		inside = inside && box[0] >= lon && box[2] <= lon + side && box[1] >= lat && box[3] <= lat + side;
+	}
+	for (const sg::cover::Cell& cell : all) {
+		sg::BBox box = grid.bbox(cell);
+		total += (box[2] - box[0]) * (box[3] - box[1]);
+	}
+	double area = side * side;
+	check("Level 12 cells are distinct and sorted", !covering.interior.empty() && unique.size() == all.size() && std::is_sorted(covering.boundary.begin(), covering.boundary.end()) && std::is_sorted(covering.interior.begin(), covering.interior.end()));
+	check("Level 12 interior inside, all cells cover the area", inside && inner <= area * (1 + 1e-9) && total >= area * (1 - 1e-9));
+
+	// Cell under a point inside the square, interior cells may have merged into a shorter prefix
+	double px = lon + side * .37, py = lat + side * .61;
+	std::string expected = geohashReference(px, py, 12);
+	bool found = false;
+	for (const sg::cover::Cell& cell : all) {
+		sg::BBox box = grid.bbox(cell);
+		if (px >= box[0] && px < box[2] && py >= box[1] && py < box[3]) {
+			found = grid.key(cell) == expected.substr(0, cell.level);
+		}
+	}
+	bool boundary = std::all_of(covering.boundary.begin(), covering.boundary.end(), [&](const sg::cover::Cell& cell) {
+		sg::BBox box = grid.bbox(cell);
+		return cell.level == 12 && grid.key(cell) == geohashReference((box[0] + box[2]) / 2, (box[1] + box[3]) / 2, 12);
+	});
+	check("Level 12 cell keys match the reference geohash", found && boundary);
+
+	sg::cover::Covering limited = grid.cover(shape, 12, 40);
+	std::vector<sg::cover::Cell> coarse = limited.boundary;
+	std::sort(coarse.begin(), coarse.end());
+	check("Level 12 covering within maxCells", limited.size() <= 40 && limited.size() > 0 && std::unique(coarse.begin(), coarse.end()) == coarse.end());
+}
+
+/*
+
+Raster Test
+Overlapping squares under EvenOdd and NonZero, a hole, anti-aliased coverage summing
+to the area, and a buffer too small to draw into
+
+*/
+
+void rasterTest() {
+	print("\n\n#### Raster Test ####\n\n");
+
+	// 10 x 10 pixels over 0..10, one unit per pixel, row 0 at the top
+	auto at = [](const std::vector<uint8_t>& pixels, int x, int y) {
+		return pixels[(9 - y) * 10 + x];
+	};
+
+	sg::Shape squares("MULTIPOLYGON (((1 1, 6 1, 6 6, 1 6, 1 1)), ((4 4, 9 4, 9 9, 4 9, 4 4)))");
+	std::vector<uint8_t> evenOdd(100), nonZero(100);
+	sg::raster::Rasterizer({0, 0, 10, 10}, 10, 10, {.rule = sg::raster::EvenOdd}).draw(squares, evenOdd);
+	sg::raster::Rasterizer({0, 0, 10, 10}, 10, 10, {.rule = sg::raster::NonZero}).draw(squares, nonZero);
+	size_t evenOddCount = std::count(evenOdd.begin(), evenOdd.end(), 255);
+	size_t nonZeroCount = std::count(nonZero.begin(), nonZero.end(), 255);
+	check("EvenOdd leaves the overlap empty", at(evenOdd, 4, 4) == 0 && at(evenOdd, 2, 2) == 255 && at(evenOdd, 7, 7) == 255 && evenOddCount == 25 + 25 - 8);
+	check("NonZero fills the overlap once", at(nonZero, 4, 4) == 255 && at(nonZero, 5, 5) == 255 && nonZeroCount == 25 + 25 - 4 && at(nonZero, 0, 0) == 0);
+
+	sg::Shape holed("POLYGON ((1 1, 9 1, 9 9, 1 9, 1 1), (3 3, 3 7, 7 7, 7 3, 3 3))");
+	std::vector<uint8_t> ring(100);
+	sg::raster::Rasterizer({0, 0, 10, 10}, 10, 10).draw(holed, ring);
+	check("Hole left empty", at(ring, 5, 5) == 0 && at(ring, 2, 2) == 255 && std::count(ring.begin(), ring.end(), 255) == 64 - 16);
+
+	// Exact horizontal coverage over sub-scanlines: the float sum is the area in pixels
+	std::mt19937 random(39);
+	std::uniform_real_distribution<double> position(0, 100);
+	bool sums = true;
+	for (int i = 0; i < 20; ++i) {
+		sg::types::Polygon triangle;
+		triangle.outer.coords = {{position(random), position(random)}, {position(random), position(random)}, {position(random), position(random)}};
+		triangle.outer.coords.push_back(triangle.outer.coords.front());
+		double area = std::abs(sg::utils::area(triangle.outer.coords));
+
+		std::vector<float> density(64 * 64);
+		sg::raster::Rasterizer raster({0, 0, 100, 100}, 64, 64, {.samples = 16});
+		raster.draw(sg::Shape(std::move(triangle)), density);
+		double sum = std::accumulate(density.begin(), density.end(), .0) * (100. / 64) * (100. / 64);
+		sums = sums && std::abs(sum - area) <= std::max(area * .01, 2.);
+	}
+	std::vector<float> aligned(100);
+	sg::raster::Rasterizer({0, 0, 10, 10}, 10, 10, {.samples = 4}).draw(sg::Shape("POLYGON ((1.5 1.5, 4.5 1.5, 4.5 4.5, 1.5 4.5, 1.5 1.5))"), aligned);
+	double alignedSum = std::accumulate(aligned.begin(), aligned.end(), .0);
+	check("Anti-aliased coverage sums to the area", sums && std::abs(alignedSum - 9) < 1e-4);
+
+	std::vector<uint8_t> small(99);
+	sg::raster::Rasterizer raster({0, 0, 10, 10}, 10, 10);
+	bool refused = !raster.draw(holed, small) && std::count(small.begin(), small.end(), 0) == 99;
+	check("Too small a buffer returns false", refused && raster.draw(holed, ring) && !raster.draw(sg::Shape("POINT (1 1)"), ring));
+}
+
+/*
+
+Quadtree Test
+Boxes clipped from the pieces against clipping the whole Shape, one by one and in parallel
+
+*/
+
+void quadtreeTest() {
+	print("\n\n#### Quadtree Test ####\n\n");
+
+	std::mt19937 random(40);
+	sg::types::Polygon star;
+	std::uniform_real_distribution<double> radius(50, 100);
+	for (size_t i = 0; i < 20000; ++i) {
+		double angle = 2 * M_PI * i / 20000;
+		double r = radius(random);
+		star.outer.coords.push_back({r * std::cos(angle), r * std::sin(angle)});
+	}
+	star.outer.coords.push_back(star.outer.coords.front());
+	sg::Shape shape(std::move(star));
+
+	sg::clippers::Quadtree tree(shape, 512, 2);
+	std::vector<sg::BBox> boxes;
+	std::uniform_real_distribution<double> position(-110, 100);
+	for (int i = 0; i < 200; ++i) {
+		double x = position(random), y = position(random);
+		boxes.push_back({x, y, x + 10, y + 10});
+	}
+
+	std::vector<double> expected;
+	size_t same = 0;
+	for (const sg::BBox& box : boxes) {
+		sg::Shape direct(shape);
+		direct.clip(box);
+		expected.push_back(direct.empty ? 0 : std::abs(sg::utils::area(direct.geom.polygon.outer.coords)));
+		sg::Shape piece = tree.clip(box);
+		double area = piece.empty ? 0 : std::abs(sg::utils::area(piece.geom.polygon.outer.coords));
+		same += std::abs(area - expected.back()) < 1e-6;
+	}
+	check("Quadtree pieces clip like the whole Shape", tree.size() > 1 && same == boxes.size());
+
+	std::vector<double> areas(boxes.size(), -1);
+	tree.clip(boxes, [&](size_t i, sg::Shape& piece) {
+		areas[i] = piece.empty ? 0 : std::abs(sg::utils::area(piece.geom.polygon.outer.coords));
+	});
+	bool parallel = true;
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		parallel = parallel && std::abs(areas[i] - expected[i]) < 1e-6;
+	}
+	check("Quadtree clips many boxes on the pool", parallel);
+}
+
+/*
+
+Batch Test
+clip, simplify, forEach and inside against the plain sequential loop,
+on the shared pool, a private one, and from inside a pool task
+
+*/
+
+void batchTest() {
+	print("\n\n#### Batch Test ####\n\n");
+
+	std::mt19937 random(41);
+	std::vector<sg::Shape> shapes = randomBoxes(random, 500, 0, 0, 60, 20);
+	for (int i = 0; i < 300; ++i) {
+		sg::types::Line line;
+		line.coords = randomWalk(random, 50 + i * 5);
+		shapes.emplace_back(std::move(line));
+	}
+	shapes.emplace_back();
+
+	auto copy = [&]() {
+		std::vector<sg::Shape> result;
+		for (const sg::Shape& shape : shapes) {
+			result.push_back(shape);
+		}
+		return result;
+	};
+
+	auto same = [](std::vector<sg::Shape>& a, std::vector<sg::Shape>& b) {
+		bool equal = a.size() == b.size();
+		for (size_t i = 0; equal && i < a.size(); ++i) {
+			equal = a[i].type == b[i].type && a[i].empty == b[i].empty && a[i].wkt() == b[i].wkt();
+		}
+		return equal;
+	};
+
+	sg::BBox box = {-20, -20, 25, 30};
+	sg::Coords mask = {{-30, -30}, {30, -25}, {20, 40}, {-25, 20}, {-30, -30}};
+
+	std::vector<sg::Shape> expectedBox = copy(), expectedMask = copy(), expectedSimple = copy();
+	for (size_t i = 0; i < shapes.size(); ++i) {
+		expectedBox[i].clip(box, 2.);
+		expectedMask[i].clip(mask);
+		expectedSimple[i].simplify(1.5);
+	}
+
+	std::vector<sg::Shape> byBox = copy(), byMask = copy(), simple = copy();
+	sg::batch::clip(byBox, box, 2.);
+	sg::batch::clip(byMask, mask);
+	sg::pool::Pool workers(3);
+	sg::batch::simplify(simple, 1.5, workers);
+	check("Batch clip and simplify equal the loop", same(byBox, expectedBox) && same(byMask, expectedMask) && same(simple, expectedSimple));
+
+	std::vector<size_t> calls(shapes.size(), 0), vertices(shapes.size(), 0);
+	sg::batch::forEach(shapes, [&](size_t i, const sg::Shape& shape) {
+		++calls[i];
+		vertices[i] = shape.vertices;
+	});
+	bool once = std::all_of(calls.begin(), calls.end(), [](size_t count) { return count == 1; });
+	for (size_t i = 0; once && i < shapes.size(); ++i) {
+		once = vertices[i] == shapes[i].vertices;
+	}
+	check("forEach visits every Shape once by index", once);
+
+	// Nested: tasks of the shared pool batch on the shared pool
+	std::vector<std::vector<sg::Shape>> nested(4);
+	sg::pool::Group group;
+	for (std::vector<sg::Shape>& part : nested) {
+		part = copy();
+		sg::pool::shared().submit(group, [&part, &box]() {
+			sg::batch::clip(part, box, 2.);
+		});
+	}
+	sg::pool::shared().wait(group);
+	bool inner = true;
+	for (std::vector<sg::Shape>& part : nested) {
+		inner = inner && same(part, expectedBox);
+	}
+	check("Batch from inside a pool task", inner);
+
+	// Exceptions from callbacks reach the caller, in parallel and sequentially, and the pool keeps working
+	auto throws = [&](auto&& shapes, sg::pool::Pool& pool) {
+		try {
+			sg::batch::forEach(shapes, [](size_t i, const sg::Shape&) {
+				if (i % 3 == 0) {
+					throw std::runtime_error("callback");
+				}
+			}, pool);
+		} catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	};
+	std::vector<sg::Shape> single = {shapes.front()};
+	bool plain = false;
+	workers.submit([]() {
+		throw std::runtime_error("task");
+	});
+	try {
+		workers.wait();
+	} catch (const std::runtime_error&) {
+		plain = true;
+	}
+	std::vector<sg::Shape> again = copy();
+	sg::batch::clip(again, box, 2.);
+	check("Exceptions from tasks are rethrown by wait", throws(shapes, sg::pool::shared()) && throws(shapes, workers) && throws(single, workers) && plain && same(again, expectedBox));
+
+	std::vector<sg::Point> points;
+	std::uniform_real_distribution<double> position(-40, 40);
+	for (int i = 0; i < 10001; ++i) {
+		points.push_back({position(random), position(random)});
+	}
+	points.push_back(mask[1]);
+	std::vector<uint8_t> out(points.size());
+	sg::batch::inside(points, mask, out);
+	size_t agree = 0;
+	for (size_t i = 0; i < points.size(); ++i) {
+		agree += (out[i] != 0) == sg::utils::inside(points[i], mask);
+	}
+	check("Batch inside equals utils::inside", agree == points.size());
+}
+
+/*
+
+Pipeline Test
+Every line through parse, clip and encode, stage errors counted,
+and source and sink exceptions rethrown by run() after the threads are joined
+
+*/
+
+void pipelineTest() {
+	print("\n\n#### Pipeline Test ####\n\n");
+
+	size_t total = 3000;
+	auto source = [total](size_t throwAt) {
+		return [total, throwAt, next = size_t(0)](sg::pipeline::Item& item) mutable {
+			if (next == throwAt) {
+				throw std::runtime_error("source");
+			}
+			if (next == total) {
+				return false;
+			}
+			item.text = "POINT (" + std::to_string(next % 100) + " " + std::to_string(next / 100) + ")";
+			++next;
+			return true;
+		};
+	};
+
+	auto pipeline = [](sg::pipeline::Pipeline& pipeline) -> sg::pipeline::Pipeline& {
+		return pipeline
+			.stage("parse", 2, sg::pipeline::parse())
+			.stage("fail", 3, [](sg::pipeline::Item& item) {
+				if (item.sequence % 7 == 3) {
+					throw std::runtime_error("stage");
+				}
+				return true;
+			})
+			.stage("clip", 2, sg::pipeline::clip({0, 0, 49.5, 100}))
+			.stage("encode", 1, sg::pipeline::encode());
+	};
+
+	sg::pipeline::Pipeline full({4});
+	pipeline(full);
+	std::vector<size_t> sequences;
+	std::vector<sg::pipeline::Stats> stats = full.run(source(-1), [&](sg::pipeline::Item& item) {
+		sequences.push_back(item.sequence);
+	});
+	std::sort(sequences.begin(), sequences.end());
+	std::vector<size_t> expected;
+	for (size_t i = 0; i < total; ++i) {
+		if (i % 7 != 3 && i % 100 < 50) {
+			expected.push_back(i);
+		}
+	}
+	check("Pipeline delivers every kept item", sequences == expected && stats[0].items == total && stats[2].errors == (total + 3) / 7 && stats.back().items == expected.size());
+
+	auto rethrows = [&](size_t sourceAt, size_t sinkAt, const std::string& what) {
+		sg::pipeline::Pipeline failing({4});
+		pipeline(failing);
+		size_t received = 0;
+		try {
+			failing.run(source(sourceAt), [&](sg::pipeline::Item&) {
+				if (received++ == sinkAt) {
+					throw std::runtime_error("sink");
+				}
+			});
+		} catch (const std::runtime_error& error) {
+			return what == error.what() && (sinkAt == size_t(-1) || received == sinkAt + 1);
+		}
+		return false;
+	};
+	check("Source exception is rethrown", rethrows(500, -1, "source") && rethrows(0, -1, "source"));
+	check("Sink exception is rethrown", rethrows(-1, 100, "sink") && rethrows(-1, 0, "sink"));
+}
+
+/*
+
+WKT Reader Test
+A file of every geometry type, several chunks long, read in parallel against Shape(std::string)
+on the same lines; Columns back to Shapes, and Shapes through Columns::add
+
+*/
+
+std::string randomWKT(std::mt19937& random) {
+	std::uniform_real_distribution<double> position(-180, 180);
+	std::uniform_int_distribution<int> count(3, 12);
+	auto coords = [&](size_t size, bool closed) {
+		std::ostringstream os;
+		os.precision(17);
+		sg::Point first = {position(random), position(random)};
+		os << "(" << first.x << " " << first.y;
+		for (size_t i = 1; i < size; ++i) {
+			os << ", " << position(random) << " " << position(random);
+		}
+		if (closed) {
+			os << ", " << first.x << " " << first.y;
+		}
+		os << ")";
+		return os.str();
+	};
+
+	switch (random() % 6) {
+		case 0: {
+			std::ostringstream os;
+			os.precision(17);
+			os << "POINT (" << position(random) << " " << position(random) << ")";
+			return os.str();
+		}
+		case 1:
+			return "LINESTRING " + coords(count(random), false);
+		case 2:
+			return "MULTILINESTRING (" + coords(count(random), false) + ", " + coords(count(random), false) + ")";
+		case 3:
+			return "POLYGON (" + coords(count(random), true) + ")";
+		case 4:
+			return "POLYGON (" + coords(count(random), true) + ", " + coords(count(random), true) + ")";
+		default:
+			return "MULTIPOLYGON ((" + coords(count(random), true) + "), (" + coords(count(random), true) + ", " + coords(count(random), true) + "))";
+	}
+}
+
+void wktReaderTest() {
+	print("\n\n#### WKT Reader Test ####\n\n");
+
+	std::mt19937 random(43);
+	std::vector<std::string> lines;
+	while (lines.size() < 30000) {
+		lines.push_back(randomWKT(random));
+		if (lines.size() % 997 == 0) {
+			lines.push_back("NOT WKT (1 2)");
+		}
+	}
+
+	std::string path = (std::filesystem::temp_directory_path() / "surfy-wkt-reader.wkt").string();
+	{
+		std::ofstream file(path);
+		for (size_t i = 0; i < lines.size(); ++i) {
+			file << lines[i] << "\n";
+			if (i % 1001 == 0) {
+				file << "\n"; // Blank lines are skipped
+			}
+		}
+	}
+
+	sg::pool::Pool workers(4);
+	sg::wkt::Reader reader(path, {}, workers);
+	std::vector<sg::Shape> shapes = reader.read();
+	bool same = reader.size() > 3 << 20 && shapes.size() == lines.size();
+	size_t failed = 0;
+	for (size_t i = 0; same && i < lines.size(); ++i) {
+		sg::Shape expected(lines[i]);
+		same = shapes[i].type == expected.type && shapes[i].empty == expected.empty && shapes[i].vertices == expected.vertices && shapes[i].wkt() == expected.wkt();
+		failed += shapes[i].empty;
+	}
+	check("Reader equals Shape(std::string) line by line", same && failed == lines.size() / 997);
+
+	std::vector<std::pair<size_t, std::string>> visited;
+	std::mutex mutex;
+	reader.forEach([&](size_t offset, sg::Shape& shape) {
+		std::lock_guard<std::mutex> lock(mutex);
+		visited.push_back({offset, shape.wkt()});
+	});
+	std::sort(visited.begin(), visited.end());
+	bool ordered = visited.size() == shapes.size();
+	for (size_t i = 0; ordered && i < shapes.size(); ++i) {
+		ordered = visited[i].second == shapes[i].wkt();
+	}
+	check("forEach offsets give the file order", ordered);
+
+	sg::wkt::Columns columns = reader.columns();
+	sg::wkt::Columns added;
+	bool round = columns.size() == shapes.size();
+	for (size_t i = 0; round && i < shapes.size(); ++i) {
+		added.add(shapes[i]);
+		sg::Shape fromColumns = columns.shape(i);
+		sg::Shape fromAdded = added.shape(i);
+		round = fromColumns.type == shapes[i].type && fromColumns.wkt() == shapes[i].wkt() && fromAdded.wkt() == shapes[i].wkt();
+	}
+	check("Columns round trip", round && added.points.size() == columns.points.size());
+
+	// CSV with a header and the WKT quoted in the second column
+	std::string csvPath = (std::filesystem::temp_directory_path() / "surfy-wkt-reader.csv").string();
+	{
+		std::ofstream file(csvPath);
+		file << "id,geometry,name\n";
+		for (size_t i = 0; i < 100; ++i) {
+			file << i << ",\"" << lines[i] << "\",x\n";
+		}
+	}
+	std::vector<sg::Shape> csv = sg::wkt::Reader(csvPath, {.column = 1, .header = true}).read();
+	bool quoted = csv.size() == 100;
+	for (size_t i = 0; quoted && i < 100; ++i) {
+		quoted = csv[i].wkt() == shapes[i].wkt();
+	}
+	check("CSV column with header", quoted);
+
+	std::string emptyPath = (std::filesystem::temp_directory_path() / "surfy-wkt-reader-empty.wkt").string();
+	std::ofstream(emptyPath).close();
+	size_t visits = 0;
+	sg::wkt::Reader empty(emptyPath);
+	empty.forEach([&](size_t, sg::Shape&) {
+		++visits;
+	});
+	check("Empty file reads nothing", empty.read().empty() && visits == 0 && empty.columns().size() == 0);
+	std::filesystem::remove(emptyPath);
+
+	sg::Shape z = sg::wkt::parse("POLYGON Z ((0 0 1, 0 1 1, 1 1 1, 0 0 1))");
+	check("Z ordinates skipped", z.type == "Polygon" && z.wkt() == sg::Shape("POLYGON ((0 0, 0 1, 1 1, 0 0))").wkt());
+
+	std::filesystem::remove(path);
+	std::filesystem::remove(csvPath);
+}
+
+/*
+
+GeoJSON Reader Test
+FeatureCollection with every geometry type, ids and properties, null and unsupported geometry,
+a single Feature, a bare Geometry, "type" after "coordinates", extra holes, a parse error and top-level scalars
+
+*/
+
+void geojsonReaderTest() {
+	print("\n\n#### GeoJSON Reader Test ####\n\n");
+
+	std::string text = R"({"type": "FeatureCollection", "name": "test", "features": [
+		{"type": "Feature", "id": 1, "properties": {"name": "a", "nested": {"list": [1, 2.5, null, true]}}, "geometry": {"type": "Point", "coordinates": [1.5, -2]}},
+		{"type": "Feature", "id": "two", "properties": null, "geometry": {"type": "LineString", "coordinates": [[0, 0], [1, 1], [2, 0]]}},
+		{"type": "Feature", "properties": {}, "geometry": {"type": "MultiLineString", "coordinates": [[[0, 0], [1, 1]], [[2, 2], [3, 3], [4, 2]]]}},
+		{"type": "Feature", "properties": {}, "geometry": {"coordinates": [[[0, 0], [10, 0], [10, 10], [0, 10], [0, 0]], [[2, 2], [4, 2], [4, 4], [2, 2]]], "type": "Polygon"}},
+		{"type": "Feature", "properties": {}, "geometry": {"type": "MultiPolygon", "coordinates": [[[[0, 0], [1, 0], [1, 1], [0, 0]]], [[[5, 5], [6, 5], [6, 6], [5, 5]]]]}},
+		{"type": "Feature", "properties": {"kind": "null"}, "geometry": null},
+		{"type": "Feature", "properties": {}, "geometry": {"type": "MultiPoint", "coordinates": [[0, 0], [1, 1]]}},
+		{"type": "Feature", "properties": {}, "geometry": {"type": "GeometryCollection", "geometries": [{"type": "Point", "coordinates": [0, 0]}]}},
+		{"type": "Feature", "properties": {}, "geometry": {"type": "Polygon", "coordinates": [[[0, 0], [10, 0], [10, 10], [0, 10], [0, 0]], [[1, 1], [2, 1], [2, 2], [1, 1]], [[5, 5], [6, 5], [6, 6], [5, 5]]]}}
+	]})";
+
+	std::vector<sg::Shape> shapes;
+	std::vector<sg::geojson::json> ids, properties;
+	bool parsed = sg::geojson::parse(text, [&](sg::geojson::Feature& feature) {
+		shapes.push_back(feature.shape);
+		ids.push_back(feature.id);
+		properties.push_back(feature.properties);
+	});
+
+	bool types = parsed && shapes.size() == 9 && shapes[0].type == "Point" && shapes[1].type == "Line" && shapes[2].type == "MultiLine" && shapes[3].type == "Polygon" && shapes[4].type == "MultiPolygon";
+	check("FeatureCollection of every type", types && shapes[0].geom.point.x == 1.5 && shapes[0].geom.point.y == -2 && shapes[2].geom.multiLine.items[1].coords.size() == 3 && shapes[4].geom.multiPolygon.items.size() == 2);
+	check("Type after coordinates", types && shapes[3].wkt() == sg::Shape("POLYGON ((0 0, 10 0, 10 10, 0 10, 0 0), (2 2, 4 2, 4 4, 2 2))").wkt());
+	check("Ids and properties", ids.size() == 9 && ids[0] == 1 && ids[1] == "two" && ids[2].is_null() && properties[0]["nested"]["list"][1] == 2.5 && properties[0]["name"] == "a" && properties[5]["kind"] == "null");
+	check("Null, MultiPoint and GeometryCollection give empty Shapes", shapes.size() == 9 && shapes[5].empty && shapes[6].empty && shapes[7].empty);
+
+	// One hole per Polygon: the last ring wins, like Shape(std::string) and wkt::parse
+	std::string holes = "POLYGON ((0 0, 10 0, 10 10, 0 10, 0 0), (1 1, 2 1, 2 2, 1 1), (5 5, 6 5, 6 6, 5 5))";
+	check("Extra holes are dropped like WKT", shapes.size() == 9 && shapes[8].wkt() == sg::Shape(holes).wkt() && shapes[8].wkt() == sg::wkt::parse(holes).wkt() && shapes[8].geom.polygon.inner.coords.front().x == 5);
+
+	size_t bare = 0;
+	sg::geojson::parse(R"({"type": "Feature", "geometry": {"type": "LineString", "coordinates": [[0, 0], [3, 4]]}, "properties": {"a": 1}})", [&](sg::geojson::Feature& feature) {
+		bare += feature.shape.type == "Line" && feature.properties["a"] == 1;
+	});
+	sg::geojson::parse(R"({"type": "Point", "coordinates": [7, 8]})", [&](sg::geojson::Feature& feature) {
+		bare += feature.shape.type == "Point" && feature.shape.geom.point.x == 7;
+	});
+	check("Single Feature and bare Geometry", bare == 2);
+
+	std::istringstream stream(text);
+	size_t streamed = 0;
+	bool noProperties = true;
+	sg::geojson::read(stream, [&](sg::geojson::Feature& feature) {
+		noProperties = noProperties && feature.properties.empty();
+		++streamed;
+	}, {.properties = false});
+	check("Stream without properties", streamed == 9 && noProperties);
+
+	size_t before = 0;
+	std::string broken = text.substr(0, text.find("MultiPoint"));
+	bool failed = !sg::geojson::parse(broken, [&](sg::geojson::Feature&) {
+		++before;
+	});
+	check("Parse error after the complete Features", failed && before == 6);
+
+	size_t scalars = 0;
+	bool rejected = true;
+	for (std::string scalar : {"42", "-1", "18446744073709551615", "1.5", "\"x\"", "null", "true"}) {
+		rejected = rejected && !sg::geojson::parse(scalar, [&](sg::geojson::Feature&) {
+			++scalars;
+		});
+	}
+	check("Top-level scalars are not GeoJSON", rejected && scalars == 0);
+}
+
+/*
+
+GeoJSON Writer Test
+Precision trimming, shortest round-trip numbers, empty and non-finite values as null,
+closed rings, and a Writer's FeatureCollection read back by the reader
+
+*/
+
+void geojsonWriterTest() {
+	print("\n\n#### GeoJSON Writer Test ####\n\n");
+
+	auto number = [](double value, int precision) {
+		std::string out;
+		sg::geojson::write::number(out, value, precision);
+		return out;
+	};
+	check("Precision drops trailing zeros", number(1.5, 4) == "1.5" && number(2, 3) == "2" && number(1.23456789, 3) == "1.235" && number(-0.1, 0) == "-0" && number(10, 0) == "10" && number(120.25, 6) == "120.25");
+	check("Shortest text reads back", number(0.1, -1) == "0.1" && number(1e21, -1) == "1e+21" && std::stod(number(1. / 3, -1)) == 1. / 3);
+	check("Non-finite numbers are null", number(std::numeric_limits<double>::quiet_NaN(), 3) == "null" && number(std::numeric_limits<double>::infinity(), -1) == "null");
+
+	check("Empty Shape is a null geometry", sg::geojson::stringify(sg::Shape()) == "null");
+
+	sg::types::Polygon open;
+	open.outer.coords = {{0, 0}, {1, 0}, {1, 1}};
+	check("Open rings are closed", sg::geojson::stringify(sg::Shape(std::move(open))) == R"({"type":"Polygon","coordinates":[[[0,0],[1,0],[1,1],[0,0]]]})");
+
+	std::string feature;
+	sg::geojson::feature(feature, sg::Shape("POINT (1.25 2)"), {{"name", "A"}}, 7, 1);
+	check("Feature with id, properties and precision", feature == R"({"type":"Feature","id":7,"geometry":{"type":"Point","coordinates":[1.2,2]},"properties":{"name":"A"}})");
+
+	// Writer to reader: full precision gives the same Shapes back, small flushes included
+	std::mt19937 random(45);
+	std::vector<sg::Shape> shapes;
+	for (int i = 0; i < 2000; ++i) {
+		shapes.emplace_back(randomWKT(random));
+	}
+	shapes.emplace_back();
+
+	std::ostringstream output;
+	{
+		sg::geojson::Writer writer(output, -1, 512);
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			writer.write(shapes[i], {{"index", i}}, i);
+		}
+	}
+
+	size_t index = 0;
+	bool same = true;
+	bool parsed = sg::geojson::parse(output.str(), [&](sg::geojson::Feature& feature) {
+		same = same && index < shapes.size() && feature.id == index && feature.properties["index"] == index && feature.shape.empty == shapes[index].empty && feature.shape.wkt() == shapes[index].wkt();
+		++index;
+	});
+	check("Writer to reader round trip", parsed && same && index == shapes.size());
+
+	std::ostringstream empty;
+	sg::geojson::Writer(empty).close();
+	size_t none = 0;
+	check("Empty FeatureCollection", sg::geojson::parse(empty.str(), [&](sg::geojson::Feature&) { ++none; }) && none == 0);
+}
+
+/*
+
+FlatGeobuf Test
+Write and read back with and without an index, search against brute force,
+a header count of 0 read by walking the features, and corrupt counts and vectors
+
+*/
+
+std::string readFile(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+	std::ofstream file(path, std::ios::binary);
+	file.write(data.data(), data.size());
+}
+
+void flatgeobufTest() {
+	print("\n\n#### FlatGeobuf Test ####\n\n");
+
+	std::mt19937 random(46);
+	std::vector<sg::Shape> shapes;
+	std::multiset<std::string> expected;
+	for (int i = 0; i < 3000; ++i) {
+		shapes.emplace_back(randomWKT(random));
+		expected.insert(shapes.back().wkt());
+	}
+	shapes.emplace_back();
+	expected.insert(shapes.back().wkt());
+
+	std::string indexed = (std::filesystem::temp_directory_path() / "surfy-indexed.fgb").string();
+	std::string plain = (std::filesystem::temp_directory_path() / "surfy-plain.fgb").string();
+	std::string crafted = (std::filesystem::temp_directory_path() / "surfy-crafted.fgb").string();
+	sg::flatgeobuf::write(indexed, shapes, {.name = "test", .crs = 4326});
+	sg::flatgeobuf::write(plain, shapes, {.nodeSize = 0});
+
+	auto readsBack = [&](const sg::flatgeobuf::Reader& reader) {
+		std::multiset<std::string> found;
+		for (sg::Shape& shape : reader.read()) {
+			found.insert(shape.wkt());
+		}
+		return found == expected;
+	};
+
+	sg::flatgeobuf::Reader reader(indexed);
+	sg::flatgeobuf::Reader unindexed(plain);
+	check("Write and read back", reader && reader.indexed() && !unindexed.indexed() && reader.header.name == "test" && reader.header.crs == 4326 && reader.size() == shapes.size() && readsBack(reader) && readsBack(unindexed));
+
+	std::vector<sg::Shape> all = reader.read();
+	std::uniform_real_distribution<double> position(-180, 160);
+	size_t same = 0;
+	for (int q = 0; q < 50; ++q) {
+		double x = position(random), y = position(random);
+		sg::BBox box = {x, y, x + 20, y + 20};
+		std::vector<size_t> found, plainFound;
+		reader.search(box, [&](size_t index, sg::Shape&) {
+			found.push_back(index);
+		});
+		unindexed.search(box, [&](size_t index, sg::Shape&) {
+			plainFound.push_back(index);
+		});
+		std::vector<size_t> brute = bruteSearch(all, box);
+		same += found == brute && plainFound.size() == brute.size();
+	}
+	check("Search against brute force", same == 50);
+
+	// features_count 0: unknown, the reader walks the size prefixes
+	std::string data = readFile(plain);
+	uint32_t headerSize;
+	std::memcpy(&headerSize, data.data() + 8, 4);
+	sg::flatgeobuf::flatbuffers::Table header = sg::flatgeobuf::flatbuffers::Table::root(reinterpret_cast<const uint8_t*>(data.data()) + 12, headerSize);
+	size_t countAt = header.field(8) - reinterpret_cast<const uint8_t*>(data.data());
+	std::string unknown = data;
+	std::memset(unknown.data() + countAt, 0, 8);
+	writeFile(crafted, unknown);
+	sg::flatgeobuf::Reader walked(crafted);
+	check("Unknown feature count walks the file", walked.size() == shapes.size() && readsBack(walked));
+
+	auto rejects = [&](const std::string& bytes) {
+		writeFile(crafted, bytes);
+		try {
+			sg::flatgeobuf::Reader reader(crafted);
+			reader.read();
+		} catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	};
+
+	std::string huge = readFile(indexed);
+	std::memcpy(&headerSize, huge.data() + 8, 4);
+	header = sg::flatgeobuf::flatbuffers::Table::root(reinterpret_cast<const uint8_t*>(huge.data()) + 12, headerSize);
+	countAt = header.field(8) - reinterpret_cast<const uint8_t*>(huge.data());
+	for (uint64_t count : {uint64_t(1) << 60, ~uint64_t(0), uint64_t(huge.size())}) {
+		std::memcpy(huge.data() + countAt, &count, 8);
+		same += rejects(huge);
+	}
+	check("Counts past the end of the file throw", same == 53 && rejects(data.substr(0, data.size() - 3)));
+
+	// Root node's first child pointing at the root itself, or past the level below
+	auto corrupt = [&](uint64_t child) {
+		std::string bytes = readFile(indexed);
+		std::memcpy(&headerSize, bytes.data() + 8, 4);
+		std::memcpy(bytes.data() + 12 + headerSize + 32, &child, 8);
+		writeFile(crafted, bytes);
+		try {
+			sg::flatgeobuf::Reader damaged(crafted);
+			damaged.read({-1e9, -1e9, 1e9, 1e9});
+		} catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	};
+	check("Child offsets outside the level below throw", corrupt(0) && corrupt(uint64_t(1) << 40));
+
+	// Vector of tables read past its length
+	sg::flatgeobuf::flatbuffers::Builder builder;
+	builder.clear();
+	size_t table = builder.table({{7, 4}});
+	size_t slot = builder.slots[7];
+	builder.root(table);
+	size_t offsets = builder.offsets(1);
+	builder.link(slot, offsets);
+	builder.link(offsets + 4, builder.table({{6, 1, sg::flatgeobuf::Polygon}}));
+	sg::flatgeobuf::flatbuffers::Table parts = sg::flatgeobuf::flatbuffers::Table::root(builder.bytes.data(), builder.bytes.size());
+	bool outside = false;
+	try {
+		parts.table(7, 1);
+	} catch (const std::runtime_error&) {
+		outside = true;
+	}
+	check("Table index checked against the vector", parts.count(7) == 1 && parts.table(7, 0).scalar<uint8_t>(6) == sg::flatgeobuf::Polygon && outside);
+
+	std::filesystem::remove(indexed);
+	std::filesystem::remove(plain);
+	std::filesystem::remove(crafted);
+}
+
+/*
+
+Store Test
+write, Store and shape(i) back to the same Shapes, search and containing through the tree
+against brute force, verify() on tampered offsets and a truncated file
+
+*/
+
+void storeTest() {
+	print("\n\n#### Store Test ####\n\n");
+
+	std::mt19937 random(47);
+	std::vector<sg::Shape> shapes;
+	for (int i = 0; i < 3000; ++i) {
+		shapes.emplace_back(randomWKT(random));
+		if (i % 500 == 0) {
+			shapes.emplace_back();
+		}
+	}
+
+	std::string path = (std::filesystem::temp_directory_path() / "surfy-store.sgs").string();
+	std::string plain = (std::filesystem::temp_directory_path() / "surfy-store-plain.sgs").string();
+	sg::store::write(path, shapes);
+	sg::store::write(plain, shapes, {.nodeSize = 0});
+
+	sg::store::Store store(path);
+	sg::store::Store unindexed(plain);
+	bool same = store.size() == shapes.size() && unindexed.size() == shapes.size() && store.indexed() && !unindexed.indexed() && store.verify();
+	for (size_t i = 0; same && i < shapes.size(); ++i) {
+		sg::Shape shape = store.shape(i);
+		same = shape.type == shapes[i].type && shape.empty == shapes[i].empty && shape.wkt() == shapes[i].wkt() && unindexed.shape(i).wkt() == shapes[i].wkt();
+	}
+	check("Write, Store and shape(i) round trip", same);
+
+	std::uniform_real_distribution<double> position(-180, 180);
+	size_t found = 0, inside = 0;
+	for (int q = 0; q < 100; ++q) {
+		double x = position(random), y = position(random);
+		sg::BBox box = {x, y, x + 15, y + 15};
+		std::vector<size_t> hits = store.search(box), plainHits = unindexed.search(box);
+		std::sort(hits.begin(), hits.end());
+		found += hits == bruteSearch(shapes, box) && plainHits == hits;
+
+		// Polygons and MultiPolygons by the even-odd rule over all of their rings
+		sg::Point point = {x, y};
+		std::vector<size_t> containing = store.containing(point);
+		std::sort(containing.begin(), containing.end());
+		std::vector<size_t> brute;
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			const sg::Shape& shape = shapes[i];
+			bool in = false;
+			if (shape.type == "Polygon" && !shape.empty) {
+				in = sg::utils::inside(point, shape.geom.polygon.outer.coords) != (!shape.geom.polygon.inner.coords.empty() && sg::utils::inside(point, shape.geom.polygon.inner.coords));
+			} else if (shape.type == "MultiPolygon") {
+				for (const sg::types::Polygon& poly : shape.geom.multiPolygon.items) {
+					in ^= sg::utils::inside(point, poly.outer.coords) != (!poly.inner.coords.empty() && sg::utils::inside(point, poly.inner.coords));
+				}
+			}
+			if (in) {
+				brute.push_back(i);
+			}
+		}
+		inside += containing == brute;
+	}
+	check("search and containing against brute force", found == 100 && inside == 100);
+
+	// Offsets that still fit the file but point the wrong way, and a tree link out of the tree
+	std::string data = readFile(path);
+	auto tampered = [&](sg::store::Section section, size_t at, uint64_t value) {
+		std::string bytes = data;
+		std::memcpy(bytes.data() + store.header.offsets[section] + at * sizeof(uint64_t), &value, sizeof(value));
+		std::string copy = (std::filesystem::temp_directory_path() / "surfy-store-tampered.sgs").string();
+		writeFile(copy, bytes);
+		sg::store::Store damaged(copy);
+		bool verified = damaged.verify();
+		std::filesystem::remove(copy);
+		return verified;
+	};
+	check("verify() rejects tampered offsets", !tampered(sg::store::Rings, 10, store.header.points) && !tampered(sg::store::Parts, 1, store.header.rings + 1) && !tampered(sg::store::Indices, 0, shapes.size()) && !tampered(sg::store::Indices, store.header.nodes - 1, store.header.nodes));
+
+	bool truncated = false;
+	std::string cut = (std::filesystem::temp_directory_path() / "surfy-store-cut.sgs").string();
+	writeFile(cut, data.substr(0, data.size() - 100));
+	try {
+		sg::store::Store damaged(cut);
+	} catch (const std::runtime_error&) {
+		truncated = true;
+	}
+	writeFile(cut, data.substr(0, 20));
+	try {
+		sg::store::Store damaged(cut);
+		truncated = false;
+	} catch (const std::runtime_error&) {
+	}
+	check("Truncated file throws on open", truncated);
+
+	std::filesystem::remove(path);
+	std::filesystem::remove(plain);
+	std::filesystem::remove(cut);
+}
+
+/*
+
+SQLite Test
+load() with and without the R*Tree, search against brute force on both,
+and GeoPackage blobs through the SQL functions: envelope, empty flag and a truncated header
+
+*/
+
+void sqliteTest() {
+	print("\n\n#### SQLite Test ####\n\n");
+
+	std::mt19937 random(48);
+	std::vector<sg::Shape> shapes;
+	for (int i = 0; i < 2000; ++i) {
+		shapes.emplace_back(randomWKT(random));
+		if (i % 400 == 0) {
+			shapes.emplace_back();
+		}
+	}
+
+	sqlite3* db = nullptr;
+	sqlite3_open(":memory:", &db);
+	sg::sqlite::install(db);
+	long long indexed = sg::sqlite::load(db, "t", shapes);
+	long long plain = sg::sqlite::load(db, "u", shapes, {.rtree = false});
+	check("load() with and without the R*Tree", indexed == static_cast<long long>(shapes.size()) && plain == indexed);
+
+	std::uniform_real_distribution<double> position(-180, 180);
+	size_t found = 0;
+	for (int q = 0; q < 100; ++q) {
+		double x = position(random), y = position(random);
+		sg::BBox box = {x, y, x + 20, y + 20};
+		std::vector<size_t> hits, plainHits;
+		bool same = true;
+		bool ok = sg::sqlite::search(db, "t", box, [&](long long id, sg::Shape& shape) {
+			hits.push_back(static_cast<size_t>(id - 1));
+			same = same && shape.wkt() == shapes[static_cast<size_t>(id - 1)].wkt();
+		});
+		ok = ok && same && sg::sqlite::search(db, "u", box, [&](long long id, sg::Shape&) {
+			plainHits.push_back(static_cast<size_t>(id - 1));
+		}, {.rtree = false});
+		std::sort(hits.begin(), hits.end());
+		std::sort(plainHits.begin(), plainHits.end());
+		found += ok && hits == bruteSearch(shapes, box) && plainHits == hits;
+	}
+	check("search() with and without the R*Tree against brute force", found == 100);
+
+	// Little-endian header with the xy envelope, then WKB
+	sg::Shape square("POLYGON((0 0,4 0,4 4,0 4,0 0))");
+	std::string blob("GP\0\x03\0\0\0\0", 8);
+	for (double value : {0., 4., 0., 4.}) {
+		blob.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	blob += sg::wkb::encode(square);
+	std::string empty("GP\0\x11\0\0\0\0", 8);
+	std::string truncated = blob.substr(0, 20);
+
+	auto query = [&](const std::string& sql, const std::string& argument, std::string& out) {
+		sg::sqlite::Statement statement = sg::sqlite::prepare(db, sql);
+		sqlite3_bind_blob(statement.get(), 1, argument.data(), static_cast<int>(argument.size()), SQLITE_STATIC);
+		if (sqlite3_step(statement.get()) != SQLITE_ROW) {
+			return false;
+		}
+		const unsigned char* text = sqlite3_column_text(statement.get(), 0);
+		out = text ? reinterpret_cast<const char*>(text) : "NULL";
+		return true;
+	};
+	std::string area, wkt, error;
+	bool parsed = query("SELECT geom_area(?)", blob, area) && std::stod(area) == 16;
+	bool emptied = query("SELECT geom_wkt(?)", empty, wkt) && wkt == "NULL";
+	bool rejected = !query("SELECT geom_area(?)", truncated, error);
+	bool thrown = false;
+	try {
+		sg::sqlite::geopackage(reinterpret_cast<const uint8_t*>(truncated.data()), truncated.size());
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	check("GeoPackage blobs: envelope, empty flag, truncated header is an error", parsed && emptied && rejected && thrown);
+
+	sqlite3_close(db);
+}
+
+/*
+
+GeoPackage Test
+write and Reader back to the same Shapes, bbox search with and without the rtree against brute force,
+and the rtree triggers firing on later edits once sqlite::install has registered the ST_ functions
+
+*/
+
+void gpkgTest() {
+	print("\n\n#### GeoPackage Test ####\n\n");
+
+	std::mt19937 random(49);
+	std::vector<sg::Shape> shapes;
+	for (int i = 0; i < 2000; ++i) {
+		shapes.emplace_back(randomWKT(random));
+		if (i % 400 == 0) {
+			shapes.emplace_back();
+		}
+	}
+
+	std::string path = (std::filesystem::temp_directory_path() / "surfy-gpkg.gpkg").string();
+	std::filesystem::remove(path);
+	bool written = sg::gpkg::write(path, "indexed", shapes) && sg::gpkg::write(path, "plain", shapes, {.rtree = false});
+
+	bool same = false, layers = false;
+	{
+		sg::gpkg::Reader reader(path);
+		const sg::gpkg::Layer* indexed = reader.layer("indexed");
+		const sg::gpkg::Layer* plain = reader.layer("plain");
+		layers = reader && indexed && plain && indexed->indexed && !plain->indexed && indexed->key == "fid" && indexed->srs == 4326 && indexed->type == "GEOMETRY";
+
+		std::vector<sg::Shape> all = reader.read("indexed");
+		same = all.size() == shapes.size();
+		for (size_t i = 0; same && i < shapes.size(); ++i) {
+			same = all[i].empty == shapes[i].empty && all[i].wkt() == shapes[i].wkt();
+		}
+		check("write and Reader round trip", written && layers && same);
+
+		std::uniform_real_distribution<double> position(-180, 180);
+		size_t found = 0;
+		for (int q = 0; q < 100; ++q) {
+			double x = position(random), y = position(random);
+			sg::BBox box = {x, y, x + 20, y + 20};
+			std::vector<size_t> hits, plainHits;
+			bool ok = reader.search("indexed", box, [&](long long fid, sg::Shape&) {
+				hits.push_back(static_cast<size_t>(fid - 1));
+			});
+			ok = ok && reader.search("plain", box, [&](long long fid, sg::Shape&) {
+				plainHits.push_back(static_cast<size_t>(fid - 1));
+			});
+			std::sort(hits.begin(), hits.end());
+			std::sort(plainHits.begin(), plainHits.end());
+			found += ok && hits == bruteSearch(shapes, box) && plainHits == hits;
+		}
+		check("search with and without the rtree against brute force", found == 100);
+	}
+
+	// Edits through the triggers: insert, move, empty and delete
+	sqlite3* db = nullptr;
+	sqlite3_open(path.c_str(), &db);
+	bool missing = sqlite3_exec(db, "UPDATE indexed SET geom = geom WHERE fid = 1", nullptr, nullptr, nullptr) != SQLITE_OK;
+	sg::sqlite::install(db);
+
+	auto update = [&](const std::string& sql, const sg::Shape& shape) {
+		std::string data;
+		if (!shape.empty) {
+			sg::gpkg::blob::write(data, shape, 4326);
+		}
+		sg::sqlite::Statement statement = sg::sqlite::prepare(db, sql);
+		if (shape.empty) {
+			sqlite3_bind_null(statement.get(), 1);
+		} else {
+			sqlite3_bind_blob(statement.get(), 1, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+		}
+		return sqlite3_step(statement.get()) == SQLITE_DONE;
+	};
+	auto node = [&](long long id) {
+		sg::sqlite::Statement statement = sg::sqlite::prepare(db, "SELECT minx, maxx, miny, maxy FROM rtree_indexed_geom WHERE id = " + std::to_string(id));
+		std::vector<double> box;
+		if (sqlite3_step(statement.get()) == SQLITE_ROW) {
+			for (int i = 0; i < 4; ++i) {
+				box.push_back(sqlite3_column_double(statement.get(), i));
+			}
+		}
+		return box;
+	};
+
+	sg::Shape far("POLYGON((500 500,510 500,510 520,500 520,500 500))");
+	bool inserted = update("INSERT INTO indexed (geom) VALUES (?)", far) && node(sqlite3_last_insert_rowid(db)) == std::vector<double>{500, 510, 500, 520};
+	bool moved = update("UPDATE indexed SET geom = ? WHERE fid = 2", far) && node(2) == std::vector<double>{500, 510, 500, 520};
+	bool emptied = update("UPDATE indexed SET geom = ? WHERE fid = 3", sg::Shape()) && node(3).empty();
+	bool deleted = sqlite3_exec(db, "DELETE FROM indexed WHERE fid = 4", nullptr, nullptr, nullptr) == SQLITE_OK && node(4).empty();
+	sqlite3_close(db);
+
+	std::vector<sg::Shape> hits;
+	{
+		sg::gpkg::Reader reader(path);
+		hits = reader.read("indexed", {505, 505, 506, 506});
+	}
+	check("rtree triggers with the ST_ functions installed", missing && inserted && moved && emptied && deleted && hits.size() == 2);
+
+	std::filesystem::remove(path);
+}
+
+/*
+
+Shapefile Test
+A .shp and .shx written here: clockwise outers with counterclockwise holes, records with several outers
+and Null records, read with and without the .shx, over several chunks, and searched against brute force
+
+*/
+
+// Polygon record, parts as given, or a Null record without parts
+std::string shapefileRecord(const std::vector<sg::Coords>& parts) {
+	auto put = [](std::string& out, auto value) {
+		out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	};
+
+	std::string content;
+	if (parts.empty()) {
+		put(content, int32_t(sg::shapefile::Null));
+		return content;
+	}
+
+	sg::BBox box = sg::utils::bbox(parts.front());
+	int32_t points = 0;
+	for (const sg::Coords& part : parts) {
+		sg::BBox bounds = sg::utils::bbox(part);
+		box = {std::min(box[0], bounds[0]), std::min(box[1], bounds[1]), std::max(box[2], bounds[2]), std::max(box[3], bounds[3])};
+		points += static_cast<int32_t>(part.size());
+	}
+	put(content, int32_t(sg::shapefile::Polygon));
+	for (double side : box) {
+		put(content, side);
+	}
+	put(content, static_cast<int32_t>(parts.size()));
+	put(content, points);
+	int32_t start = 0;
+	for (const sg::Coords& part : parts) {
+		put(content, start);
+		start += static_cast<int32_t>(part.size());
+	}
+	for (const sg::Coords& part : parts) {
+		for (const sg::Point& point : part) {
+			put(content, point.x);
+			put(content, point.y);
+		}
+	}
+	return content;
+}
+
+// Writes path.shp and path.shx from record contents
+void writeShapefile(const std::string& path, const std::vector<std::string>& records, const sg::BBox& box) {
+	auto big = [](std::string& out, uint32_t value) {
+		value = __builtin_bswap32(value);
+		out.append(reinterpret_cast<const char*>(&value), 4);
+	};
+	auto header = [&](size_t size) {
+		std::string out;
+		big(out, sg::shapefile::FILE_CODE);
+		out.append(20, '\0');
+		big(out, static_cast<uint32_t>(size / 2));
+		int32_t version = 1000, type = sg::shapefile::Polygon;
+		out.append(reinterpret_cast<const char*>(&version), 4);
+		out.append(reinterpret_cast<const char*>(&type), 4);
+		for (double side : box) {
+			out.append(reinterpret_cast<const char*>(&side), 8);
+		}
+		out.append(32, '\0');
+		return out;
+	};
+
+	std::string shp, shx;
+	for (size_t i = 0; i < records.size(); ++i) {
+		big(shx, static_cast<uint32_t>((sg::shapefile::HEADER_SIZE + shp.size()) / 2));
+		big(shx, static_cast<uint32_t>(records[i].size() / 2));
+		big(shp, static_cast<uint32_t>(i + 1));
+		big(shp, static_cast<uint32_t>(records[i].size() / 2));
+		shp += records[i];
+	}
+	writeFile(path + ".shp", header(sg::shapefile::HEADER_SIZE + shp.size()) + shp);
+	writeFile(path + ".shx", header(sg::shapefile::HEADER_SIZE + shx.size()) + shx);
+}
+
+void shapefileTest() {
+	print("\n\n#### Shapefile Test ####\n\n");
+
+	// Clockwise square, or counterclockwise for holes
+	auto square = [](double x, double y, double size, bool hole) {
+		sg::Coords ring = {{x, y}, {x, y + size}, {x + size, y + size}, {x + size, y}, {x, y}};
+		if (hole) {
+			std::reverse(ring.begin(), ring.end());
+		}
+		return ring;
+	};
+	auto text = [](const sg::Coords& ring) {
+		std::string out = "(";
+		for (const sg::Point& point : ring) {
+			out += (out.size() > 1 ? "," : "") + std::to_string(point.x) + " " + std::to_string(point.y);
+		}
+		return out + ")";
+	};
+
+	// Holed polygons, two outers with the hole listed first, Null records, over a few MB.
+	// Outers keep their file order
+	std::mt19937 random(50);
+	std::uniform_int_distribution<int> position(-1000, 1000);
+	std::vector<std::string> records;
+	std::vector<sg::Shape> expected;
+	sg::BBox extent = {-1000, -1000, 1020, 1020};
+	for (int i = 0; i < 30000; ++i) {
+		double x = position(random), y = position(random);
+		sg::Coords outer = square(x, y, 10, false), hole = square(x + 2, y + 2, 3, true);
+		if (i % 1000 == 7) {
+			records.push_back(shapefileRecord({}));
+			expected.emplace_back();
+		} else if (i % 5 == 0) {
+			sg::Coords second = square(x + 12, y, 8, false);
+			records.push_back(shapefileRecord({hole, second, outer}));
+			expected.emplace_back("MULTIPOLYGON((" + text(second) + "),(" + text(outer) + "," + text(hole) + "))");
+		} else {
+			records.push_back(shapefileRecord({outer, hole}));
+			expected.emplace_back("POLYGON(" + text(outer) + "," + text(hole) + ")");
+		}
+	}
+
+	std::string path = (std::filesystem::temp_directory_path() / "surfy-shapefile").string();
+	writeShapefile(path, records, extent);
+
+	auto same = [&](const std::vector<sg::Shape>& shapes) {
+		if (shapes.size() != expected.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			sg::Shape shape = shapes[i];
+			if (shape.type != expected[i].type || shape.empty != expected[i].empty || shape.wkt() != sg::Shape(expected[i]).wkt()) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	sg::pool::Pool workers(4);
+	sg::shapefile::Reader reader(path + ".shp", workers);
+	check("Header type and bbox", reader && reader.type == sg::shapefile::Polygon && reader.bbox == extent && reader.size() == records.size());
+
+	sg::Shape holed = reader.shape(1);
+	sg::Shape multi = reader.shape(0);
+	sg::Shape null = reader.shape(7);
+	sg::BBox nullBox;
+	bool parts = holed.type == "Polygon" && !holed.geom.polygon.inner.coords.empty() && sg::shapefile::winding(holed.geom.polygon.inner.coords) > 0;
+	parts = parts && multi.type == "MultiPolygon" && multi.geom.multiPolygon.items.size() == 2 && !multi.geom.multiPolygon.items[1].inner.coords.empty() && multi.geom.multiPolygon.items[0].inner.coords.empty();
+	check("Clockwise outer with a hole, two outers, Null record", parts && null.empty && !reader.box(7, nullBox));
+	check("read() in record order over several chunks", same(reader.read()));
+
+	std::vector<int> visits(records.size());
+	reader.forEach([&](size_t index, sg::Shape&) {
+		++visits[index];
+	});
+	check("forEach visits each record once", std::all_of(visits.begin(), visits.end(), [](int count) { return count == 1; }));
+
+	size_t found = 0;
+	for (int q = 0; q < 50; ++q) {
+		double x = position(random), y = position(random);
+		sg::BBox box = {x, y, x + 50, y + 50};
+		std::vector<sg::Shape> hits = reader.read(box);
+		std::vector<size_t> brute = bruteSearch(expected, box);
+		bool match = hits.size() == brute.size();
+		for (size_t i = 0; match && i < hits.size(); ++i) {
+			match = hits[i].wkt() == sg::Shape(expected[brute[i]]).wkt();
+		}
+		found += match;
+	}
+	check("read(bbox) against brute force", found == 50);
+
+	std::filesystem::remove(path + ".shx");
+	sg::shapefile::Reader scanned(path + ".shp");
+	check("Without .shx, records from a scan of the .shp", scanned && scanned.size() == records.size() && same(scanned.read()));
+
+	// Header only, no records
+	writeShapefile(path, {}, extent);
+	size_t emptyVisits = 0;
+	sg::shapefile::Reader empty(path + ".shp");
+	empty.forEach([&](size_t, sg::Shape&) {
+		++emptyVisits;
+	});
+	check("Empty file reads nothing", empty && empty.size() == 0 && empty.read().empty() && empty.read(extent).empty() && emptyVisits == 0);
+	std::filesystem::remove(path + ".shx");
+
+	std::filesystem::remove(path + ".shp");
+}
+
+/*
+
+Join Test
+Pairs and counts against testing every point in every PreparedPolygon,
+NaN, infinite and outside points mixed in, and a join run from a pool task
+
+*/
+
+void joinTest() {
+	print("\n\n#### Join Test ####\n\n");
+
+	std::mt19937 random(36);
+	std::uniform_real_distribution<double> unit(0, 1);
+	std::vector<sg::Shape> regions = randomBoxes(random, 300, 0, 0, 100, 30);
+
+	std::vector<sg::Point> points;
+	for (size_t i = 0; i < 20000; ++i) {
+		points.push_back({unit(random) * 300 - 150, unit(random) * 300 - 150});
+	}
+	double nan = std::numeric_limits<double>::quiet_NaN(), inf = std::numeric_limits<double>::infinity();
+	points.push_back({nan, 0});
+	points.push_back({0, nan});
+	points.push_back({inf, 0});
+	points.push_back({-inf, -inf});
+	points.push_back({1e300, -1e300});
+
+	std::vector<std::pair<size_t, size_t>> expected;
+	std::vector<size_t> expectedCounts(regions.size(), 0);
+	for (size_t r = 0; r < regions.size(); ++r) {
+		sg::PreparedPolygon prepared(regions[r]);
+		for (size_t i = 0; i < points.size(); ++i) {
+			if (prepared.contains(points[i])) {
+				expected.push_back({i, r});
+				++expectedCounts[r];
+			}
+		}
+	}
+	std::sort(expected.begin(), expected.end());
+
+	auto matches = [&](const sg::join::Join& join) {
+		std::vector<std::pair<size_t, size_t>> found;
+		for (const sg::join::Pair& pair : join.pairs(points)) {
+			found.push_back({pair.point, pair.polygon});
+		}
+		std::sort(found.begin(), found.end());
+		return found == expected && join.counts(points) == expectedCounts;
+	};
+
+	sg::join::Join join(regions, {.chunk = 1000});
+	check("Join pairs and counts against brute force", !expected.empty() && matches(join));
+
+	sg::pool::Pool workers(3);
+	sg::join::Join own(regions, {.chunk = 777}, workers);
+	check("Join on a private pool", matches(own));
+
+	// Nested in a task of the same shared pool it runs on
+	bool nested = false;
+	sg::pool::Group group;
+	sg::pool::shared().submit(group, [&]() {
+		sg::join::Join inner(regions, {.chunk = 500});
+		nested = matches(inner);
+	});
+	sg::pool::shared().wait(group);
+	check("Join from inside a pool task", nested);
+}
+
+/*
+
+R-tree Test
+Random inserts, updates and removes against a brute-force map, with snapshots
+taken along the way still answering for the epoch they were published in
+
+*/
+
+std::vector<uint64_t> bruteSearch(const std::map<uint64_t, sg::BBox>& items, const sg::BBox& query) {
+	std::vector<uint64_t> result;
+	for (const auto& [id, box] : items) {
+		if (sg::index::intersects(query, box)) {
+			result.push_back(id);
+		}
+	}
+	return result;
+}
+
+void rtreeTest() {
+	print("\n\n#### R-tree Test ####\n\n");
+
+	std::mt19937 random(32);
+	std::uniform_real_distribution<double> position(0, 1000);
+	std::uniform_real_distribution<double> side(0, 20);
+	std::uniform_int_distribution<uint64_t> ids(0, 3000);
+	std::uniform_int_distribution<int> action(0, 9);
+
+	auto randomBox = [&]() {
+		double x = position(random), y = position(random);
+		return sg::BBox{x, y, x + side(random), y + side(random)};
+	};
+
+	sg::index::Dynamic tree;
+	std::map<uint64_t, sg::BBox> items;
+	std::vector<std::pair<sg::index::Snapshot, std::map<uint64_t, sg::BBox>>> snapshots;
+	std::vector<sg::BBox> queries;
+	for (int q = 0; q < 20; ++q) {
+		queries.push_back(randomBox());
+		queries.back()[2] += 80;
+		queries.back()[3] += 80;
+	}
+
+	size_t same = 0, checked = 0, removed = 0;
+	for (int step = 0; step < 20000; ++step) {
+		uint64_t id = ids(random);
+		int kind = action(random);
+		if (kind < 6) {
+			sg::BBox box = randomBox();
+			tree.insert(id, box);
+			items[id] = box;
+		} else if (kind < 8) {
+			bool found = items.erase(id) != 0;
+			removed += found;
+			same += tree.remove(id) == found;
+			++checked;
+		} else {
+			sg::BBox box = randomBox();
+			tree.update(id, box);
+			items[id] = box;
+		}
+
+		if (step % 1000 == 999) {
+			for (const sg::BBox& query : queries) {
+				std::vector<uint64_t> found = tree.search(query);
+				std::sort(found.begin(), found.end());
+				same += found == bruteSearch(items, query) && tree.size() == items.size();
+				++checked;
+			}
+			tree.publish();
+			snapshots.push_back({tree.snapshot(), items});
+			if (snapshots.size() > 4) {
+				snapshots.erase(snapshots.begin());
+			}
+		}
+
+		// Older snapshots keep seeing their epoch while the writer goes on
+		if (step % 250 == 0) {
+			for (const auto& [snapshot, state] : snapshots) {
+				for (const sg::BBox& query : queries) {
+					std::vector<uint64_t> found = snapshot.search(query);
+					std::sort(found.begin(), found.end());
+					same += found == bruteSearch(state, query) && snapshot.size() == state.size();
+					++checked;
+				}
+			}
+		}
+	}
+	check("Dynamic tree and snapshots against brute force", same == checked && removed > 1000);
+
+	// Everything removed: empty tree, ids can come back
+	for (const auto& [id, box] : std::map<uint64_t, sg::BBox>(items)) {
+		tree.remove(id);
+	}
+	bool empty = tree.size() == 0 && tree.search({0, 0, 2000, 2000}).empty();
+	tree.insert(7, sg::BBox{1, 1, 2, 2});
+	check("Tree empties and refills", empty && tree.search({0, 0, 5, 5}) == std::vector<uint64_t>{7});
+}
+
 int main() {
 
 	// pointTest();
@@ -339,6 +2457,31 @@ int main() {
 	// polygonTest();
 	// multiPolygonTest();
 	prune();
-
-	return 0;
+	mvtTest();
+	tilesTest();
+	bufferedClipTest();
+	significanceTest();
+	filterTest();
+	indexTest();
+	nearestTest();
+	preparedTest();
+	curveTest();
+	coverTest();
+	rasterTest();
+	quadtreeTest();
+	batchTest();
+	pipelineTest();
+	wktReaderTest();
+	geojsonReaderTest();
+	geojsonWriterTest();
+	flatgeobufTest();
+	storeTest();
+	sqliteTest();
+	gpkgTest();
+	shapefileTest();
+	joinTest();
+	rtreeTest();
+
+	print("\nFailed checks:", failures);
+	return failures != 0;
 }
\ No newline at end of file